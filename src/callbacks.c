@@ -6,6 +6,8 @@
 #include "types.h"
 #include "fstream.h"
 #include "buffer.h"
+#include "m3u8.h"
+#include "writer.h"
 
 #if defined(_WIN32) && defined(_UNICODE)
 	#include "wio.h"
@@ -33,29 +35,45 @@ size_t curl_write_string_cb(char* ptr, size_t size, size_t nmemb, void* userdata
 	
 }
 
-size_t curl_progress_cb(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+size_t curl_write_file_cb(char* ptr, size_t size, size_t nmemb, void* userdata) {
 	
-	(void) (clientp);
-	(void) (ultotal);
-	(void) (ulnow);
+	struct FStream* const stream = (struct FStream*) userdata;
 	
-	const curl_off_t progress = dltotal < 1 ? 0 : (dlnow * 100) / dltotal;
+	const size_t chunk_size = size * nmemb;
 	
-	printf("\r+ Atualmente em progresso: %" CURL_FORMAT_CURL_OFF_T "%% / 100%%\r", progress);
+	if (fstream_write(stream, ptr, chunk_size) == -1) {
+		return 0;
+	}
 	
-	fflush(stdout);
+	return chunk_size;
 	
-	return 0;
+}
+
+size_t curl_write_async_cb(char* ptr, size_t size, size_t nmemb, void* userdata) {
+	
+	struct WriterFile* const file = (struct WriterFile*) userdata;
+	
+	const size_t chunk_size = size * nmemb;
+	
+	switch (writer_write(file, ptr, chunk_size)) {
+		case 0:
+			return chunk_size;
+		case 1:
+			// No buffer available; the transfer is resumed once one is
+			return CURL_WRITEFUNC_PAUSE;
+		default:
+			return 0;
+	}
 	
 }
 
-size_t curl_write_file_cb(char* ptr, size_t size, size_t nmemb, void* userdata) {
+size_t curl_write_m3u8_cb(char* ptr, size_t size, size_t nmemb, void* userdata) {
 	
-	struct FStream* const stream = (struct FStream*) userdata;
+	struct M3U8Parser* const parser = (struct M3U8Parser*) userdata;
 	
 	const size_t chunk_size = size * nmemb;
 	
-	if (fstream_write(stream, ptr, chunk_size) == -1) {
+	if (m3u8parser_feed(parser, ptr, chunk_size) != M3U8ERR_SUCCESS) {
 		return 0;
 	}
 	
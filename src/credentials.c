@@ -4,7 +4,13 @@
 
 void credentials_free(struct Credentials* obj) {
 	
+	free(obj->username);
+	obj->username = NULL;
+	
 	free(obj->access_token);
 	obj->access_token = NULL;
 	
+	free(obj->cookie_jar);
+	obj->cookie_jar = NULL;
+	
 }
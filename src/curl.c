@@ -2,11 +2,13 @@
 #include <string.h>
 
 #if defined(_WIN32)
+	#include <windows.h>
 	#include <synchapi.h>
 #endif
 
 #if !defined(_WIN32)
 	#include <unistd.h>
+	#include <pthread.h>
 #endif
 
 #include <curl/curl.h>
@@ -17,6 +19,7 @@
 #include "symbols.h"
 #include "fstream.h"
 #include "errors.h"
+#include "trace.h"
 
 #ifndef ARA_DISABLE_CERTIFICATE_VALIDATION
 	static const char CA_CERT_FILENAME[] = 
@@ -32,13 +35,56 @@ static const char HTTP_DEFAULT_USER_AGENT[] = "Mozilla/5.0 (Windows NT 10.0; Win
 static const long HTTP_MAX_CONCURRENT_CONNECTIONS = 30L;
 static const size_t HTTP_MAX_RETRIES = 10;
 
-static char CURL_ERROR_MESSAGE[CURL_ERROR_SIZE] = {'\0'};
+/*
+Each thread gets handles of its own, as cURL handles must not be used by more than one thread
+at a time. What can be shared between them (resolved host names, TLS sessions and the
+connections themselves) goes through curl_share_global instead, so that a thread does not have
+to look up a host, connect to it or go through a full handshake with it just because another
+thread got there first.
+
+The connection limit is process-wide: besides the multi handles sharing one connection pool, a
+transfer has to take one of the slots counted by curl_slots_global before it is handed to a
+multi handle (see curl_slot_acquire()), so that the threads never run more transfers at a time
+than the limit allows, however the work happens to be spread between them.
+
+The handles of a thread are kept in thread-specific storage rather than in __thread variables,
+since not every target we build for has compiler support for thread-local storage (the same
+reason it is stripped from Tidy, see CMakeLists.txt).
+*/
+struct CurlThread {
+	CURL* easy;
+	CURLM* multi;
+	char error[CURL_ERROR_SIZE];
+};
 
 static int GLOBALS_INITIALIZED = 0;
 
-static CURL* curl_easy_global = NULL;
-static CURLM* curl_multi_global = NULL;
+#ifdef _WIN32
+	static DWORD curl_thread_key = TLS_OUT_OF_INDEXES;
+#else
+	static pthread_key_t curl_thread_key;
+	static int curl_thread_key_created = 0;
+#endif
+
+static CURLSH* curl_share_global = NULL;
+static long curl_connections_global = 0; /* Process-wide connection limit; 0 means the default, with no limit on transfers */
+static long curl_slots_global = 0; /* Transfers currently holding a slot */
 static struct curl_blob curl_blob_global = {0};
+static struct FStream* ca_bundle_global = NULL; /* Mapped into curl_blob_global */
+
+#ifdef _WIN32
+	static CRITICAL_SECTION curl_share_locks[CURL_LOCK_DATA_LAST];
+#else
+	static pthread_mutex_t curl_share_locks[CURL_LOCK_DATA_LAST];
+#endif
+
+#ifdef _WIN32
+	static CRITICAL_SECTION curl_slots_lock;
+	static CONDITION_VARIABLE curl_slots_changed;
+#else
+	static pthread_mutex_t curl_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+	static pthread_cond_t curl_slots_changed = PTHREAD_COND_INITIALIZER;
+#endif
 
 void __curl_slist_free_all(struct curl_slist** ptr) {
 	curl_slist_free_all(*ptr);
@@ -52,16 +98,102 @@ void __curl_url_cleanup(CURLU** ptr) {
 	curl_url_cleanup(*ptr);
 }
 
+void __curl_slot_release(size_t* ptr) {
+	curl_slot_release(*ptr);
+}
+
+static struct CurlThread* curl_thread(const int create) {
+	/*
+	Returns the handles of the calling thread, setting them up if asked to; a null pointer if
+	there are none (or they could not be set up).
+	*/
+	
+	#ifdef _WIN32
+		if (curl_thread_key == TLS_OUT_OF_INDEXES) {
+			return NULL;
+		}
+		
+		struct CurlThread* thread = (struct CurlThread*) TlsGetValue(curl_thread_key);
+	#else
+		if (!curl_thread_key_created) {
+			return NULL;
+		}
+		
+		struct CurlThread* thread = (struct CurlThread*) pthread_getspecific(curl_thread_key);
+	#endif
+	
+	if (thread != NULL || !create) {
+		return thread;
+	}
+	
+	thread = calloc(1, sizeof(*thread));
+	
+	if (thread == NULL) {
+		return NULL;
+	}
+	
+	#ifdef _WIN32
+		const int status = TlsSetValue(curl_thread_key, thread) ? 0 : -1;
+	#else
+		const int status = pthread_setspecific(curl_thread_key, thread) == 0 ? 0 : -1;
+	#endif
+	
+	if (status == -1) {
+		free(thread);
+		return NULL;
+	}
+	
+	return thread;
+	
+}
+
+static void share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+	
+	(void) handle;
+	(void) access;
+	(void) userptr;
+	
+	#ifdef _WIN32
+		EnterCriticalSection(&curl_share_locks[data]);
+	#else
+		pthread_mutex_lock(&curl_share_locks[data]);
+	#endif
+	
+}
+
+static void share_unlock(CURL* handle, curl_lock_data data, void* userptr) {
+	
+	(void) handle;
+	(void) userptr;
+	
+	#ifdef _WIN32
+		LeaveCriticalSection(&curl_share_locks[data]);
+	#else
+		pthread_mutex_unlock(&curl_share_locks[data]);
+	#endif
+	
+}
+
 static void globals_destroy(void) {
 	
-	curl_multi_cleanup(curl_multi_global);
-	curl_multi_global = NULL;
+	free_global_curl();
 	
-	curl_easy_cleanup(curl_easy_global);
-	curl_easy_global = NULL;
+	if (curl_share_global != NULL) {
+		curl_share_cleanup(curl_share_global);
+		curl_share_global = NULL;
+		
+		for (size_t index = 0; index < CURL_LOCK_DATA_LAST; index++) {
+			#ifdef _WIN32
+				DeleteCriticalSection(&curl_share_locks[index]);
+			#else
+				pthread_mutex_destroy(&curl_share_locks[index]);
+			#endif
+		}
+	}
 	
-	if (curl_blob_global.data != NULL) {
-		free(curl_blob_global.data);
+	if (ca_bundle_global != NULL) {
+		fstream_close(ca_bundle_global);
+		ca_bundle_global = NULL;
 		
 		curl_blob_global.data = NULL;
 		curl_blob_global.len = 0;
@@ -77,8 +209,34 @@ static int globals_initialize(void) {
 	
 	curl_global_init(CURL_GLOBAL_ALL);
 	
+	#ifdef _WIN32
+		curl_thread_key = TlsAlloc();
+		InitializeCriticalSection(&curl_slots_lock);
+		InitializeConditionVariable(&curl_slots_changed);
+	#else
+		curl_thread_key_created = (pthread_key_create(&curl_thread_key, NULL) == 0);
+	#endif
+	
 	atexit(globals_destroy);
 	
+	curl_share_global = curl_share_init();
+	
+	if (curl_share_global != NULL) {
+		for (size_t index = 0; index < CURL_LOCK_DATA_LAST; index++) {
+			#ifdef _WIN32
+				InitializeCriticalSection(&curl_share_locks[index]);
+			#else
+				pthread_mutex_init(&curl_share_locks[index], NULL);
+			#endif
+		}
+		
+		curl_share_setopt(curl_share_global, CURLSHOPT_LOCKFUNC, share_lock);
+		curl_share_setopt(curl_share_global, CURLSHOPT_UNLOCKFUNC, share_unlock);
+		curl_share_setopt(curl_share_global, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(curl_share_global, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		curl_share_setopt(curl_share_global, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+	}
+	
 	#ifndef ARA_DISABLE_CERTIFICATE_VALIDATION
 		char app_filename[PATH_MAX];
 		get_app_filename(app_filename);
@@ -99,61 +257,27 @@ static int globals_initialize(void) {
 			return UERR_FSTREAM_FAILURE;
 		}
 		
-		if (fstream_seek(stream, 0, FSTREAM_SEEK_END) == -1) {
-			const struct SystemError error = get_system_error();
-			
-			fstream_close(stream);
-			
-			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover a posição do arquivo em '%s': %s\r\n", ca_bundle, error.message);
-			return UERR_FSTREAM_FAILURE;
-		}
-		
-		const long int file_size = fstream_tell(stream);
-		
-		if (file_size == -1) {
-			const struct SystemError error = get_system_error();
-			
-			fstream_close(stream);
-			
-			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter a posição do arquivo em '%s': %s\r\n", ca_bundle, error.message);
-			return UERR_FSTREAM_FAILURE;
-		}
-		
-		if (fstream_seek(stream, 0, FSTREAM_SEEK_BEGIN) == -1) {
-			const struct SystemError error = get_system_error();
-			
-			fstream_close(stream);
-			
-			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover a posição do arquivo em '%s': %s\r\n", ca_bundle, error.message);
-			return UERR_FSTREAM_FAILURE;
-		}
-		
-		curl_blob_global.data = malloc((size_t) file_size);
-		
-		if (curl_blob_global.data == NULL) {
-			const struct SystemError error = get_system_error();
-			
-			fstream_close(stream);
-			
-			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema: %s\r\n", error.message);
-			return UERR_MEMORY_ALLOCATE_FAILURE;
-		}
-		
-		const ssize_t size = fstream_read(stream, curl_blob_global.data, (size_t) file_size);
+		/*
+		The bundle is handed to cURL as it is mapped in memory (cURL does not copy it); the mapping
+		is kept until the globals are destroyed.
+		*/
+		size_t size = 0;
+		const char* const data = fstream_map(stream, &size);
 		
-		if (size == -1) {
+		if (data == NULL) {
 			const struct SystemError error = get_system_error();
 			
 			fstream_close(stream);
-			free(curl_blob_global.data);
 			
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar ler os conteúdos do arquivo em '%s': %s\r\n", ca_bundle, error.message);
 			return UERR_FSTREAM_FAILURE;
 		}
 		
-		fstream_close(stream);
+		ca_bundle_global = stream;
 		
-		curl_blob_global.len = (size_t) file_size;
+		curl_blob_global.data = (void*) data;
+		curl_blob_global.len = size;
+		curl_blob_global.flags = CURL_BLOB_NOCOPY;
 	#endif
 	
 	GLOBALS_INITIALIZED = 1;
@@ -177,6 +301,10 @@ static int curl_set_options(CURL* handle) {
 	curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, -1L);
 	curl_easy_setopt(handle, CURLOPT_DNS_SHUFFLE_ADDRESSES, 1L);
 	
+	if (curl_share_global != NULL) {
+		curl_easy_setopt(handle, CURLOPT_SHARE, curl_share_global);
+	}
+	
 	#ifdef ARA_DISABLE_CERTIFICATE_VALIDATION
 		curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
 	#else
@@ -197,19 +325,25 @@ CURL* get_global_curl_easy(void) {
 		return NULL;
 	}
 	
-	if (curl_easy_global != NULL) {
-		return curl_easy_global;
+	struct CurlThread* const thread = curl_thread(1);
+	
+	if (thread == NULL) {
+		return NULL;
+	}
+	
+	if (thread->easy != NULL) {
+		return thread->easy;
 	}
 	
-	curl_easy_global = curl_easy_new();
+	thread->easy = curl_easy_new();
 	
-	if (curl_easy_global == NULL) {
+	if (thread->easy == NULL) {
 		return NULL;
 	}
 	
-	curl_easy_setopt(curl_easy_global, CURLOPT_ERRORBUFFER, CURL_ERROR_MESSAGE);
+	curl_easy_setopt(thread->easy, CURLOPT_ERRORBUFFER, thread->error);
 	
-	return curl_easy_global;
+	return thread->easy;
 	
 }
 
@@ -237,65 +371,226 @@ CURLM* get_global_curl_multi(void) {
 		return NULL;
 	}
 	
-	if (curl_multi_global != NULL) {
-		return curl_multi_global;
+	struct CurlThread* const thread = curl_thread(1);
+	
+	if (thread == NULL) {
+		return NULL;
 	}
 	
-	curl_multi_global = curl_multi_init();
+	if (thread->multi != NULL) {
+		return thread->multi;
+	}
 	
-	if (curl_multi_global == NULL) {
+	thread->multi = curl_multi_init();
+	
+	if (thread->multi == NULL) {
 		return NULL;
 	}
 	
-	curl_multi_setopt(curl_multi_global, CURLMOPT_MAX_HOST_CONNECTIONS, HTTP_MAX_CONCURRENT_CONNECTIONS);
-	curl_multi_setopt(curl_multi_global, CURLMOPT_MAX_TOTAL_CONNECTIONS, HTTP_MAX_CONCURRENT_CONNECTIONS);
+	const long connections = curl_connections_global > 0 ? curl_connections_global : HTTP_MAX_CONCURRENT_CONNECTIONS;
+	
+	curl_multi_setopt(thread->multi, CURLMOPT_MAX_HOST_CONNECTIONS, connections);
+	curl_multi_setopt(thread->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, connections);
+	
+	return thread->multi;
+	
+}
+
+int init_global_curl(void) {
+	/*
+	Initializes what is shared by the handles of all threads. It is done implicitly on first
+	use, but must be called explicitly before threads other than the main one use cURL.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	return globals_initialize() == UERR_SUCCESS ? 0 : -1;
+	
+}
+
+void set_global_curl_connections(const long connections) {
+	/*
+	Limits the number of connections open at a time across all threads, and the number of
+	transfers that may hold a slot at a time (see curl_slot_acquire()). Must be called before
+	threads other than the main one use cURL.
+	*/
+	
+	curl_connections_global = connections;
+	
+}
+
+int curl_slot_acquire(const int wait) {
+	/*
+	Takes one of the transfer slots of the process-wide connection limit, waiting for one to be
+	given back if all of them are in use and asked to. Every slot taken must be given back with
+	curl_slot_release().
+	
+	A thread must not wait for a slot while it holds others, since the slots it is waiting for
+	may be its own.
+	
+	Returns (1) if a slot was taken, (0) if all of them are in use.
+	*/
+	
+	if (curl_connections_global <= 0) {
+		return 1;
+	}
+	
+	#ifdef _WIN32
+		EnterCriticalSection(&curl_slots_lock);
+	#else
+		pthread_mutex_lock(&curl_slots_lock);
+	#endif
+	
+	while (wait && curl_slots_global >= curl_connections_global) {
+		#ifdef _WIN32
+			SleepConditionVariableCS(&curl_slots_changed, &curl_slots_lock, INFINITE);
+		#else
+			pthread_cond_wait(&curl_slots_changed, &curl_slots_lock);
+		#endif
+	}
+	
+	const int acquired = (curl_slots_global < curl_connections_global);
 	
-	return curl_multi_global;
+	if (acquired) {
+		curl_slots_global++;
+	}
+	
+	#ifdef _WIN32
+		LeaveCriticalSection(&curl_slots_lock);
+	#else
+		pthread_mutex_unlock(&curl_slots_lock);
+	#endif
+	
+	return acquired;
+	
+}
+
+void curl_slot_release(const size_t count) {
+	/*
+	Gives back slots taken with curl_slot_acquire().
+	*/
+	
+	if (curl_connections_global <= 0 || count == 0) {
+		return;
+	}
+	
+	#ifdef _WIN32
+		EnterCriticalSection(&curl_slots_lock);
+	#else
+		pthread_mutex_lock(&curl_slots_lock);
+	#endif
+	
+	curl_slots_global -= (long) count;
+	
+	#ifdef _WIN32
+		WakeAllConditionVariable(&curl_slots_changed);
+		LeaveCriticalSection(&curl_slots_lock);
+	#else
+		pthread_cond_broadcast(&curl_slots_changed);
+		pthread_mutex_unlock(&curl_slots_lock);
+	#endif
+	
+}
+
+void free_global_curl(void) {
+	/*
+	Frees the handles of the calling thread (writing out their cookies, if a cookie jar was
+	set). A thread other than the main one must call this before it exits; the next call to
+	get_global_curl_easy() or get_global_curl_multi() starts over with new handles.
+	*/
+	
+	struct CurlThread* const thread = curl_thread(0);
+	
+	if (thread == NULL) {
+		return;
+	}
+	
+	curl_multi_cleanup(thread->multi);
+	curl_easy_cleanup(thread->easy);
+	
+	free(thread);
+	
+	#ifdef _WIN32
+		TlsSetValue(curl_thread_key, NULL);
+	#else
+		pthread_setspecific(curl_thread_key, NULL);
+	#endif
 	
 }
 
 const char* get_global_curl_error(void) {
 	
-	return CURL_ERROR_MESSAGE;
+	const struct CurlThread* const thread = curl_thread(0);
+	
+	return (thread == NULL) ? "" : thread->error;
+	
+}
+
+int curl_retry_after(CURL* const curl, const CURLcode code, size_t* const retries, size_t* const delay) {
+	/*
+	Decides whether a transfer that failed with the code is worth trying again. Only timeouts, failures
+	to send and HTTP errors that are likely to go away (408, 429, 500, 502, 503 and 504) are retried,
+	up to HTTP_MAX_RETRIES times, waiting twice as long before each new attempt.
+	
+	Returns (1) if the transfer should be tried again once the number of seconds put into delay have
+	passed (retries is incremented), or (0) if it should be given up on.
+	*/
+	
+	switch (code) {
+		case CURLE_HTTP_RETURNED_ERROR: {
+			long status_code = 0;
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+			
+			if (!(status_code == 408 || status_code == 429 || status_code == 500 || status_code == 502 || status_code == 503 || status_code == 504)) {
+				return 0;
+			}
+			
+			break;
+		}
+		case CURLE_SEND_ERROR:
+		case CURLE_OPERATION_TIMEDOUT:
+			break;
+		default:
+			return 0;
+	}
+	
+	if (*retries >= HTTP_MAX_RETRIES) {
+		return 0;
+	}
+	
+	(*retries)++;
+	
+	*delay = (size_t) 1 << *retries;
+	
+	const char* const error = get_global_curl_error();
+	const char* const message = (*error == '\0') ? curl_easy_strerror(code) : error;
+	
+	fprintf(stderr, "- Ocorreu uma falha inesperada durante a comunicação com o servidor HTTP: %s\r\n- (%zu/%zu) Uma nova tentativa de conexão ocorrerá dentro de %zu segundos\n", message, *retries, HTTP_MAX_RETRIES, *delay);
+	
+	return 1;
 	
 }
 
 CURLcode curl_easy_perform_retry(CURL* const curl) {
 	
-	size_t retry_after = 1;
 	size_t retries = 0;
 	
 	while (1) {
+		// Transfers made outside of a multi handle count against the connection limit too
+		curl_slot_acquire(1);
+		
 		const CURLcode code = curl_easy_perform(curl);
 		
-		switch (code) {
-			case CURLE_HTTP_RETURNED_ERROR: {
-				long status_code = 0;
-				curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
-				
-				if (!(status_code == 408 || status_code == 429 || status_code == 500 || status_code == 502 || status_code == 503 || status_code == 504)) {
-					return code;
-				}
-				
-				break;
-			}
-			case CURLE_SEND_ERROR:
-			case CURLE_OPERATION_TIMEDOUT:
-				break;
-			default:
-				return code;
-		}
+		curl_slot_release(1);
+		
+		trace_transfer(curl, code);
 		
-		retries++;
+		size_t retry_after = 0;
 		
-		if (retries > HTTP_MAX_RETRIES) {
+		if (!curl_retry_after(curl, code, &retries, &retry_after)) {
 			return code;
 		}
 		
-		retry_after += retry_after;
-		
-		fprintf(stderr, "- Ocorreu uma falha inesperada durante a comunicação com o servidor HTTP: %s\r\n- (%zu/%zu) Uma nova tentativa de conexão ocorrerá dentro de %zu segundos\n", get_global_curl_error(), retries, HTTP_MAX_RETRIES, retry_after);
-		
 		#ifdef _WIN32
 			Sleep((DWORD) (retry_after * 1000));
 		#else
@@ -7,12 +7,21 @@ CURLM* get_global_curl_multi(void);
 
 const char* get_global_curl_error(void);
 
+int init_global_curl(void);
+void set_global_curl_connections(const long connections);
+int curl_slot_acquire(const int wait);
+void curl_slot_release(const size_t count);
+void free_global_curl(void);
+
+int curl_retry_after(CURL* const curl, const CURLcode code, size_t* const retries, size_t* const delay);
 CURLcode curl_easy_perform_retry(CURL* const curl);
 
 void __curl_slist_free_all(struct curl_slist** ptr);
 void __curl_free(char** ptr);
 void __curl_url_cleanup(CURLU** ptr);
+void __curl_slot_release(size_t* ptr);
 
 #define __curl_slist_free_all__ __attribute__((__cleanup__(__curl_slist_free_all)))
 #define __curl_free__ __attribute__((__cleanup__(__curl_free)))
-#define __curl_url_cleanup__ __attribute__((__cleanup__(__curl_url_cleanup)))
\ No newline at end of file
+#define __curl_url_cleanup__ __attribute__((__cleanup__(__curl_url_cleanup)))
+#define __curl_slot_release__ __attribute__((__cleanup__(__curl_slot_release)))
\ No newline at end of file
@@ -1,200 +1,1012 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <pthread.h>
+#endif
 
 #include <libavformat/avformat.h>
 #include <libavutil/timestamp.h>
+#include <libavutil/time.h>
+
+#include "ffmpeg.h"
+
+#define MEMORY_BUFFER_SIZE (1024 * 32)
+
+/*
+Probing limits for inputs opened with fast_open. These are enough for the demuxer to find the codec
+parameters of well-formed MPEG-TS segments and MP4 files, whose headers carry them right away.
+*/
+#define FAST_PROBE_SIZE (1024 * 128)
+#define FAST_ANALYZE_DURATION (AV_TIME_BASE / 2)
+
+/*
+The output goes through a buffer this large unless told otherwise; the muxer writes packets one
+at a time, and most of them are far smaller than this.
+*/
+#define OUTPUT_BUFFER_SIZE (1024 * 1024 * 4)
 
-#define MAX_STREAMS 30
+/*
+Room reserved for the index (moov atom) of MP4 files written with faststart. The index holds a
+few small entries per sample; this is a generous upper bound of their combined size.
+*/
+#define MOOV_BASE_SIZE (1024 * 64)
+#define MOOV_BYTES_PER_SAMPLE 32
 
-#define __avformat_close_inputs__ __attribute__((__cleanup__(close_inputs_cleanup)))
-#define __avformat_free_context__ __attribute__((__cleanup__(output_context_cleanup)))
+#if LIBAVFORMAT_VERSION_MAJOR < 61
+	#define AVIO_WRITE_BUFFER uint8_t*
+#else
+	#define AVIO_WRITE_BUFFER const uint8_t*
+#endif
 
-static void close_inputs_cleanup(AVFormatContext*** inputs_format_context) {
+#define __remux_free__ __attribute__((__cleanup__(remux_free)))
+
+/*
+FFmpeg is built without a thread backend (--disable-pthreads, --disable-w32threads), which turns its
+internal locks into no-ops and its one-time initializations (e.g., the static tables the decoders
+set up when the streams of an input are probed) into unsynchronized checks. Nothing in it may run
+on two threads at once, so copies are serialized across the whole process.
+*/
+#if defined(_WIN32)
+	static SRWLOCK ffmpeg_lock = SRWLOCK_INIT;
+#else
+	static pthread_mutex_t ffmpeg_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+struct MemoryInput {
+	const unsigned char* data;
+	size_t size;
+	size_t position;
+};
+
+static int memory_read(void* opaque, uint8_t* buffer, int size) {
 	
-	if (*inputs_format_context == NULL) {
-		return;
+	struct MemoryInput* const memory = (struct MemoryInput*) opaque;
+	
+	const size_t remaining = memory->size - memory->position;
+	
+	if (remaining == 0) {
+		return AVERROR_EOF;
 	}
 	
-	for (size_t index = 0; index < MAX_STREAMS; index++) {
-		AVFormatContext** input_format_context = &(*inputs_format_context)[index];
-		
-		if (input_format_context == NULL) {
+	const size_t chunk_size = ((size_t) size < remaining) ? (size_t) size : remaining;
+	
+	memcpy(buffer, memory->data + memory->position, chunk_size);
+	memory->position += chunk_size;
+	
+	return (int) chunk_size;
+	
+}
+
+static int64_t memory_seek(void* opaque, int64_t offset, int whence) {
+	
+	struct MemoryInput* const memory = (struct MemoryInput*) opaque;
+	
+	int64_t position = 0;
+	
+	switch (whence & ~AVSEEK_FORCE) {
+		case AVSEEK_SIZE:
+			return (int64_t) memory->size;
+		case SEEK_SET:
+			position = offset;
+			break;
+		case SEEK_CUR:
+			position = (int64_t) memory->position + offset;
 			break;
+		case SEEK_END:
+			position = (int64_t) memory->size + offset;
+			break;
+		default:
+			return AVERROR(EINVAL);
+	}
+	
+	if (position < 0 || position > (int64_t) memory->size) {
+		return AVERROR(EINVAL);
+	}
+	
+	memory->position = (size_t) position;
+	
+	return position;
+	
+}
+
+#if !defined(_WIN32)
+	struct FileOutput {
+		int fd;
+		int64_t position;
+		int64_t size; /* End of the data written so far */
+	};
+	
+	static int file_write(void* opaque, AVIO_WRITE_BUFFER buffer, int size) {
+		
+		struct FileOutput* const file = (struct FileOutput*) opaque;
+		
+		int written = 0;
+		
+		while (written < size) {
+			const ssize_t count = write(file->fd, buffer + written, (size_t) (size - written));
+			
+			if (count == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
+				return AVERROR(errno);
+			}
+			
+			written += (int) count;
+		}
+		
+		file->position += size;
+		
+		if (file->position > file->size) {
+			file->size = file->position;
 		}
 		
-		avformat_close_input(input_format_context);
+		return size;
+		
 	}
 	
-	free(*inputs_format_context);
+	static int64_t file_seek(void* opaque, int64_t offset, int whence) {
+		
+		struct FileOutput* const file = (struct FileOutput*) opaque;
+		
+		whence &= ~AVSEEK_FORCE;
+		
+		if (whence == AVSEEK_SIZE) {
+			return file->size;
+		}
+		
+		const off_t position = lseek(file->fd, (off_t) offset, whence);
+		
+		if (position == -1) {
+			return AVERROR(errno);
+		}
+		
+		file->position = (int64_t) position;
+		
+		return file->position;
+		
+	}
+#endif
+
+struct RemuxInput {
+	AVFormatContext* context;
+	AVIOContext* io;
+	struct MemoryInput memory;
+	int* streams; /* Output stream of each input stream; -1 for the ones that are dropped */
+	unsigned int nb_streams; /* Streams known when the input was opened; any that show up later are dropped */
+	int64_t start; /* Start time of the input, in AV_TIME_BASE units */
+	int64_t offset; /* Added to the timestamps of the input when concatenating, in AV_TIME_BASE units */
+	AVPacket* packet; /* Next packet of the input, when merging */
+	int finished;
+};
+
+struct Remux {
+	size_t count;
+	struct RemuxInput* inputs;
+	AVFormatContext* output;
+	AVIOContext* io; /* Output buffer, when the output file is handled by us */
+#if !defined(_WIN32)
+	struct FileOutput file;
+#endif
+};
+
+static void remux_free(struct Remux* const remux) {
+	
+	for (size_t index = 0; index < remux->count; index++) {
+		struct RemuxInput* const input = &remux->inputs[index];
+		
+		avformat_close_input(&input->context);
+		av_packet_free(&input->packet);
+		
+		if (input->io != NULL) {
+			av_freep(&input->io->buffer);
+			avio_context_free(&input->io);
+		}
+		
+		free(input->streams);
+	}
+	
+	free(remux->inputs);
+	
+	if (remux->io != NULL) {
+		av_freep(&remux->io->buffer);
+		avio_context_free(&remux->io);
+	}
+	
+	#if !defined(_WIN32)
+		if (remux->file.fd != -1) {
+			close(remux->file.fd);
+		}
+	#endif
+	
+	if (remux->output != NULL) {
+		if (!(remux->output->oformat->flags & AVFMT_NOFILE) && !(remux->output->flags & AVFMT_FLAG_CUSTOM_IO)) {
+			avio_closep(&remux->output->pb);
+		}
+		
+		avformat_free_context(remux->output);
+	}
 	
 }
 
-static void output_context_cleanup(AVFormatContext** output_format_context) {
+static int estimate_output(const struct Remux* const remux, int64_t* const size, int64_t* const samples) {
+	/*
+	Estimates the size of the output and the number of samples (frames) in it from the durations
+	and bit rates of the inputs. Inputs whose duration is unknown are left out.
 	
-	if (*output_format_context == NULL) {
-		return;
+	Returns (1) if the duration of every input is known, (0) if the estimates fall short.
+	*/
+	
+	*size = 0;
+	*samples = 0;
+	
+	int complete = 1;
+	
+	for (size_t index = 0; index < remux->count; index++) {
+		const struct RemuxInput* const input = &remux->inputs[index];
+		
+		const int64_t duration = input->context->duration;
+		
+		if (duration < 1) {
+			complete = 0;
+			continue;
+		}
+		
+		int64_t bit_rate = 0;
+		
+		for (size_t subindex = 0; subindex < input->nb_streams; subindex++) {
+			if (input->streams[subindex] == -1) {
+				continue;
+			}
+			
+			const AVStream* const stream = input->context->streams[subindex];
+			const AVCodecParameters* const parameters = stream->codecpar;
+			
+			bit_rate += parameters->bit_rate;
+			
+			if (parameters->codec_type == AVMEDIA_TYPE_VIDEO) {
+				const AVRational rate = stream->avg_frame_rate;
+				
+				// Assume a high frame rate when it is not known
+				*samples += (rate.num > 0 && rate.den > 0) ? av_rescale(duration, rate.num, (int64_t) rate.den * AV_TIME_BASE) : av_rescale(duration, 60, AV_TIME_BASE);
+			} else {
+				const int frame_size = (parameters->frame_size > 0) ? parameters->frame_size : 1024;
+				
+				*samples += av_rescale(duration, parameters->sample_rate, (int64_t) frame_size * AV_TIME_BASE);
+			}
+		}
+		
+		if (bit_rate < 1) {
+			bit_rate = input->context->bit_rate;
+		}
+		
+		*size += av_rescale(duration, bit_rate, (int64_t) AV_TIME_BASE * 8);
 	}
 	
-	if (!((*output_format_context)->oformat->flags & AVFMT_NOFILE)) {
-		avio_closep(&(*output_format_context)->pb);
+	return complete;
+	
+}
+
+static int open_output(struct Remux* const remux, const char* const destination, const size_t buffer_size, const int64_t estimate) {
+	/*
+	Opens the output file behind a large buffer and reserves room on disk for its estimated size,
+	so that it is written in big chunks and ends up in as few extents as possible.
+	
+	On Windows, the output is left to FFmpeg's own file protocol.
+	*/
+	
+	#if defined(_WIN32)
+		(void) buffer_size;
+		(void) estimate;
+		
+		return avio_open(&remux->output->pb, destination, AVIO_FLAG_WRITE);
+	#else
+		remux->file.fd = open(destination, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		
+		if (remux->file.fd == -1) {
+			return AVERROR(errno);
+		}
+		
+		#if defined(__linux__)
+			// This is only a hint; the size of the file is left alone, so nothing needs undoing if it fails
+			if (estimate > 0) {
+				fallocate(remux->file.fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) estimate);
+			}
+		#else
+			(void) estimate;
+		#endif
+		
+		unsigned char* const buffer = av_malloc(buffer_size);
+		
+		if (buffer == NULL) {
+			return AVERROR(ENOMEM);
+		}
+		
+		remux->io = avio_alloc_context(buffer, (int) buffer_size, 1, &remux->file, NULL, file_write, file_seek);
+		
+		if (remux->io == NULL) {
+			av_free(buffer);
+			return AVERROR(ENOMEM);
+		}
+		
+		remux->output->pb = remux->io;
+		remux->output->flags |= AVFMT_FLAG_CUSTOM_IO;
+		
+		return 0;
+	#endif
+	
+}
+
+static int close_output(struct Remux* const remux, int64_t* const size) {
+	/*
+	Flushes whatever is left in the output buffer and closes the output file. Space reserved past
+	the end of the data is given back.
+	
+	The size of the file is put into size.
+	*/
+	
+	#if defined(_WIN32)
+		avio_flush(remux->output->pb);
+		
+		const int64_t value = avio_size(remux->output->pb);
+		*size = (value < 0) ? -1 : value;
+		
+		return avio_closep(&remux->output->pb);
+	#else
+		avio_flush(remux->io);
+		
+		if (remux->io->error < 0) {
+			return remux->io->error;
+		}
+		
+		const int fd = remux->file.fd;
+		remux->file.fd = -1;
+		
+		*size = remux->file.size;
+		
+		int code = 0;
+		
+		if (ftruncate(fd, (off_t) remux->file.size) == -1) {
+			code = AVERROR(errno);
+		}
+		
+		if (close(fd) == -1 && code == 0) {
+			code = AVERROR(errno);
+		}
+		
+		return code;
+	#endif
+	
+}
+
+static int streams_known(const AVFormatContext* const context) {
+	/*
+	Checks whether the codec parameters that matter for copying were found for every audio and
+	video stream of the input.
+	*/
+	
+	for (size_t index = 0; index < context->nb_streams; index++) {
+		const AVCodecParameters* const parameters = context->streams[index]->codecpar;
+		
+		switch (parameters->codec_type) {
+			case AVMEDIA_TYPE_VIDEO:
+				if (parameters->width < 1 || parameters->height < 1) {
+					return 0;
+				}
+				
+				break;
+			case AVMEDIA_TYPE_AUDIO:
+				if (parameters->sample_rate < 1) {
+					return 0;
+				}
+				
+				break;
+			default:
+				break;
+		}
 	}
 	
-	avformat_free_context(*output_format_context);
+	return 1;
 	
 }
 
-int ffmpeg_copy_streams(const char* const* const sources, const char* const destination) {
+static int open_input(
+	const struct FFmpegInput* const input,
+	struct MemoryInput* const memory,
+	AVIOContext** const io,
+	const int fast,
+	AVFormatContext** const context
+) {
+	/*
+	Opens the input and looks for information about its streams. With fast set, the demuxer is only
+	allowed to look at the very beginning of the input.
+	*/
 	
-	int code = 0;
+	const AVInputFormat* format = NULL;
+	
+	if (input->format != NULL) {
+		format = av_find_input_format(input->format);
+	}
+	
+	AVFormatContext* input_format_context = avformat_alloc_context();
+	
+	if (input_format_context == NULL) {
+		return AVERROR(ENOMEM);
+	}
+	
+	if (input->buffer != NULL) {
+		if (*io != NULL) {
+			av_freep(&(*io)->buffer);
+			avio_context_free(io);
+		}
+		
+		memory->data = (const unsigned char*) input->buffer;
+		memory->size = input->size;
+		memory->position = 0;
+		
+		unsigned char* const buffer = av_malloc(MEMORY_BUFFER_SIZE);
+		
+		if (buffer == NULL) {
+			avformat_free_context(input_format_context);
+			return AVERROR(ENOMEM);
+		}
+		
+		*io = avio_alloc_context(buffer, MEMORY_BUFFER_SIZE, 0, memory, memory_read, NULL, memory_seek);
+		
+		if (*io == NULL) {
+			av_free(buffer);
+			avformat_free_context(input_format_context);
+			return AVERROR(ENOMEM);
+		}
+		
+		input_format_context->pb = *io;
+	}
 	
 	AVDictionary* options = NULL;
 	av_dict_set(&options, "allowed_extensions", "ALL", 0);
 	
-	int streams_index[MAX_STREAMS];
-	int stream_index = 0;
+	if (fast) {
+		input_format_context->probesize = FAST_PROBE_SIZE;
+		input_format_context->max_analyze_duration = FAST_ANALYZE_DURATION;
+		
+		av_dict_set_int(&options, "fpsprobesize", 0, 0);
+	}
 	
-	AVFormatContext** inputs_context __avformat_close_inputs__ = malloc(sizeof(AVFormatContext*) * MAX_STREAMS);
+	int code = avformat_open_input(&input_format_context, input->filename, format, &options);
 	
-	if (inputs_context == NULL) {
-		return AVERROR_UNKNOWN;
-	}
+	av_dict_free(&options);
 	
-	for (size_t index = 0; index < MAX_STREAMS; index++) {
-		inputs_context[index] = NULL;
+	if (code != 0) {
+		return code;
 	}
 	
-	AVFormatContext* output_format_context __avformat_free_context__ = NULL;
-	code = avformat_alloc_output_context2(&output_format_context, NULL, NULL, destination);
+	*context = input_format_context;
+	
+	code = avformat_find_stream_info(input_format_context, NULL);
 	
 	if (code < 0) {
 		return code;
 	}
 	
-	for (size_t source_index = 0;; source_index++) {
-		const char* const source = sources[source_index];
+	return 0;
+	
+}
+
+static int usable_stream(const AVStream* const stream) {
+	/*
+	Only audio and video streams are copied; audio streams without a known sample rate are
+	of no use to any player.
+	*/
+	
+	const AVCodecParameters* const parameters = stream->codecpar;
+	
+	switch (parameters->codec_type) {
+		case AVMEDIA_TYPE_VIDEO:
+			return 1;
+		case AVMEDIA_TYPE_AUDIO:
+			return parameters->sample_rate > 0;
+		default:
+			return 0;
+	}
+	
+}
+
+static int map_merged_streams(struct Remux* const remux, struct RemuxInput* const input) {
+	/*
+	Adds an output stream for each usable stream of the input.
+	*/
+	
+	for (size_t index = 0; index < input->nb_streams; index++) {
+		const AVStream* const input_stream = input->context->streams[index];
 		
-		if (source == NULL) {
-			break;
+		input->streams[index] = -1;
+		
+		if (!usable_stream(input_stream)) {
+			continue;
 		}
 		
-		AVFormatContext* input_format_context = NULL;
-		code = avformat_open_input(&input_format_context, source, NULL, &options);
+		AVStream* const output_stream = avformat_new_stream(remux->output, NULL);
 		
-		if (code != 0) {
-			return code;
+		if (output_stream == NULL) {
+			return AVERROR(ENOMEM);
 		}
 		
-		inputs_context[source_index] = input_format_context;
-		
-		code = avformat_find_stream_info(input_format_context, NULL);
+		const int code = avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar);
 		
 		if (code < 0) {
 			return code;
 		}
 		
-		for (size_t index = 0; index < input_format_context->nb_streams; index++) {
-			AVStream* const input_stream = input_format_context->streams[index];
-			
-			const int output_stream_index = index + source_index;
-			
-			if (input_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && input_stream->codecpar->sample_rate < 1) {
-				streams_index[output_stream_index] = -1;
-				continue;
-			}
+		output_stream->codecpar->codec_tag = 0;
+		
+		input->streams[index] = output_stream->index;
+	}
+	
+	return 0;
+	
+}
+
+static void map_concatenated_streams(const struct Remux* const remux, struct RemuxInput* const input) {
+	/*
+	Matches the streams of the input against the output streams (which come from the first input):
+	the nth video (or audio) stream of the input goes to the nth video (or audio) stream of the output,
+	as long as both have the same codec. Streams without a match are dropped.
+	*/
+	
+	unsigned int next[] = {0, 0};
+	
+	for (size_t index = 0; index < input->nb_streams; index++) {
+		const AVStream* const input_stream = input->context->streams[index];
+		
+		input->streams[index] = -1;
+		
+		if (!usable_stream(input_stream)) {
+			continue;
+		}
+		
+		const enum AVMediaType type = input_stream->codecpar->codec_type;
+		unsigned int* const position = &next[type == AVMEDIA_TYPE_AUDIO];
+		
+		for (; *position < remux->output->nb_streams; (*position)++) {
+			const AVStream* const output_stream = remux->output->streams[*position];
 			
-			if (!(input_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || input_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)) {
-				streams_index[output_stream_index] = -1;
+			if (output_stream->codecpar->codec_type != type) {
 				continue;
 			}
 			
-			streams_index[output_stream_index] = stream_index++;
-			
-			AVStream* const output_stream = avformat_new_stream(output_format_context, NULL);
-			
-			if (output_stream == NULL) {
-				return AVERROR_UNKNOWN;
+			if (output_stream->codecpar->codec_id == input_stream->codecpar->codec_id) {
+				input->streams[index] = (int) *position;
 			}
 			
-			const int code = avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar);
-			
-			if (code < 0) {
-				return code;
-			}
+			(*position)++;
 			
-			output_stream->codecpar->codec_tag = 0;
+			break;
 		}
 	}
 	
-	if (!(output_format_context->oformat->flags & AVFMT_NOFILE)) {
-		const int code = avio_open(&output_format_context->pb, destination, AVIO_FLAG_WRITE);
+}
+
+static int read_packet(struct RemuxInput* const input, AVPacket* const packet) {
+	/*
+	Reads the next packet of the input that belongs to a copied stream.
+	
+	Returns (0) on success, AVERROR_EOF at the end of the input, or a negative error code.
+	*/
+	
+	while (1) {
+		const int code = av_read_frame(input->context, packet);
 		
 		if (code < 0) {
 			return code;
 		}
+		
+		const int stream_index = packet->stream_index;
+		
+		if (packet->pts != AV_NOPTS_VALUE && stream_index < (int) input->nb_streams && input->streams[stream_index] != -1) {
+			return 0;
+		}
+		
+		av_packet_unref(packet);
 	}
 	
-	code = avformat_write_header(output_format_context, NULL);
+}
+
+static int write_packet(struct Remux* const remux, struct RemuxInput* const input, AVPacket* const packet, int64_t* const end) {
+	/*
+	Moves the packet to the output, rescaling its timestamps and shifting them by the offset of its input.
+	The end time of the packet is recorded into end, if it is later than the current one.
+	*/
 	
-	if (code < 0) {
-		return code;
+	const AVStream* const input_stream = input->context->streams[packet->stream_index];
+	const AVStream* const output_stream = remux->output->streams[input->streams[packet->stream_index]];
+	
+	const AVRational time_base = {1, AV_TIME_BASE};
+	
+	const int64_t shift = av_rescale_q(input->offset - input->start, time_base, input_stream->time_base);
+	
+	packet->pts = av_rescale_q_rnd(packet->pts + shift, input_stream->time_base, output_stream->time_base, AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
+	
+	if (packet->dts != AV_NOPTS_VALUE) {
+		packet->dts = av_rescale_q_rnd(packet->dts + shift, input_stream->time_base, output_stream->time_base, AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
 	}
 	
-	AVPacket packet = {0};
+	packet->duration = av_rescale_q(packet->duration, input_stream->time_base, output_stream->time_base);
+	packet->pos = -1;
+	packet->stream_index = output_stream->index;
 	
-	for (size_t source_index = 0;; source_index++) {
-		const char* const source = sources[source_index];
-		
-		if (source == NULL) {
-			break;
-		}
+	const int64_t packet_end = av_rescale_q(packet->pts + packet->duration, output_stream->time_base, time_base);
+	
+	if (packet_end > *end) {
+		*end = packet_end;
+	}
+	
+	// This takes ownership of the packet's data, even on error
+	return av_interleaved_write_frame(remux->output, packet);
+	
+}
+
+static int copy_concatenated(struct Remux* const remux) {
+	/*
+	Copies the inputs one after the other; each one starts where the previous one ended.
+	*/
+	
+	AVPacket* packet = av_packet_alloc();
+	
+	if (packet == NULL) {
+		return AVERROR(ENOMEM);
+	}
+	
+	int64_t end = 0;
+	int code = 0;
+	
+	for (size_t index = 0; index < remux->count && code == 0; index++) {
+		struct RemuxInput* const input = &remux->inputs[index];
 		
-		AVFormatContext* const input_format_context = inputs_context[source_index];
+		input->offset = end;
 		
-		while (1) {
-			code = av_read_frame(input_format_context, &packet);
+		while ((code = read_packet(input, packet)) == 0) {
+			code = write_packet(remux, input, packet, &end);
 			
-			if (code == AVERROR_EOF) {
+			if (code != 0) {
 				break;
 			}
+		}
+		
+		if (code == AVERROR_EOF) {
+			code = 0;
+		}
+	}
+	
+	av_packet_free(&packet);
+	
+	return code;
+	
+}
+
+static int copy_merged(struct Remux* const remux) {
+	/*
+	Copies the inputs side by side. The next packet of every input is kept at hand and the one with the
+	lowest timestamp is written first, so the muxer never has to buffer one input while waiting on another.
+	*/
+	
+	for (size_t index = 0; index < remux->count; index++) {
+		struct RemuxInput* const input = &remux->inputs[index];
+		
+		input->packet = av_packet_alloc();
+		
+		if (input->packet == NULL) {
+			return AVERROR(ENOMEM);
+		}
+		
+		const int code = read_packet(input, input->packet);
+		
+		if (code == AVERROR_EOF) {
+			input->finished = 1;
+		} else if (code < 0) {
+			return code;
+		}
+	}
+	
+	int64_t end = 0;
+	
+	while (1) {
+		struct RemuxInput* next = NULL;
+		
+		for (size_t index = 0; index < remux->count; index++) {
+			struct RemuxInput* const input = &remux->inputs[index];
 			
-			if (code < 0) {
-				return code;
+			if (input->finished) {
+				continue;
 			}
 			
-			const int input_stream_index = packet.stream_index;
-			const int output_stream_index = input_stream_index + source_index;
-			
-			const int should_discard = (packet.pts == AV_NOPTS_VALUE || output_stream_index >= MAX_STREAMS || streams_index[output_stream_index] == -1);
-			
-			if (should_discard) {
-				av_packet_unref(&packet);
+			if (next == NULL) {
+				next = input;
 				continue;
 			}
 			
-			const AVStream* const input_stream = input_format_context->streams[input_stream_index];
-			const AVStream* const output_stream = output_format_context->streams[output_stream_index];
-			
-			packet.pts = av_rescale_q_rnd(packet.pts, input_stream->time_base, output_stream->time_base, AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
-			packet.dts = av_rescale_q_rnd(packet.dts, input_stream->time_base, output_stream->time_base, AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
-			packet.duration = av_rescale_q(packet.duration, input_stream->time_base, output_stream->time_base);
-			packet.pos = -1;
+			const AVPacket* const a = input->packet;
+			const AVPacket* const b = next->packet;
 			
-			packet.stream_index = output_stream_index;
-			code = av_interleaved_write_frame(output_format_context, &packet);
+			const int64_t a_time = (a->dts == AV_NOPTS_VALUE) ? a->pts : a->dts;
+			const int64_t b_time = (b->dts == AV_NOPTS_VALUE) ? b->pts : b->dts;
 			
-			av_packet_unref(&packet);
+			const AVRational a_time_base = input->context->streams[a->stream_index]->time_base;
+			const AVRational b_time_base = next->context->streams[b->stream_index]->time_base;
 			
-			if (code != 0) {
-				return code;
+			if (av_compare_ts(a_time, a_time_base, b_time, b_time_base) < 0) {
+				next = input;
 			}
 		}
+		
+		if (next == NULL) {
+			break;
+		}
+		
+		int code = write_packet(remux, next, next->packet, &end);
+		
+		if (code != 0) {
+			return code;
+		}
+		
+		code = read_packet(next, next->packet);
+		
+		if (code == AVERROR_EOF) {
+			next->finished = 1;
+		} else if (code < 0) {
+			return code;
+		}
 	}
 	
-	code = av_write_trailer(output_format_context);
+	return 0;
+	
+}
+
+static int copy_inputs(
+	const struct FFmpegInput* const inputs,
+	const size_t count,
+	const char* const destination,
+	const struct FFmpegOptions* const options,
+	struct FFmpegStats* const stats,
+	int* const overflow
+) {
+	/*
+	Does the actual copy (see ffmpeg_copy_inputs()). overflow is set if the copy failed only because
+	the room reserved for the index of the output at its beginning was not enough.
+	*/
+	
+	*overflow = 0;
+	
+	if (count < 1) {
+		return AVERROR(EINVAL);
+	}
+	
+	const int64_t open_start = av_gettime_relative();
+	
+	struct Remux remux __remux_free__ = {0};
+	
+	#if !defined(_WIN32)
+		remux.file.fd = -1;
+	#endif
+	
+	const struct FFmpegOptions defaults = {0};
+	const struct FFmpegOptions* const settings = (options == NULL) ? &defaults : options;
+	
+	const enum FFmpegCopyMode mode = settings->mode;
+	
+	remux.inputs = calloc(count, sizeof(*remux.inputs));
+	
+	if (remux.inputs == NULL) {
+		return AVERROR(ENOMEM);
+	}
+	
+	remux.count = count;
+	
+	int code = avformat_alloc_output_context2(&remux.output, NULL, NULL, destination);
+	
+	if (code < 0) {
+		return code;
+	}
+	
+	for (size_t index = 0; index < count; index++) {
+		const struct FFmpegInput* const source = &inputs[index];
+		struct RemuxInput* const input = &remux.inputs[index];
+		
+		code = open_input(source, &input->memory, &input->io, source->fast_open, &input->context);
+		
+		// The beginning of the input was not enough to learn about all of its streams; probe it the usual way
+		if (source->fast_open && (code < 0 || !streams_known(input->context))) {
+			avformat_close_input(&input->context);
+			code = open_input(source, &input->memory, &input->io, 0, &input->context);
+		}
+		
+		if (code < 0) {
+			return code;
+		}
+		
+		input->nb_streams = input->context->nb_streams;
+		input->streams = malloc((input->nb_streams + 1) * sizeof(*input->streams));
+		
+		if (input->streams == NULL) {
+			return AVERROR(ENOMEM);
+		}
+		
+		input->start = (input->context->start_time == AV_NOPTS_VALUE) ? 0 : input->context->start_time;
+		
+		if (mode == FFMPEG_COPY_CONCATENATE && index > 0) {
+			map_concatenated_streams(&remux, input);
+			continue;
+		}
+		
+		// Merged inputs keep their own timestamps, which are meant to line up with each other
+		if (mode == FFMPEG_COPY_MERGE) {
+			input->start = 0;
+		}
+		
+		code = map_merged_streams(&remux, input);
+		
+		if (code < 0) {
+			return code;
+		}
+	}
+	
+	int64_t estimated_size = 0;
+	int64_t estimated_samples = 0;
+	
+	const int estimated = estimate_output(&remux, &estimated_size, &estimated_samples);
+	
+	if (!(remux.output->oformat->flags & AVFMT_NOFILE)) {
+		const size_t buffer_size = (settings->buffer_size == 0) ? OUTPUT_BUFFER_SIZE : settings->buffer_size;
+		
+		code = open_output(&remux, destination, buffer_size, estimated_size);
+		
+		if (code < 0) {
+			return code;
+		}
+	}
+	
+	AVDictionary* muxer_options = NULL;
+	
+	/*
+	Instead of moving the index to the front of the file with a second pass over it once everything
+	is written (which is what the "faststart" flag of the MP4 muxer does), room for it is reserved
+	at the front right away. This needs the number of samples to be known beforehand, so it is only
+	done when the duration of every input is known; even then the number is a guess, and the muxer
+	only finds out it was too small once everything is written (see ffmpeg_copy_inputs()).
+	*/
+	const int is_mp4 = (strcmp(remux.output->oformat->name, "mp4") == 0 || strcmp(remux.output->oformat->name, "mov") == 0);
+	
+	const int reserved = (settings->faststart && is_mp4 && estimated && estimated_samples > 0);
+	
+	if (reserved) {
+		av_dict_set_int(&muxer_options, "moov_size", MOOV_BASE_SIZE + estimated_samples * MOOV_BYTES_PER_SAMPLE, 0);
+	}
+	
+	code = avformat_write_header(remux.output, &muxer_options);
+	
+	av_dict_free(&muxer_options);
+	
+	if (code < 0) {
+		return code;
+	}
+	
+	const int64_t copy_start = av_gettime_relative();
+	
+	code = (mode == FFMPEG_COPY_CONCATENATE) ? copy_concatenated(&remux) : copy_merged(&remux);
 	
 	if (code != 0) {
 		return code;
 	}
 	
+	code = av_write_trailer(remux.output);
+	
+	if (code != 0) {
+		*overflow = reserved;
+		return code;
+	}
+	
+	int64_t size = -1;
+	
+	if (!(remux.output->oformat->flags & AVFMT_NOFILE)) {
+		code = close_output(&remux, &size);
+		
+		if (code != 0) {
+			return code;
+		}
+	}
+	
+	if (stats != NULL) {
+		stats->open = copy_start - open_start;
+		stats->copy = av_gettime_relative() - copy_start;
+		stats->size = size;
+	}
+	
 	return 0;
 	
 }
+
+int ffmpeg_copy_inputs(
+	const struct FFmpegInput* const inputs,
+	const size_t count,
+	const char* const destination,
+	const struct FFmpegOptions* const options,
+	struct FFmpegStats* const stats
+) {
+	/*
+	Copies the audio and video streams of the inputs into the destination, without re-encoding them.
+	
+	With FFMPEG_COPY_MERGE, every input contributes its own streams (e.g., a video and an audio rendition
+	of the same media). With FFMPEG_COPY_CONCATENATE, the inputs are joined one after the other; their
+	streams are expected to match those of the first input.
+	
+	If options is NULL, the inputs are merged with the default settings. If stats is not NULL, it
+	receives the time spent opening the inputs and copying their packets, and the size of the output.
+	
+	With faststart, the index of MP4 outputs is written at their beginning, in room reserved for it
+	from an estimate; if that turns out too small, the copy is done again with the index at the end.
+	
+	Only one copy runs at a time, whatever thread it is called from; the others wait for their turn.
+	*/
+	
+	#if defined(_WIN32)
+		AcquireSRWLockExclusive(&ffmpeg_lock);
+	#else
+		pthread_mutex_lock(&ffmpeg_lock);
+	#endif
+	
+	int overflow = 0;
+	int code = copy_inputs(inputs, count, destination, options, stats, &overflow);
+	
+	/*
+	The room reserved for the index turned out to be too small (the muxer only tells once the trailer
+	is written); copy everything again, this time with the index at the end of the file.
+	*/
+	if (code < 0 && overflow) {
+		struct FFmpegOptions fallback = *options;
+		fallback.faststart = 0;
+		
+		code = copy_inputs(inputs, count, destination, &fallback, stats, &overflow);
+	}
+	
+	#if defined(_WIN32)
+		ReleaseSRWLockExclusive(&ffmpeg_lock);
+	#else
+		pthread_mutex_unlock(&ffmpeg_lock);
+	#endif
+	
+	return code;
+	
+}
+
+int ffmpeg_copy_streams(const char* const* const sources, const char* const destination) {
+	
+	size_t count = 0;
+	
+	while (sources[count] != NULL) {
+		count++;
+	}
+	
+	struct FFmpegInput inputs[count + 1];
+	
+	for (size_t index = 0; index < count; index++) {
+		const struct FFmpegInput input = {
+			.filename = sources[index]
+		};
+		
+		inputs[index] = input;
+	}
+	
+	return ffmpeg_copy_inputs(inputs, count, destination, NULL, NULL);
+	
+}
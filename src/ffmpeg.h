@@ -1,3 +1,38 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+struct FFmpegInput {
+	const char* filename; /* Name of the input; relative references within it are resolved against this */
+	const char* format; /* Name of the demuxer to use; NULL to probe it */
+	const char* buffer; /* Contents of the input when it lives in memory; NULL to read it from the filename */
+	size_t size;
+	int fast_open; /* Whether the codec parameters can be found at the very beginning of the input, e.g., our own downloaded segments */
+};
+
+enum FFmpegCopyMode {
+	FFMPEG_COPY_MERGE, /* Each input contributes its own streams */
+	FFMPEG_COPY_CONCATENATE /* The inputs are joined one after the other */
+};
+
+struct FFmpegOptions {
+	enum FFmpegCopyMode mode;
+	size_t buffer_size; /* Size of the output buffer; 0 for the default */
+	int faststart; /* Whether to put the index of MP4 files at their beginning, so that playback can start before the whole file is read */
+};
+
+struct FFmpegStats {
+	int64_t open; /* Time spent opening and probing the inputs, in microseconds */
+	int64_t copy; /* Time spent copying packets, in microseconds */
+	int64_t size; /* Size of the output, in bytes; (-1) if not known */
+};
+
+int ffmpeg_copy_inputs(
+	const struct FFmpegInput* const inputs,
+	const size_t count,
+	const char* const destination,
+	const struct FFmpegOptions* const options,
+	struct FFmpegStats* const stats
+);
 int ffmpeg_copy_streams(const char* const* const sources, const char* const destination);
 
 #pragma once
@@ -1,3 +1,7 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -36,6 +40,13 @@
 	#include <limits.h>
 #endif
 
+#if defined(__linux__)
+	#include <sys/ioctl.h>
+	#include <sys/sendfile.h>
+	#include <sys/syscall.h>
+	#include <linux/fs.h>
+#endif
+
 #include "fstream.h"
 #include "symbols.h"
 #include "filesystem.h"
@@ -45,6 +56,16 @@
 	#include "getdents.h"
 #endif
 
+#if !(defined(_WIN32) || defined(__serenity__) || defined(__HAIKU__))
+	#define HAVE_REMOVE_AT 1
+#endif
+
+#if defined(HAVE_REMOVE_AT)
+	#include <dirent.h>
+	
+	#include "threads.h"
+#endif
+
 #if defined(_WIN32)
 	int is_absolute(const char* const path) {
 		/*
@@ -260,57 +281,247 @@ static int remove_empty_directory(const char* const directory) {
 	
 }
 
-int remove_recursive(const char* const directory, int remove_itself) {
-	/*
-	Recursively removes a directory from disk.
+#if defined(HAVE_REMOVE_AT)
+	#define REMOVE_BUFFER_SIZE (64 * 1024)
+	#define REMOVE_WORKERS 4
 	
-	Returns (0) on success, (-1) on error.
-	*/
+	struct RemoveJob {
+		int parent;
+		char name[];
+	};
+	
+	static int remove_contents_at(const int fd, struct ThreadPool* const pool);
 	
-	struct WalkDir walkdir = {0};
+	static int remove_directory_at(const int parent, const char* const name) {
+		/*
+		Removes a directory (relative to the parent directory), along with everything within it.
+		
+		Returns (0) on success, (-1) on error.
+		*/
+		
+		const int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		
+		if (fd == -1) {
+			return (errno == ENOENT) ? 0 : -1;
+		}
+		
+		const int status = remove_contents_at(fd, NULL);
+		
+		close(fd);
+		
+		if (status == -1) {
+			return -1;
+		}
+		
+		if (unlinkat(parent, name, AT_REMOVEDIR) == -1 && errno != ENOENT) {
+			return -1;
+		}
+		
+		return 0;
+		
+	}
 	
-	if (walkdir_init(&walkdir, directory) == -1) {
-		return -1;
+	static int remove_job_run(void* const data) {
+		
+		const struct RemoveJob* const job = (const struct RemoveJob*) data;
+		
+		return remove_directory_at(job->parent, job->name);
+		
 	}
 	
-	while (1) {
-		const struct WalkDirItem* const item = walkdir_next(&walkdir);
+	static int remove_contents_at(const int fd, struct ThreadPool* const pool) {
+		/*
+		Removes everything within the directory. Entries are listed in large batches and their
+		types are taken from the listing itself, so nothing gets stat()'ed unless the file system
+		leaves the type out; names are resolved relative to the directory, so no paths are built.
 		
-		if (item == NULL) {
-			break;
-		}
+		If a pool is given, subdirectories are removed by its workers.
 		
-		if (strcmp(item->name, ".") == 0 || strcmp(item->name, "..") == 0) {
-			continue;
+		Returns (0) on success, (-1) on error.
+		*/
+		
+		char* const buffer = malloc(REMOVE_BUFFER_SIZE);
+		
+		if (buffer == NULL) {
+			return -1;
 		}
 		
-		char path[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(item->name) + 1];
-		strcpy(path, directory);
-		strcat(path, PATH_SEPARATOR);
-		strcat(path, item->name);
+		int status = 0;
+		size_t removed = 1;
 		
-		switch (item->type) {
-			case WALKDIR_ITEM_DIRECTORY: {
-				if (remove_recursive(path, 1) == -1) {
-					walkdir_free(&walkdir);
-					return -1;
-				}
-				
+		// Listing a directory while removing entries from it may skip some of them; list it again until nothing is left
+		while (status == 0 && removed > 0) {
+			removed = 0;
+			
+			if (lseek(fd, 0, SEEK_SET) == -1) {
+				status = -1;
 				break;
 			}
-			case WALKDIR_ITEM_FILE:
-			case WALKDIR_ITEM_UNKNOWN: {
-				if (remove_file(path) == -1) {
-					walkdir_free(&walkdir);
-					return -1;
+			
+			while (status == 0) {
+				const ssize_t size = get_directory_entries(fd, buffer, REMOVE_BUFFER_SIZE);
+				
+				if (size == -1) {
+					status = -1;
+					break;
 				}
 				
-				break;
+				if (size == 0) {
+					break;
+				}
+				
+				ssize_t offset = 0;
+				
+				while (status == 0 && offset < size) {
+					const struct directory_entry* const entry = (const struct directory_entry*) (buffer + offset);
+					offset += directory_entry_size(entry);
+					
+					const char* const name = entry->d_name;
+					
+					if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+						continue;
+					}
+					
+					int is_directory = (directory_entry_type(entry) == DT_DIR);
+					
+					// Some file systems do not report the type of the entries they list
+					if (directory_entry_type(entry) == DT_UNKNOWN) {
+						struct stat st = {0};
+						
+						if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+							if (errno != ENOENT) {
+								status = -1;
+							}
+							
+							continue;
+						}
+						
+						is_directory = S_ISDIR(st.st_mode);
+					}
+					
+					removed++;
+					
+					if (!is_directory) {
+						if (unlinkat(fd, name, 0) == -1 && errno != ENOENT) {
+							status = -1;
+						}
+						
+						continue;
+					}
+					
+					if (pool == NULL) {
+						status = remove_directory_at(fd, name);
+						continue;
+					}
+					
+					struct RemoveJob* const job = malloc(sizeof(*job) + strlen(name) + 1);
+					
+					if (job == NULL) {
+						status = -1;
+						break;
+					}
+					
+					job->parent = fd;
+					strcpy(job->name, name);
+					
+					if (threadpool_submit(pool, remove_job_run, free, job) != 0) {
+						status = -1;
+					}
+				}
+			}
+			
+			// Subdirectories must be gone before the directory is listed again
+			if (pool != NULL && threadpool_wait(pool) > 0) {
+				status = -1;
 			}
 		}
+		
+		free(buffer);
+		
+		return status;
+		
 	}
+#endif
+
+int remove_recursive(const char* const directory, int remove_itself) {
+	/*
+	Recursively removes a directory from disk.
+	
+	Where supported, entries are removed relative to the directory that holds them, and
+	subdirectories of the directory are removed in parallel.
 	
-	walkdir_free(&walkdir);
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(HAVE_REMOVE_AT)
+		const int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		
+		if (fd == -1) {
+			return -1;
+		}
+		
+		struct ThreadPool pool = {0};
+		
+		// Without workers, everything is removed on this thread
+		const int parallel = (threadpool_init(&pool, REMOVE_WORKERS, REMOVE_WORKERS * 4) == 0);
+		
+		const int status = remove_contents_at(fd, parallel ? &pool : NULL);
+		
+		if (parallel) {
+			threadpool_free(&pool);
+		}
+		
+		close(fd);
+		
+		if (status == -1) {
+			return -1;
+		}
+	#else
+		struct WalkDir walkdir = {0};
+		
+		if (walkdir_init(&walkdir, directory) == -1) {
+			return -1;
+		}
+		
+		while (1) {
+			const struct WalkDirItem* const item = walkdir_next(&walkdir);
+			
+			if (item == NULL) {
+				break;
+			}
+			
+			if (strcmp(item->name, ".") == 0 || strcmp(item->name, "..") == 0) {
+				continue;
+			}
+			
+			char path[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(item->name) + 1];
+			strcpy(path, directory);
+			strcat(path, PATH_SEPARATOR);
+			strcat(path, item->name);
+			
+			switch (item->type) {
+				case WALKDIR_ITEM_DIRECTORY: {
+					if (remove_recursive(path, 1) == -1) {
+						walkdir_free(&walkdir);
+						return -1;
+					}
+					
+					break;
+				}
+				case WALKDIR_ITEM_FILE:
+				case WALKDIR_ITEM_UNKNOWN: {
+					if (remove_file(path) == -1) {
+						walkdir_free(&walkdir);
+						return -1;
+					}
+					
+					break;
+				}
+			}
+		}
+		
+		walkdir_free(&walkdir);
+	#endif
 	
 	if (remove_itself) {
 		if (remove_empty_directory(directory) == -1) {
@@ -529,7 +740,68 @@ int file_exists(const char* const filename) {
 	
 }
 
-static int raw_create_dir(const char* const directory) {
+int get_file_size(const char* const filename, long long* const size) {
+	/*
+	Gets the size of a file.
+	
+	Returns (1) if file exists, (0) if it does not exists, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		WIN32_FILE_ATTRIBUTE_DATA data = {0};
+		
+		#if defined(_UNICODE)
+			const int is_abs = is_absolute(filename);
+			
+			const int wfilenames = MultiByteToWideChar(CP_UTF8, 0, filename, -1, NULL, 0);
+			
+			if (wfilenames == 0) {
+				return -1;
+			}
+			
+			wchar_t wfilename[(is_abs ? wcslen(WIN10LP_PREFIX) : 0) + wfilenames];
+			
+			if (is_abs) {
+				wcscpy(wfilename, WIN10LP_PREFIX);
+			}
+			
+			if (MultiByteToWideChar(CP_UTF8, 0, filename, -1, wfilename + (is_abs ? wcslen(WIN10LP_PREFIX) : 0), wfilenames) == 0) {
+				return -1;
+			}
+			
+			const BOOL status = GetFileAttributesExW(wfilename, GetFileExInfoStandard, &data);
+		#else
+			const BOOL status = GetFileAttributesExA(filename, GetFileExInfoStandard, &data);
+		#endif
+		
+		if (status == 0) {
+			if (GetLastError() == ERROR_FILE_NOT_FOUND || GetLastError() == ERROR_PATH_NOT_FOUND) {
+				return 0;
+			}
+			
+			return -1;
+		}
+		
+		*size = (long long) (((unsigned long long) data.nFileSizeHigh << 32) | data.nFileSizeLow);
+	#else
+		struct stat st = {0};
+		
+		if (stat(filename, &st) == -1) {
+			if (errno == ENOENT) {
+				return 0;
+			}
+			
+			return -1;
+		}
+		
+		*size = (long long) st.st_size;
+	#endif
+	
+	return 1;
+	
+}
+
+int raw_create_dir(const char* const directory) {
 	/*
 	Try to create one directory (not the whole path).
 	
@@ -637,12 +909,160 @@ int create_directory(const char* const directory) {
 	
 }
 
+#if defined(__linux__)
+	#define COPY_CHUNK_SIZE (1024 * 1024 * 1024)
+	#define COPY_BUFFER_SIZE (1024 * 1024)
+	
+	static int copy_fallback(const int error) {
+		/*
+		Checks whether an error from copy_file_range() or sendfile() means that the call is not
+		supported for this pair of files (or by this kernel), rather than an actual I/O error.
+		*/
+		
+		return (error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == ENOTSUP || error == EPERM);
+		
+	}
+	
+	static int copy_descriptors(const int input, const int output, const off_t size) {
+		/*
+		Copies the contents of one file into another, trying the cheapest way first:
+		
+		- FICLONE shares the data blocks between both files (Btrfs, XFS, bcachefs); nothing is copied at all.
+		- copy_file_range() copies within the kernel, and may be offloaded to the file system or storage device.
+		- sendfile() copies within the kernel as well, and works across any two file systems.
+		- read()/write() with a large buffer, as the last resort.
+		
+		The later ones are only tried if the previous one could not copy anything.
+		
+		Returns (0) on success, (-1) on error.
+		*/
+		
+		#if defined(FICLONE)
+			if (ioctl(output, FICLONE, input) == 0) {
+				return 0;
+			}
+		#endif
+		
+		// Reserve the whole file upfront; running out of space is better found out now than halfway through
+		if (size > 0 && fallocate(output, 0, 0, size) == -1 && errno == ENOSPC) {
+			return -1;
+		}
+		
+		off_t copied = 0;
+		
+		#if defined(__NR_copy_file_range)
+			while (copied < size) {
+				const size_t count = (size - copied) > COPY_CHUNK_SIZE ? COPY_CHUNK_SIZE : (size_t) (size - copied);
+				const ssize_t wsize = (ssize_t) syscall(__NR_copy_file_range, input, NULL, output, NULL, count, 0);
+				
+				if (wsize == -1) {
+					if (errno == EINTR) {
+						continue;
+					}
+					
+					if (copied == 0 && copy_fallback(errno)) {
+						break;
+					}
+					
+					return -1;
+				}
+				
+				if (wsize == 0) {
+					break;
+				}
+				
+				copied += wsize;
+			}
+		#endif
+		
+		while (copied == 0 || copied < size) {
+			const size_t count = (size - copied) > COPY_CHUNK_SIZE || size == 0 ? COPY_CHUNK_SIZE : (size_t) (size - copied);
+			
+			off_t offset = copied;
+			const ssize_t wsize = sendfile(output, input, &offset, count);
+			
+			if (wsize == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				
+				if (copied == 0 && copy_fallback(errno)) {
+					break;
+				}
+				
+				return -1;
+			}
+			
+			if (wsize == 0) {
+				break;
+			}
+			
+			copied += wsize;
+		}
+		
+		if (copied == 0) {
+			char* const buffer = malloc(COPY_BUFFER_SIZE);
+			
+			if (buffer == NULL) {
+				return -1;
+			}
+			
+			while (1) {
+				const ssize_t rsize = read(input, buffer, COPY_BUFFER_SIZE);
+				
+				if (rsize == -1) {
+					if (errno == EINTR) {
+						continue;
+					}
+					
+					free(buffer);
+					return -1;
+				}
+				
+				if (rsize == 0) {
+					break;
+				}
+				
+				ssize_t offset = 0;
+				
+				while (offset < rsize) {
+					const ssize_t wsize = write(output, buffer + offset, (size_t) (rsize - offset));
+					
+					if (wsize == -1) {
+						if (errno == EINTR) {
+							continue;
+						}
+						
+						free(buffer);
+						return -1;
+					}
+					
+					offset += wsize;
+				}
+				
+				copied += rsize;
+			}
+			
+			free(buffer);
+		}
+		
+		// The source may have been shorter than what was reserved for it
+		if (ftruncate(output, copied) == -1) {
+			return -1;
+		}
+		
+		return 0;
+		
+	}
+#endif
+
 int copy_file(const char* const source, const char* const destination) {
 	/*
 	Copies a file from source to destination.
 	
 	On the Windows platform this will copy the source file's attributes into destination.
 	On Mac OS X, copyfile() C API will be used (available since OS X 10.5).
+	On Linux, the copy is done within the kernel whenever possible (see copy_descriptors()).
 	
 	If destination already exists, the file attributes will be preserved and the content overwritten.
 	
@@ -695,6 +1115,34 @@ int copy_file(const char* const source, const char* const destination) {
 				return -1;
 			}
 		#endif
+	#elif defined(__linux__)
+		const int input = open(source, O_RDONLY | O_CLOEXEC);
+		
+		if (input == -1) {
+			return -1;
+		}
+		
+		struct stat st = {0};
+		
+		if (fstat(input, &st) == -1) {
+			close(input);
+			return -1;
+		}
+		
+		const int output = open(destination, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		
+		if (output == -1) {
+			close(input);
+			return -1;
+		}
+		
+		const int status = copy_descriptors(input, output, st.st_size);
+		
+		close(input);
+		
+		if (close(output) == -1 || status == -1) {
+			return -1;
+		}
 	#elif defined(__APPLE__)
 		copyfile_state_t state = copyfile_state_alloc();
 		
@@ -719,36 +1167,24 @@ int copy_file(const char* const source, const char* const destination) {
 			return -1;
 		}
 		
-		char chunk[8192] = {'\0'};
+		size_t size = 0;
+		const char* const data = fstream_map(istream, &size);
 		
-		while (1) {
-			const ssize_t size = fstream_read(istream, chunk, sizeof(chunk));
-			
-			if (size == -1) {
-				fstream_close(istream);
-				fstream_close(ostream);
-				return -1;
-			}
-			
-			if (size == 0) {
-				if (fstream_close(istream) == -1 || fstream_close(ostream) == -1) {
-					return -1;
-				}
-				break;
-			}
-			
-			const int status = fstream_write(ostream, chunk, (size_t) size);
-			
-			if (status == -1) {
-				fstream_close(istream);
-				fstream_close(ostream);
-				return -1;
-			}
+		if (data == NULL) {
+			fstream_close(istream);
+			fstream_close(ostream);
+			return -1;
+		}
+		
+		const int status = fstream_write(ostream, data, size);
+		
+		if (fstream_close(istream) == -1 || fstream_close(ostream) == -1 || status == -1) {
+			return -1;
 		}
 	#endif
 	
 	return 0;
-
+	
 }
 
 int move_file(const char* const source, const char* const destination) {
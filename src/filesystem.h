@@ -4,6 +4,8 @@ int remove_file(const char* const filename);
 int remove_recursive(const char* const directory, int remove_itself);
 int directory_exists(const char* const directory);
 int file_exists(const char* const filename);
+int get_file_size(const char* const filename, long long* const size);
+int raw_create_dir(const char* const directory);
 int create_directory(const char* const directory);
 int move_file(const char* const source, const char* const destination);
 int copy_file(const char* const source, const char* const destination);
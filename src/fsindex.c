@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsindex.h"
+#include "filesystem.h"
+#include "walkdir.h"
+#include "symbols.h"
+
+/*
+An in-memory index of the paths within a directory tree, built by listing each directory once.
+
+Checking whether each resource, module, page and file exists, one stat() at a time, adds up to
+tens of thousands of system calls when resyncing a large course (and each one is a round trip
+on network file systems). The index answers those checks instead; it knows about whatever was
+there when the tree was scanned (files along with their sizes and modification times), plus the
+directories created and the files published through it.
+*/
+
+#define FSINDEX_MINIMUM_SIZE 1024
+
+static size_t fsindex_hash(const char* const path) {
+	/*
+	FNV-1a.
+	*/
+	
+	size_t hash = (size_t) 14695981039346656037ULL;
+	
+	for (const unsigned char* ch = (const unsigned char*) path; *ch != '\0'; ch++) {
+		hash ^= *ch;
+		hash *= (size_t) 1099511628211ULL;
+	}
+	
+	return hash;
+	
+}
+
+static struct FSIndexEntry* fsindex_slot(struct FSIndexEntry* const items, const size_t size, const char* const path, const size_t hash) {
+	/*
+	Returns the slot holding the path, or the empty slot where it would go.
+	*/
+	
+	size_t position = hash & (size - 1);
+	
+	while (1) {
+		struct FSIndexEntry* const entry = &items[position];
+		
+		if (entry->path == NULL || (entry->hash == hash && strcmp(entry->path, path) == 0)) {
+			return entry;
+		}
+		
+		position = (position + 1) & (size - 1);
+	}
+	
+}
+
+static int fsindex_grow(struct FSIndex* const index) {
+	
+	const size_t size = (index->size == 0) ? FSINDEX_MINIMUM_SIZE : index->size * 2;
+	struct FSIndexEntry* const items = calloc(size, sizeof(*items));
+	
+	if (items == NULL) {
+		return -1;
+	}
+	
+	for (size_t position = 0; position < index->size; position++) {
+		const struct FSIndexEntry* const entry = &index->items[position];
+		
+		if (entry->path == NULL) {
+			continue;
+		}
+		
+		*fsindex_slot(items, size, entry->path, entry->hash) = *entry;
+	}
+	
+	free(index->items);
+	
+	index->items = items;
+	index->size = size;
+	
+	return 0;
+	
+}
+
+static struct FSIndexEntry* fsindex_put(struct FSIndex* const index, const char* const path, const enum FSIndexType type) {
+	/*
+	Adds a path to the index, or updates its type if it is already there.
+	
+	Returns its entry, or a null pointer on error.
+	*/
+	
+	// Keep the load factor under 3/4
+	if ((index->count + 1) * 4 > index->size * 3 && fsindex_grow(index) == -1) {
+		return NULL;
+	}
+	
+	const size_t hash = fsindex_hash(path);
+	struct FSIndexEntry* const entry = fsindex_slot(index->items, index->size, path, hash);
+	
+	if (entry->path == NULL) {
+		entry->path = malloc(strlen(path) + 1);
+		
+		if (entry->path == NULL) {
+			return NULL;
+		}
+		
+		strcpy(entry->path, path);
+		
+		entry->hash = hash;
+		
+		index->count++;
+	}
+	
+	entry->type = type;
+	entry->size = 0;
+	entry->mtime = 0;
+	
+	return entry;
+	
+}
+
+int fsindex_add(struct FSIndex* const index, const char* const path, const enum FSIndexType type) {
+	/*
+	Adds a path to the index, or updates its type if it is already there.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	return (fsindex_put(index, path, type) == NULL) ? -1 : 0;
+	
+}
+
+int fsindex_add_file(struct FSIndex* const index, const char* const path, const long long size, const long long mtime) {
+	/*
+	Adds a file to the index along with its size and modification time (e.g., once it has been
+	published), or updates them if it is already there.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct FSIndexEntry* const entry = fsindex_put(index, path, FSINDEX_FILE);
+	
+	if (entry == NULL) {
+		return -1;
+	}
+	
+	entry->size = size;
+	entry->mtime = mtime;
+	
+	return 0;
+	
+}
+
+const struct FSIndexEntry* fsindex_get(const struct FSIndex* const index, const char* const path) {
+	/*
+	Looks up a path.
+	
+	Returns a null pointer if the path is not in the index.
+	*/
+	
+	if (index->size == 0) {
+		return NULL;
+	}
+	
+	const struct FSIndexEntry* const entry = fsindex_slot(index->items, index->size, path, fsindex_hash(path));
+	
+	return (entry->path == NULL) ? NULL : entry;
+	
+}
+
+int fsindex_scan(struct FSIndex* const index, const char* const directory) {
+	/*
+	Adds the directory and everything within it (recursively) to the index.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (fsindex_add(index, directory, FSINDEX_DIRECTORY) == -1) {
+		return -1;
+	}
+	
+	struct WalkDir walkdir = {0};
+	
+	if (walkdir_init(&walkdir, directory) == -1) {
+		return -1;
+	}
+	
+	int status = 0;
+	
+	while (status == 0) {
+		const struct WalkDirItem* const item = walkdir_next(&walkdir);
+		
+		if (item == NULL) {
+			break;
+		}
+		
+		if (strcmp(item->name, ".") == 0 || strcmp(item->name, "..") == 0) {
+			continue;
+		}
+		
+		char path[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(item->name) + 1];
+		strcpy(path, directory);
+		strcat(path, PATH_SEPARATOR);
+		strcat(path, item->name);
+		
+		int is_directory = (item->type == WALKDIR_ITEM_DIRECTORY);
+		
+		// Some file systems do not report the type of the entries they list
+		if (item->type == WALKDIR_ITEM_UNKNOWN) {
+			is_directory = directory_exists(path);
+			
+			if (is_directory == -1) {
+				status = -1;
+				break;
+			}
+		}
+		
+		if (is_directory) {
+			status = fsindex_scan(index, path);
+		} else {
+			status = walkdir_stat(&walkdir);
+			
+			if (status == 0) {
+				status = fsindex_add_file(index, path, item->size, item->mtime);
+			}
+		}
+	}
+	
+	walkdir_free(&walkdir);
+	
+	return status;
+	
+}
+
+int fsindex_directory_exists(const struct FSIndex* const index, const char* const directory) {
+	/*
+	Checks if the directory is in the index.
+	
+	Returns (1) if it is, (0) otherwise.
+	*/
+	
+	const struct FSIndexEntry* const entry = fsindex_get(index, directory);
+	
+	return (entry != NULL && entry->type == FSINDEX_DIRECTORY);
+	
+}
+
+int fsindex_file_exists(const struct FSIndex* const index, const char* const filename) {
+	/*
+	Checks if the file is in the index. An empty file is what is left behind by a download that
+	never got to write anything, and does not count.
+	
+	Returns (1) if it is, (0) otherwise.
+	*/
+	
+	const struct FSIndexEntry* const entry = fsindex_get(index, filename);
+	
+	return (entry != NULL && entry->type == FSINDEX_FILE && entry->size != 0);
+	
+}
+
+int fsindex_create_directory(struct FSIndex* const index, const char* const directory) {
+	/*
+	Creates the directory (along with any missing parent directories) and adds it to the index.
+	
+	Parent directories that are in the index are known to exist, so only the ones after the
+	deepest of them are created; with the tree scanned upfront, every directory takes a single
+	mkdir() and nothing else.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (fsindex_directory_exists(index, directory)) {
+		return 0;
+	}
+	
+	const size_t length = strlen(directory);
+	
+	char path[length + 1];
+	strcpy(path, directory);
+	
+	size_t start = 0;
+	
+	for (size_t position = length; position > 0; position--) {
+		if (path[position] != *PATH_SEPARATOR) {
+			continue;
+		}
+		
+		path[position] = '\0';
+		
+		const int known = fsindex_directory_exists(index, path);
+		
+		path[position] = *PATH_SEPARATOR;
+		
+		if (known) {
+			start = position;
+			break;
+		}
+	}
+	
+	// Nothing is known about where this directory goes; create the whole path
+	if (start == 0) {
+		if (create_directory(directory) == -1) {
+			return -1;
+		}
+		
+		return fsindex_add(index, directory, FSINDEX_DIRECTORY);
+	}
+	
+	for (size_t position = start + 1; position < length + 1; position++) {
+		const char ch = path[position];
+		
+		if (!(ch == *PATH_SEPARATOR || ch == '\0') || path[position - 1] == *PATH_SEPARATOR) {
+			continue;
+		}
+		
+		path[position] = '\0';
+		
+		if (raw_create_dir(path) == -1 || fsindex_add(index, path, FSINDEX_DIRECTORY) == -1) {
+			return -1;
+		}
+		
+		path[position] = ch;
+	}
+	
+	return 0;
+	
+}
+
+void fsindex_free(struct FSIndex* const index) {
+	
+	for (size_t position = 0; position < index->size; position++) {
+		free(index->items[position].path);
+	}
+	
+	free(index->items);
+	
+	index->items = NULL;
+	index->count = 0;
+	index->size = 0;
+	
+}
@@ -0,0 +1,31 @@
+#include <stdlib.h>
+
+enum FSIndexType {
+	FSINDEX_DIRECTORY,
+	FSINDEX_FILE
+};
+
+struct FSIndexEntry {
+	char* path; /* NULL for an empty slot */
+	size_t hash;
+	enum FSIndexType type;
+	long long size; /* Size of a file; (-1) if it is not known (e.g., it is still being written) */
+	long long mtime; /* Modification time of a file, in seconds since the Unix epoch */
+};
+
+struct FSIndex {
+	size_t count; /* Number of paths in the index */
+	size_t size; /* Number of slots; always a power of two */
+	struct FSIndexEntry* items;
+};
+
+int fsindex_add(struct FSIndex* const index, const char* const path, const enum FSIndexType type);
+int fsindex_add_file(struct FSIndex* const index, const char* const path, const long long size, const long long mtime);
+const struct FSIndexEntry* fsindex_get(const struct FSIndex* const index, const char* const path);
+int fsindex_scan(struct FSIndex* const index, const char* const directory);
+int fsindex_directory_exists(const struct FSIndex* const index, const char* const directory);
+int fsindex_file_exists(const struct FSIndex* const index, const char* const filename);
+int fsindex_create_directory(struct FSIndex* const index, const char* const directory);
+void fsindex_free(struct FSIndex* const index);
+
+#pragma once
@@ -1,15 +1,27 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
+#include <stdint.h>
 
 #if defined(_WIN32)
 	#include <windows.h>
 	#include <fileapi.h>
+	#include <io.h>
 #endif
 
 #if !defined(_WIN32)
 	#include <stdio.h>
+	#include <fcntl.h>
+	#include <errno.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
 #endif
 
 #include "fstream.h"
+#include "sha256.h"
 
 #if defined(_WIN32) && defined(_UNICODE)
 	#include "symbols.h"
@@ -32,6 +44,28 @@ On NetBSD: available when __POSIX_VISIBLE >= 200112 or __XSI_VISIBLE >= 500 or d
 	#define HAVE_FTELLO 1
 #endif
 
+#if (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__DragonFly__)) && defined(POSIX_FADV_SEQUENTIAL)
+	#define HAVE_POSIX_FADVISE 1
+#endif
+
+int fstream_flush(struct FStream* const stream) {
+	/*
+	Writes out whatever the C library is still holding on to. On Windows, writes are not
+	buffered, so there is nothing to do.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		(void) stream;
+		
+		return 0;
+	#else
+		return fflush(stream->stream) == 0 ? 0 : -1;
+	#endif
+	
+}
+
 struct FStream* fstream_open(const char* const filename, const enum FStreamMode mode) {
 	/*
 	Opens a file on disk.
@@ -42,7 +76,8 @@ struct FStream* fstream_open(const char* const filename, const enum FStreamMode
 	#if defined(_WIN32)
 		DWORD desired_access = 0;
 		DWORD creation_disposition = 0;
-		const DWORD flags_and_attributes = FILE_ATTRIBUTE_NORMAL;
+		// Files are always read and written from start to end
+		const DWORD flags_and_attributes = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
 		
 		switch (mode) {
 			case FSTREAM_WRITE:
@@ -124,6 +159,11 @@ struct FStream* fstream_open(const char* const filename, const enum FStreamMode
 		if (handle == NULL) {
 			return NULL;
 		}
+		
+		#if defined(HAVE_POSIX_FADVISE)
+			// Files are always read and written from start to end; this is only a hint, so errors are ignored
+			posix_fadvise(fileno(handle), 0, 0, POSIX_FADV_SEQUENTIAL);
+		#endif
 	#endif
 	
 	struct FStream* const stream = malloc(sizeof(struct FStream));
@@ -132,6 +172,74 @@ struct FStream* fstream_open(const char* const filename, const enum FStreamMode
 		return NULL;
 	}
 	
+	stream->stream = handle;
+	stream->reserved = 0;
+	stream->map = NULL;
+	stream->map_size = 0;
+	stream->digest = NULL;
+	
+	#if defined(_WIN32)
+		stream->mapping = NULL;
+	#endif
+	
+	return stream;
+	
+}
+
+struct FStream* fstream_fdopen(const int fd) {
+	/*
+	Opens a stream for writing to a file descriptor the process inherited (e.g., a pipe set up by
+	whoever started it). The stream gets a duplicate of the descriptor, so closing it leaves
+	the original one open.
+	
+	Returns a null pointer on error.
+	*/
+	
+	#if defined(_WIN32)
+		const int duplicate = _dup(fd);
+		
+		if (duplicate == -1) {
+			return NULL;
+		}
+		
+		HANDLE original = (HANDLE) _get_osfhandle(duplicate);
+		HANDLE handle = INVALID_HANDLE_VALUE;
+		
+		// The stream owns a handle of its own; the descriptor is not needed past this point
+		const BOOL status = (original != INVALID_HANDLE_VALUE) && DuplicateHandle(GetCurrentProcess(), original, GetCurrentProcess(), &handle, 0, FALSE, DUPLICATE_SAME_ACCESS);
+		
+		_close(duplicate);
+		
+		if (!status) {
+			return NULL;
+		}
+	#else
+		const int duplicate = dup(fd);
+		
+		if (duplicate == -1) {
+			return NULL;
+		}
+		
+		FILE* const handle = fdopen(duplicate, "w");
+		
+		if (handle == NULL) {
+			close(duplicate);
+			return NULL;
+		}
+	#endif
+	
+	struct FStream* const stream = calloc(1, sizeof(struct FStream));
+	
+	if (stream == NULL) {
+		#if defined(_WIN32)
+			CloseHandle(handle);
+		#else
+			fclose(handle);
+		#endif
+		
+		return NULL;
+	}
+	
 	stream->stream = handle;
 	
 	return stream;
@@ -177,6 +285,10 @@ int fstream_write(struct FStream* const stream, const char* const buffer, const
 	Returns (0) on success, (-1) on error.
 	*/
 	
+	if (stream->digest != NULL) {
+		sha256_update(stream->digest, buffer, size);
+	}
+	
 	#if defined(_WIN32)
 		DWORD wsize = 0;
 		const BOOL status = WriteFile(stream->stream, buffer, (DWORD) size, &wsize, NULL);
@@ -247,6 +359,15 @@ int fstream_seek(struct FStream* const stream, const long int offset, const enum
 		#endif
 	#endif
 	
+	// Going back to the start means the contents are being written over; anywhere else, the hash no longer follows them
+	if (stream->digest != NULL) {
+		if (method == FSTREAM_SEEK_BEGIN && offset == 0) {
+			sha256_init(stream->digest);
+		} else {
+			stream->digest = NULL;
+		}
+	}
+	
 	return 0;
 	
 }
@@ -280,6 +401,218 @@ long int fstream_tell(struct FStream* const stream) {
 	
 }
 
+int fstream_truncate(struct FStream* const stream) {
+	/*
+	Cuts the file off at the current position, discarding whatever comes after it.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#if defined(_WIN32)
+		if (SetEndOfFile(stream->stream) == 0) {
+			return -1;
+		}
+	#else
+		if (fflush(stream->stream) != 0) {
+			return -1;
+		}
+		
+		const long int offset = fstream_tell(stream);
+		
+		if (offset == -1) {
+			return -1;
+		}
+		
+		if (ftruncate(fileno(stream->stream), (off_t) offset) == -1) {
+			return -1;
+		}
+	#endif
+	
+	return 0;
+	
+}
+
+int fstream_allocate(struct FStream* const stream, const long long size) {
+	/*
+	Reserves disk space for a file that is expected to grow up to the specified size, so that it
+	is laid out contiguously instead of piece by piece as it is written. The file size itself
+	is left untouched. This is only a hint; on platforms where it is not supported, nothing is done.
+	
+	Calling it again with a size that was already reserved does nothing.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (size <= stream->reserved) {
+		return 0;
+	}
+	
+	// Failures are not retried either
+	stream->reserved = size;
+	
+	#if defined(_WIN32)
+		LARGE_INTEGER current = {0};
+		
+		if (GetFileSizeEx(stream->stream, &current) == 0) {
+			return -1;
+		}
+		
+		// Setting an allocation size smaller than the file would truncate it
+		if (size > current.QuadPart) {
+			FILE_ALLOCATION_INFO info = {0};
+			info.AllocationSize.QuadPart = size;
+			
+			if (SetFileInformationByHandle(stream->stream, FileAllocationInfo, &info, sizeof(info)) == 0) {
+				return -1;
+			}
+		}
+	#elif defined(__linux__)
+		/*
+		Unlike posix_fallocate(), this does not change the file size (so a file that ends up shorter
+		than expected carries no trailing zeros), and fails instead of falling back to writing zeros
+		on file systems that do not support it.
+		*/
+		if (fallocate(fileno(stream->stream), FALLOC_FL_KEEP_SIZE, 0, (off_t) size) == -1) {
+			return -1;
+		}
+	#endif
+	
+	return 0;
+	
+}
+
+void fstream_digest(struct FStream* const stream, struct SHA256* const digest) {
+	/*
+	Hashes everything written to the file from here on into the given (initialized) context,
+	so that the contents of a download are hashed as they are written, rather than read back
+	from disk afterwards. Seeking back to the start of the file starts the hash over; seeking
+	anywhere else stops it.
+	*/
+	
+	stream->digest = digest;
+	
+}
+
+const char* fstream_map(struct FStream* const stream, size_t* const size) {
+	/*
+	Maps the whole file into memory for reading, so that its contents can be used in place
+	instead of being copied into a buffer. The view stays valid until fstream_unmap() or
+	fstream_close() is called. The stream must have been opened for reading.
+	
+	Returns a null pointer on error. An empty file has nothing to map; a pointer to an empty
+	string is returned for it.
+	*/
+	
+	if (stream->map != NULL) {
+		*size = stream->map_size;
+		return stream->map;
+	}
+	
+	#if defined(_WIN32)
+		LARGE_INTEGER file_size = {0};
+		
+		if (GetFileSizeEx(stream->stream, &file_size) == 0) {
+			return NULL;
+		}
+		
+		if ((unsigned long long) file_size.QuadPart > (unsigned long long) SIZE_MAX) {
+			SetLastError(ERROR_FILE_TOO_LARGE);
+			return NULL;
+		}
+		
+		*size = (size_t) file_size.QuadPart;
+		
+		if (*size == 0) {
+			return "";
+		}
+		
+		HANDLE mapping = CreateFileMappingW(stream->stream, NULL, PAGE_READONLY, 0, 0, NULL);
+		
+		if (mapping == NULL) {
+			return NULL;
+		}
+		
+		char* const map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		
+		if (map == NULL) {
+			CloseHandle(mapping);
+			return NULL;
+		}
+		
+		stream->mapping = mapping;
+	#else
+		const int fd = fileno(stream->stream);
+		
+		struct stat st = {0};
+		
+		if (fstat(fd, &st) == -1) {
+			return NULL;
+		}
+		
+		if ((unsigned long long) st.st_size > (unsigned long long) SIZE_MAX) {
+			errno = EFBIG;
+			return NULL;
+		}
+		
+		*size = (size_t) st.st_size;
+		
+		if (*size == 0) {
+			return "";
+		}
+		
+		char* const map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+		
+		if (map == MAP_FAILED) {
+			return NULL;
+		}
+		
+		#if defined(MADV_SEQUENTIAL)
+			madvise(map, *size, MADV_SEQUENTIAL);
+		#endif
+	#endif
+	
+	stream->map = map;
+	stream->map_size = *size;
+	
+	return map;
+	
+}
+
+int fstream_unmap(struct FStream* const stream) {
+	/*
+	Removes the view set up by fstream_map(), if any.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (stream->map == NULL) {
+		return 0;
+	}
+	
+	#if defined(_WIN32)
+		const BOOL status = UnmapViewOfFile(stream->map);
+		
+		CloseHandle(stream->mapping);
+		stream->mapping = NULL;
+		
+		if (status == 0) {
+			stream->map = NULL;
+			return -1;
+		}
+	#else
+		if (munmap(stream->map, stream->map_size) == -1) {
+			stream->map = NULL;
+			return -1;
+		}
+	#endif
+	
+	stream->map = NULL;
+	stream->map_size = 0;
+	
+	return 0;
+	
+}
+
 int fstream_close(struct FStream* const stream) {
 	/*
 	Closes the stream.
@@ -287,6 +620,8 @@ int fstream_close(struct FStream* const stream) {
 	Returns (0) on success, (-1) on error.
 	*/
 	
+	fstream_unmap(stream);
+	
 	#if defined(_WIN32)
 		if (stream->stream != 0) {
 			const BOOL status = CloseHandle(stream->stream);
@@ -6,12 +6,21 @@
 	#include <stdio.h>
 #endif
 
+struct SHA256;
+
 struct FStream {
 #ifdef _WIN32
 	HANDLE stream;
 #else
 	FILE* stream;
 #endif
+	long long reserved; /* Number of bytes reserved on disk by fstream_allocate() */
+	char* map; /* View of the whole file set up by fstream_map() */
+	size_t map_size;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+	struct SHA256* digest; /* Hash of the contents written so far, set up by fstream_digest() */
 };
 
 enum FStreamMode {
@@ -27,10 +36,17 @@ enum FStreamSeek {
 };
 
 struct FStream* fstream_open(const char* const filename, const enum FStreamMode mode);
+struct FStream* fstream_fdopen(const int fd);
 ssize_t fstream_read(struct FStream* const stream, char* const buffer, const size_t size);
 int fstream_write(struct FStream* const stream, const char* const buffer, const size_t size);
 int fstream_seek(struct FStream* const stream, const long int offset, const enum FStreamSeek method);
 long int fstream_tell(struct FStream* const stream);
+int fstream_truncate(struct FStream* const stream);
+int fstream_flush(struct FStream* const stream);
+int fstream_allocate(struct FStream* const stream, const long long size);
+void fstream_digest(struct FStream* const stream, struct SHA256* const digest);
+const char* fstream_map(struct FStream* const stream, size_t* const size);
+int fstream_unmap(struct FStream* const stream);
 int fstream_close(struct FStream* const stream);
 
 #pragma once
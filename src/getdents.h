@@ -60,4 +60,11 @@ int close_dir(int fd);
 	#define directory_entry_size(entry) (entry->d_reclen)
 #endif
 
+/* The old getdents() syscall stores the type in the last byte of the record */
+#if defined(__linux__) && !(defined(__GLIBC__) || defined(__MUSL__)) && !defined(SYS_getdents64)
+	#define directory_entry_type(entry) (*((const unsigned char*) entry + entry->d_reclen - 1))
+#elif !defined(__HAIKU__)
+	#define directory_entry_type(entry) (entry->d_type)
+#endif
+
 #pragma once
@@ -25,6 +25,7 @@
 #include "hotmart.h"
 #include "html.h"
 #include "ttidy.h"
+#include "scan.h"
 
 static const char HTTP_HEADER_AUTHORIZATION[] = "Authorization";
 static const char HTTP_HEADER_REFERER[] = "Referer";
@@ -817,14 +818,25 @@ int hotmart_get_page(
 				return UERR_CURL_FAILURE;
 			}
 			
-			const char* const ptr = strstr(string.s, "mediaAssets");
+			const char* const send = string.s + string.slength;
+			
+			const char* const ptr = scan_find(string.s, send, "mediaAssets");
 			
 			if (ptr == NULL) {
 				return UERR_STRSTR_FAILURE;
 			}
 			
-			const char* const start = strstr(ptr, HTTPS_SCHEME);
-			const char* const end = strstr(start, QUOTATION_MARK);
+			const char* const start = scan_find(ptr, send, HTTPS_SCHEME);
+			
+			if (start == NULL) {
+				return UERR_STRSTR_FAILURE;
+			}
+			
+			const char* const end = scan_byte(start, send, *QUOTATION_MARK);
+			
+			if (end == NULL) {
+				return UERR_STRSTR_FAILURE;
+			}
 			
 			size_t size = (size_t) (end - start);
 			
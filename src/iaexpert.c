@@ -22,6 +22,7 @@
 #include "iaexpert.h"
 #include "html.h"
 #include "vimeo.h"
+#include "scan.h"
 
 #define IAEXPERT_HOMEPAGE_ENDPOINT "https://iaexpert.academy"
 
@@ -888,7 +889,9 @@ int iaexpert_get_resources(
 	
 	const char* const pattern = "data-nonce=\"";
 	
-	const char* start = strstr(string.s, pattern);
+	const char* const send = string.s + string.slength;
+	
+	const char* start = scan_find(string.s, send, pattern);
 	
 	if (start == NULL) {
 		return UERR_STRSTR_FAILURE;
@@ -896,7 +899,11 @@ int iaexpert_get_resources(
 	
 	start += strlen(pattern);
 	
-	const char* end = strstr(start, QUOTATION_MARK);
+	const char* end = scan_byte(start, send, *QUOTATION_MARK);
+	
+	if (end == NULL) {
+		return UERR_STRSTR_FAILURE;
+	}
 	
 	const size_t size = (size_t) (end - start);
 	
@@ -1017,10 +1024,12 @@ int iaexpert_get_modules(
 	
 	const char* const pattern = "> Não Matriculado<";
 	
-	if (strstr(string.s, pattern) != NULL) {
+	const char* const send = string.s + string.slength;
+	
+	if (scan_find(string.s, send, pattern) != NULL) {
 		const char* pattern = "/sfwd-courses/";
 		
-		const char* start = strstr(string.s, pattern);
+		const char* start = scan_find(string.s, send, pattern);
 		
 		if (start == NULL) {
 			return UERR_STRSTR_FAILURE;
@@ -1028,7 +1037,7 @@ int iaexpert_get_modules(
 		
 		start += strlen(pattern);
 		
-		const char* end = strstr(start, QUOTATION_MARK);
+		const char* end = scan_byte(start, send, *QUOTATION_MARK);
 		
 		if (end == NULL) {
 			return UERR_STRSTR_FAILURE;
@@ -1042,7 +1051,7 @@ int iaexpert_get_modules(
 		
 		pattern = "name=\"course_join\" value=\"";
 	
-		start = strstr(string.s, pattern);
+		start = scan_find(string.s, send, pattern);
 		
 		if (start == NULL) {
 			return UERR_STRSTR_FAILURE;
@@ -1050,7 +1059,7 @@ int iaexpert_get_modules(
 		
 		start += strlen(pattern);
 		
-		end = strstr(start, QUOTATION_MARK);
+		end = scan_byte(start, send, *QUOTATION_MARK);
 		
 		if (end == NULL) {
 			return UERR_STRSTR_FAILURE;
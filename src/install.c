@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <limits.h>
 
 #if defined(_WIN32)
@@ -15,14 +16,13 @@
 	#include <sys/stat.h>
 #endif
 
-#include <bearssl.h>
 #include <libavcodec/version.h>
 #include <libavformat/version.h>
 #include <libavutil/version.h>
 
 #if defined(_WIN32)
 	#include "wregistry.h"
-
+	
 	#if defined(_UNICODE)
 		#include "wio.h"
 	#endif
@@ -35,6 +35,7 @@
 #include "os.h"
 #include "fstream.h"
 #include "cleanup.h"
+#include "sha256.h"
 
 #define STRINGIFY_HELPER(x) #x
 #define STRINGIFY(x) STRINGIFY_HELPER(x)
@@ -91,46 +92,6 @@ static const char* const INSTALL_FILES[] = {
 	CONFIGURATION_DIRECTORY PATH_SEPARATOR "tls" PATH_SEPARATOR "cert.pem"
 };
 
-int sha256_digest(const char* const filename, char* const output) {
-	
-	struct FStream* const stream = fstream_open(filename, FSTREAM_READ);
-	
-	if (stream == NULL) {
-		return -1;
-	}
-	
-	br_sha256_context context = {0};
-	br_sha256_init(&context);
-	
-	char chunk[8192] = {'\0'};
-	
-	while (1) {
-		const ssize_t size = fstream_read(stream, chunk, sizeof(chunk));
-		
-		switch (size) {
-			case -1:
-				fstream_close(stream);
-				return -1;
-			case 0:
-				if (fstream_close(stream) == -1) {
-					return -1;
-				}
-				break;
-		}
-		
-		if (size == 0) {
-			break;
-		}
-		
-		br_sha256_update(&context, chunk, size);
-	}
-	
-	br_sha256_out(&context, output);
-	
-	return 0;
-	
-}
-
 #if defined(_WIN32) && defined(_UNICODE)
 	#define main wmain
 	int wmain(void);
@@ -223,17 +184,17 @@ int main(void) {
 		
 		switch (file_exists(destination_file)) {
 			case 1: {
-				char isha256[br_sha256_SIZE] = {'\0'};
-				char osha256[br_sha256_SIZE] = {'\0'};
+				unsigned char isha256[SHA256_DIGEST_SIZE] = {'\0'};
+				unsigned char osha256[SHA256_DIGEST_SIZE] = {'\0'};
 				
-				if (sha256_digest(source_file, isha256) == -1) {
+				if (sha256_file(source_file, isha256) == -1) {
 					const struct SystemError error = get_system_error();
 					
 					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar calcular o SHA256 do arquivo em '%s': %s\r\n", source_file, error.message);
 					return EXIT_FAILURE;
 				};
 				
-				if (sha256_digest(destination_file, osha256) == -1) {
+				if (sha256_file(destination_file, osha256) == -1) {
 					const struct SystemError error = get_system_error();
 					
 					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar calcular o SHA256 do arquivo em '%s': %s\r\n", destination_file, error.message);
@@ -325,7 +286,7 @@ int main(void) {
 		
 		if (wregistry_put(HKEY_CURRENT_USER, "Environment", "Path", new_path) == -1) {
 			const struct SystemError error = get_system_error();
-		
+			
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar modificar as chaves de registro do Windows: %s\r\n", error.message);
 			return EXIT_FAILURE;
 		};
@@ -0,0 +1,406 @@
+#if defined(_WIN32) && defined(_UNICODE)
+	#include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "job.h"
+#include "fstream.h"
+#include "cleanup.h"
+
+/*
+Options for running unattended, taken from the command line and/or a job file.
+
+The job file is a JSON object with any of the keys "provider", "account", "username", "password",
+"select", "keep_names" (a boolean) and "directory". Options given on the command line take
+precedence over the ones in the file; the password may also come from the ARA_PASSWORD
+environment variable, so that it does not show up in the process list.
+
+The daemon file (see daemon_load()) runs several jobs, possibly of different providers and
+accounts, from a single process.
+*/
+
+static const char USAGE[] =
+	"Uso: ara [opções]\r\n"
+	"\r\n"
+	"Sem opções, o programa é executado de forma interativa.\r\n"
+	"\r\n"
+	"  --job <arquivo>       Lê as opções de um arquivo JSON\r\n"
+	"  --daemon <arquivo>    Executa as tarefas listadas em um arquivo JSON\r\n"
+	"  --provider <nome>     Provedor de serviços (ex: Hotmart)\r\n"
+	"  --account <usuário>   Usa uma conta previamente salva\r\n"
+	"  --username <usuário>  Acessa o serviço usando este usuário\r\n"
+	"  --password <senha>    Acessa o serviço usando esta senha\r\n"
+	"  --select <escolhas>   Conteúdos a serem baixados (ex: 1,3-5 ou * para todos)\r\n"
+	"  --keep-names          Mantém o nome original de arquivos e diretórios (padrão)\r\n"
+	"  --short-names         Usa nomes curtos para arquivos e diretórios\r\n"
+	"  --directory <caminho> Diretório onde os conteúdos serão salvos\r\n"
+	"  --help                Mostra esta mensagem\r\n";
+
+static char* job_argument(const argument_t* const argument) {
+	/*
+	Returns a copy of the command line argument, in UTF-8.
+	*/
+	
+	#if defined(_WIN32) && defined(_UNICODE)
+		const int size = WideCharToMultiByte(CP_UTF8, 0, argument, -1, NULL, 0, NULL, NULL);
+		
+		if (size == 0) {
+			return NULL;
+		}
+		
+		char* const value = malloc((size_t) size);
+		
+		if (value == NULL) {
+			return NULL;
+		}
+		
+		if (WideCharToMultiByte(CP_UTF8, 0, argument, -1, value, size, NULL, NULL) == 0) {
+			free(value);
+			return NULL;
+		}
+	#else
+		char* const value = malloc(strlen(argument) + 1);
+		
+		if (value == NULL) {
+			return NULL;
+		}
+		
+		strcpy(value, argument);
+	#endif
+	
+	return value;
+	
+}
+
+static int job_set(char** const destination, const char* const value) {
+	/*
+	Stores a copy of the value, unless the option was already given.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (*destination != NULL) {
+		return 0;
+	}
+	
+	*destination = malloc(strlen(value) + 1);
+	
+	if (*destination == NULL) {
+		return -1;
+	}
+	
+	strcpy(*destination, value);
+	
+	return 0;
+	
+}
+
+static json_t* job_read(const char* const filename) {
+	/*
+	Reads and parses the JSON file.
+	
+	Returns a null pointer on error.
+	*/
+	
+	struct FStream* const stream = fstream_open(filename, FSTREAM_READ);
+	
+	if (stream == NULL) {
+		fprintf(stderr, "- Não foi possível abrir o arquivo de tarefa em '%s'!\r\n", filename);
+		return NULL;
+	}
+	
+	size_t size = 0;
+	const char* const data = fstream_map(stream, &size);
+	
+	json_t* const tree = (data == NULL) ? NULL : json_loadb(data, size, 0, NULL);
+	
+	fstream_close(stream);
+	
+	if (tree == NULL || !json_is_object(tree)) {
+		json_decref(tree);
+		
+		fprintf(stderr, "- O arquivo de tarefa localizado em '%s' possui uma sintaxe inválida ou não reconhecida!\r\n", filename);
+		return NULL;
+	}
+	
+	return tree;
+	
+}
+
+static int job_load(struct Job* const job, const json_t* const tree, const char* const filename) {
+	/*
+	Fills the options not given on the command line with the ones in the job object, which
+	comes from the file with the given name.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const char* key = NULL;
+	json_t* value = NULL;
+	
+	json_object_foreach((json_t*) tree, key, value) {
+		if (strcmp(key, "keep_names") == 0) {
+			if (!json_is_boolean(value)) {
+				fprintf(stderr, "- O arquivo de tarefa localizado em '%s' possui um formato inválido!\r\n", filename);
+				return -1;
+			}
+			
+			if (job->keep_names == -1) {
+				job->keep_names = json_is_true(value);
+			}
+			
+			continue;
+		}
+		
+		char** destination = NULL;
+		
+		if (strcmp(key, "provider") == 0) {
+			destination = &job->provider;
+		} else if (strcmp(key, "account") == 0) {
+			destination = &job->account;
+		} else if (strcmp(key, "username") == 0) {
+			destination = &job->username;
+		} else if (strcmp(key, "password") == 0) {
+			destination = &job->password;
+		} else if (strcmp(key, "select") == 0) {
+			destination = &job->selection;
+		} else if (strcmp(key, "directory") == 0) {
+			destination = &job->directory;
+		} else {
+			fprintf(stderr, "- O arquivo de tarefa localizado em '%s' possui uma opção desconhecida: '%s'\r\n", filename, key);
+			return -1;
+		}
+		
+		if (!json_is_string(value)) {
+			fprintf(stderr, "- O arquivo de tarefa localizado em '%s' possui um formato inválido!\r\n", filename);
+			return -1;
+		}
+		
+		if (job_set(destination, json_string_value(value)) == -1) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			return -1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+int job_parse(struct Job* const job, const int argc, argument_t* argv[]) {
+	/*
+	Parses the command line, along with the job file it points to (if any).
+	
+	Returns (0) on success, (1) if the program should just exit (e.g. --help), (-1) on error.
+	*/
+	
+	job->headless = (argc > 1);
+	job->keep_names = -1;
+	
+	char* filename __free__ = NULL;
+	char* daemon __free__ = NULL;
+	
+	for (int index = 1; index < argc; index++) {
+		char* argument __free__ = job_argument(argv[index]);
+		
+		if (argument == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			return -1;
+		}
+		
+		if (strcmp(argument, "--help") == 0 || strcmp(argument, "-h") == 0) {
+			printf("%s", USAGE);
+			return 1;
+		}
+		
+		if (strcmp(argument, "--keep-names") == 0 || strcmp(argument, "--short-names") == 0) {
+			job->keep_names = (strcmp(argument, "--keep-names") == 0);
+			continue;
+		}
+		
+		char** destination = NULL;
+		
+		if (strcmp(argument, "--job") == 0) {
+			destination = &filename;
+		} else if (strcmp(argument, "--daemon") == 0) {
+			destination = &daemon;
+		} else if (strcmp(argument, "--provider") == 0) {
+			destination = &job->provider;
+		} else if (strcmp(argument, "--account") == 0) {
+			destination = &job->account;
+		} else if (strcmp(argument, "--username") == 0) {
+			destination = &job->username;
+		} else if (strcmp(argument, "--password") == 0) {
+			destination = &job->password;
+		} else if (strcmp(argument, "--select") == 0) {
+			destination = &job->selection;
+		} else if (strcmp(argument, "--directory") == 0) {
+			destination = &job->directory;
+		} else {
+			fprintf(stderr, "- Opção desconhecida: '%s'\r\n\r\n%s", argument, USAGE);
+			return -1;
+		}
+		
+		if (index + 1 == argc) {
+			fprintf(stderr, "- A opção '%s' requer um valor!\r\n", argument);
+			return -1;
+		}
+		
+		// The last occurrence of an option wins
+		free(*destination);
+		*destination = job_argument(argv[++index]);
+		
+		if (*destination == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			return -1;
+		}
+	}
+	
+	if (filename != NULL) {
+		json_auto_t* tree = job_read(filename);
+		
+		if (tree == NULL || job_load(job, tree, filename) == -1) {
+			return -1;
+		}
+	}
+	
+	if (daemon != NULL) {
+		job->daemon = daemon;
+		daemon = NULL;
+	}
+	
+	const char* const password = getenv("ARA_PASSWORD");
+	
+	if (password != NULL && *password != '\0' && job_set(&job->password, password) == -1) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+void job_free(struct Job* const job) {
+	
+	free(job->provider);
+	free(job->account);
+	free(job->username);
+	free(job->password);
+	free(job->selection);
+	free(job->directory);
+	free(job->daemon);
+	
+	job->provider = NULL;
+	job->account = NULL;
+	job->username = NULL;
+	job->password = NULL;
+	job->selection = NULL;
+	job->directory = NULL;
+	job->daemon = NULL;
+	
+}
+
+int daemon_load(struct Daemon* const daemon, const struct Job* const defaults) {
+	/*
+	Loads the daemon file the job points to. It is a JSON object with the keys "jobs" (an array
+	of job objects, in the same format as the job file), "workers" (how many jobs may run at
+	the same time; defaults to 2) and "interval" (the number of seconds to wait before running
+	all of the jobs again; 0, the default, runs them only once). Options given on the command
+	line apply to every job that does not set them itself.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(daemon, 0, sizeof(*daemon));
+	
+	const char* const filename = defaults->daemon;
+	
+	json_auto_t* tree = job_read(filename);
+	
+	if (tree == NULL) {
+		return -1;
+	}
+	
+	const json_t* const workers = json_object_get(tree, "workers");
+	const json_t* const interval = json_object_get(tree, "interval");
+	const json_t* const jobs = json_object_get(tree, "jobs");
+	
+	if ((workers != NULL && (!json_is_integer(workers) || json_integer_value(workers) < 1)) ||
+		(interval != NULL && (!json_is_integer(interval) || json_integer_value(interval) < 0)) ||
+		jobs == NULL || !json_is_array(jobs) || json_array_size(jobs) < 1) {
+		fprintf(stderr, "- O arquivo de tarefa localizado em '%s' possui um formato inválido!\r\n", filename);
+		return -1;
+	}
+	
+	daemon->workers = (workers == NULL) ? DAEMON_DEFAULT_WORKERS : (size_t) json_integer_value(workers);
+	daemon->interval = (interval == NULL) ? 0 : (size_t) json_integer_value(interval);
+	
+	daemon->jobs = calloc(json_array_size(jobs), sizeof(*daemon->jobs));
+	
+	if (daemon->jobs == NULL) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+		return -1;
+	}
+	
+	size_t index = 0;
+	const json_t* item = NULL;
+	
+	json_array_foreach(jobs, index, item) {
+		struct Job* const job = &daemon->jobs[daemon->count++];
+		
+		job->headless = 1;
+		job->keep_names = -1;
+		
+		if (!json_is_object(item)) {
+			fprintf(stderr, "- O arquivo de tarefa localizado em '%s' possui um formato inválido!\r\n", filename);
+			daemon_free(daemon);
+			return -1;
+		}
+		
+		if (job_load(job, item, filename) == -1) {
+			daemon_free(daemon);
+			return -1;
+		}
+		
+		// Credentials are specific to each job, so only these are taken from the command line
+		const char* const options[] = {defaults->provider, defaults->selection, defaults->directory};
+		char** const destinations[] = {&job->provider, &job->selection, &job->directory};
+		
+		for (size_t position = 0; position < sizeof(destinations) / sizeof(*destinations); position++) {
+			if (options[position] != NULL && job_set(destinations[position], options[position]) == -1) {
+				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+				daemon_free(daemon);
+				return -1;
+			}
+		}
+		
+		if (job->keep_names == -1) {
+			job->keep_names = defaults->keep_names;
+		}
+		
+		if (job->provider == NULL) {
+			fprintf(stderr, "- Uma das tarefas listadas em '%s' não especifica o provedor de serviços!\r\n", filename);
+			daemon_free(daemon);
+			return -1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+void daemon_free(struct Daemon* const daemon) {
+	
+	for (size_t index = 0; index < daemon->count; index++) {
+		job_free(&daemon->jobs[index]);
+	}
+	
+	free(daemon->jobs);
+	
+	daemon->jobs = NULL;
+	daemon->count = 0;
+	
+}
@@ -0,0 +1,40 @@
+#include <stdlib.h>
+
+#if defined(_WIN32) && defined(_UNICODE)
+	#include <wchar.h>
+#endif
+
+#if defined(_WIN32) && defined(_UNICODE)
+	typedef wchar_t argument_t;
+#else
+	typedef char argument_t;
+#endif
+
+struct Job {
+	int headless; /* Whether anything was given on the command line; nothing is asked interactively if so */
+	char* provider; /* Label (or configuration directory) of the provider */
+	char* account; /* Username of a saved account */
+	char* username; /* Credentials of an account to log in with */
+	char* password;
+	char* selection; /* Which resources to download; same syntax as the interactive prompt, or "*" for all */
+	int keep_names; /* (-1) if not specified */
+	char* directory; /* Where to save the resources; defaults to the current directory */
+	char* daemon; /* Daemon file listing the jobs to run, if any */
+};
+
+#define DAEMON_DEFAULT_WORKERS 2
+
+struct Daemon {
+	size_t workers; /* Maximum number of jobs running at the same time */
+	size_t interval; /* Seconds to wait between rounds; 0 means a single round */
+	size_t count;
+	struct Job* jobs;
+};
+
+int job_parse(struct Job* const job, const int argc, argument_t* argv[]);
+void job_free(struct Job* const job);
+
+int daemon_load(struct Daemon* const daemon, const struct Job* const defaults);
+void daemon_free(struct Daemon* const daemon);
+
+#pragma once
@@ -7,6 +7,8 @@
 #include "symbols.h"
 #include "fstream.h"
 #include "readlines.h"
+#include "buffer.h"
+#include "scan.h"
 
 /*
 static const char s[] = 
@@ -30,7 +32,8 @@ static const char s[] =
 	"4k/skate_phantom_flex_4k_8288_2160p.m3u8\n";
 */
 
-#define M3U8_MAX_LINE (1024 * 10) // 10 KiB should be enough
+#define M3U8_ARENA_BLOCK_SIZE (1024 * 64) // Big enough for most playlists to fit in a single block
+#define M3U8_ARENA_ALIGNMENT 16
 
 #define M3U8_PLAYLIST_TAG 1
 #define M3U8_PLAYLIST_COMMENT 2
@@ -129,9 +132,9 @@ static enum M3U8TagType m3u8tag_unstringify(const char* const name) {
 	
 }
 
-static int namesafe(const char* const s) {
+static int namesafe(const char* const s, const size_t size) {
 	
-	for (size_t index = 0; index < strlen(s); index++) {
+	for (size_t index = 0; index < size; index++) {
 		const unsigned char ch = s[index];
 		
 		const int safe = (isdigit(ch) || isupper(ch) || ch == *HYPHEN);
@@ -178,395 +181,377 @@ static enum M3U8TagVType m3u8tag_get_vtype(const struct M3U8Tag tag) {
 	
 }
 
-int m3u8_parse(struct M3U8Playlist* const playlist, const char* const s) {
+static int m3u8tag_accepts_uri(const struct M3U8Tag* const tag) {
 	
-	struct ReadLines readlines = {0};
-	readlines_init(&readlines, s);
+	return (tag->type == EXT_X_KEY || tag->type == EXT_X_STREAM_INF || tag->type == EXTINF);
 	
-	struct Line current_line = {0};
+}
+
+struct M3U8ArenaBlock {
+	struct M3U8ArenaBlock* next;
+	size_t offset;
+	size_t size;
+	unsigned char data[];
+};
+
+struct M3U8Arena {
+	struct M3U8ArenaBlock* blocks;
+};
+
+static struct M3U8Arena* m3u8arena_new(const size_t size) {
+	/*
+	Creates an arena whose first block is able to hold at least the specified number of bytes.
 	
-	enum M3U8TagType tags = 0;
+	Returns NULL on error.
+	*/
 	
-	char line[M3U8_MAX_LINE];
+	struct M3U8Arena* const arena = malloc(sizeof(*arena));
 	
-	while (1) {
-		if (readlines_next(&readlines, &current_line) == NULL) {
-			break;
-		}
+	if (arena == NULL) {
+		return NULL;
+	}
+	
+	const size_t block_size = (size > M3U8_ARENA_BLOCK_SIZE) ? size : M3U8_ARENA_BLOCK_SIZE;
+	
+	arena->blocks = malloc(sizeof(*arena->blocks) + block_size);
+	
+	if (arena->blocks == NULL) {
+		free(arena);
+		return NULL;
+	}
+	
+	arena->blocks->next = NULL;
+	arena->blocks->offset = 0;
+	arena->blocks->size = block_size;
+	
+	return arena;
+	
+}
+
+static void m3u8arena_free(struct M3U8Arena* const arena) {
+	
+	struct M3U8ArenaBlock* block = arena->blocks;
+	
+	while (block != NULL) {
+		struct M3U8ArenaBlock* const next = block->next;
+		free(block);
 		
-		if ((current_line.size + 1) > sizeof(line)) {
-			return M3U8ERR_PLAYLIST_LINE_TOO_LONG;
+		block = next;
+	}
+	
+	free(arena);
+	
+}
+
+static void* m3u8arena_alloc(struct M3U8Arena* const arena, const size_t size) {
+	/*
+	Takes a chunk of memory from the arena. Chunks are never released individually;
+	they all go away at once when the arena itself is freed.
+	
+	Returns NULL on error.
+	*/
+	
+	const size_t aligned_size = (size + (M3U8_ARENA_ALIGNMENT - 1)) & ~((size_t) (M3U8_ARENA_ALIGNMENT - 1));
+	
+	struct M3U8ArenaBlock* block = arena->blocks;
+	
+	if ((block->size - block->offset) < aligned_size) {
+		const size_t block_size = (aligned_size > M3U8_ARENA_BLOCK_SIZE) ? aligned_size : M3U8_ARENA_BLOCK_SIZE;
+		
+		block = malloc(sizeof(*block) + block_size);
+		
+		if (block == NULL) {
+			return NULL;
 		}
 		
-		memcpy(line, current_line.begin, current_line.size);
-		line[current_line.size] = '\0';
+		block->next = arena->blocks;
+		block->offset = 0;
+		block->size = block_size;
 		
-		struct M3U8Tag tag = {0};
-		int type = 0;
+		arena->blocks = block;
+	}
+	
+	void* const chunk = block->data + block->offset;
+	block->offset += aligned_size;
+	
+	return chunk;
+	
+}
+
+static char* m3u8arena_strdup(struct M3U8Arena* const arena, const char* const s) {
+	
+	const size_t size = strlen(s) + 1;
+	
+	char* const copy = m3u8arena_alloc(arena, size);
+	
+	if (copy == NULL) {
+		return NULL;
+	}
+	
+	memcpy(copy, s, size);
+	
+	return copy;
+	
+}
+
+static int m3u8parser_append(buffer_t* const buffer, const char* const chunk, const size_t size) {
+	
+	char* const s = realloc(buffer->s, buffer->slength + size + 1);
+	
+	if (s == NULL) {
+		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	buffer->s = s;
+	
+	memcpy(buffer->s + buffer->slength, chunk, size);
+	
+	buffer->slength += size;
+	buffer->s[buffer->slength] = '\0';
+	
+	return M3U8ERR_SUCCESS;
+	
+}
+
+static int m3u8tags_append(struct M3U8Arena* const arena, struct M3U8Tags* const tags, const struct M3U8Tag* const tag) {
+	/*
+	Appends the tag to the list, taking a bigger array from the arena whenever the current one is full.
+	The old array is simply abandoned; since the capacity doubles each time, the wasted space
+	never exceeds the size of the final array.
+	*/
+	
+	if (((tags->offset + 1) * sizeof(*tags->items)) > tags->size) {
+		const size_t capacity = (tags->offset == 0) ? 16 : tags->offset * 2;
+		const size_t size = capacity * sizeof(*tags->items);
 		
-		if (*line == *HASHTAG) {
-			type = (memcmp(line + 1, "EXT", 3) == 0) ? M3U8_PLAYLIST_TAG : M3U8_PLAYLIST_COMMENT;
-		} else {
-			type = M3U8_PLAYLIST_URI;
+		struct M3U8Tag* const items = m3u8arena_alloc(arena, size);
+		
+		if (items == NULL) {
+			return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 		}
 		
-		// RFC 8216 states that the first line in the playlist must be the 'EXTM3U' tag; neither comments nor URIs are allowed before this
-		if (current_line.index == 0 && type != M3U8_PLAYLIST_TAG) {
-			return M3U8ERR_PLAYLIST_INVALID;
+		if (tags->offset > 0) {
+			memcpy(items, tags->items, tags->offset * sizeof(*tags->items));
 		}
 		
-		switch (type) {
-			case M3U8_PLAYLIST_TAG: {
-				/*
-				In RFC 8216, Section 8.6, it is stated that M3U8 tags can continue on the next line by
-				specifying a backslash ('\') at the end of the line
-				*/
-				while (current_line.begin[current_line.size - 1] == *BACKSLASH) {
-					if (readlines_next(&readlines, &current_line) == NULL) {
-						return M3U8ERR_PLAYLIST_LINE_UNTERMINATED;
-					}
-					
-					current_line.index--;
-					
-					char* position = line + (strlen(line) - 1);
-					
-					// Remove the backslash from the line
-					*position = '\0';
-					
-					// Remove trailing whitespaces
-					while (position != line) {
-						position--;
-						
-						if (!isspace(*position)) {
-							break;
-						}
-						
-						*position = '\0';
-					}
-					
-					position++;
-					
-					if ((strlen(line) + current_line.size + 1) > sizeof(line)) {
-						return M3U8ERR_PLAYLIST_LINE_TOO_LONG;
-					}
-					
-					memcpy(position, current_line.begin, current_line.size);
-					position[current_line.size] = '\0';
-				}
-				
-				const char* start = line + 1;
-				const char* end = strstr(start, COLON);
+		tags->items = items;
+		tags->size = size;
+	}
+	
+	tags->items[tags->offset++] = *tag;
+	
+	return M3U8ERR_SUCCESS;
+	
+}
+
+static int m3u8_parse_tag(struct M3U8Arena* const arena, struct M3U8Tag* const tag, char* const line, const size_t size) {
+	/*
+	Parses a single tag line in place. The line does not need to be NUL-terminated, but line[size] must be writable;
+	keys, values and items are split by writing NUL characters into the line and the tag keeps pointers into it.
+	*/
+	
+	char* const lend = line + size;
+	*lend = '\0';
+	
+	char* const start = line + 1;
+	char* end = memchr(start, *COLON, (size_t) (lend - start));
+	
+	if (end == NULL) {
+		end = lend;
+	}
+	
+	// RFC 8216 states that an tag name is only valid if it contains characters from the set [A-Z], [0-9], and '-'
+	if (!namesafe(start, (size_t) (end - start))) {
+		return M3U8ERR_TAG_NAME_INVALID;
+	}
+	
+	const int has_value = (end != lend);
+	
+	*end = '\0';
+	
+	tag->type = m3u8tag_unstringify(start);
+	
+	if (tag->type == 0) {
+		return M3U8ERR_TAG_NAME_INVALID;
+	}
+	
+	tag->vtype = m3u8tag_get_vtype(*tag);
+	tag->arena = arena;
+	
+	/*
+	According to RFC 8216, an M3U8 tag may or may not require a value to be supplied after it.
+	For those tags for which a value is required, there are basically three types of values accepted:
+	
+	* A list of key=value pairs delimited with a comma (e.g., "X-EXT-EXAMPLE:key=value,anotherkey=anothervalue").
+	* A list of items delimited with a comma (e.g., "X-EXT-EXAMPLE:9999,Some string").
+	* A single-value one (e.g., "X-EXT-EXAMPLE:value").
+	*/
+	switch (tag->vtype) {
+		case M3U8TAGV_NONE: {
+			if (has_value) {
+				return M3U8ERR_TAG_TRAILING_OPTIONS;
+			}
+			
+			break;
+		}
+		case M3U8TAGV_ATTRIBUTES_LIST: {
+			if (!has_value) {
+				return M3U8ERR_TAG_MISSING_ATTRIBUTES;
+			}
+			
+			char* cursor = end + 1;
+			
+			// There can never be more attributes than delimiters plus one
+			const size_t capacity = scan_count(cursor, lend, *COMMA) + 1;
+			
+			tag->attributes.size = capacity * sizeof(*tag->attributes.items);
+			tag->attributes.items = m3u8arena_alloc(arena, tag->attributes.size);
+			
+			if (tag->attributes.items == NULL) {
+				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+			}
+			
+			while (1) {
+				char* attribute_end = memchr(cursor, *COMMA, (size_t) (lend - cursor));
 				
-				if (end == NULL) {
-					end = strchr(start, '\0');
+				if (attribute_end == NULL) {
+					attribute_end = lend;
 				}
 				
-				const size_t name_size = (size_t) (end - start);
-				
-				char name[name_size + 1];
-				memcpy(name, start, name_size);
-				name[name_size] = '\0';
-				
-				// RFC 8216 states that an tag name is only valid if it contains characters from the set [A-Z], [0-9], and '-'
-				if (!namesafe(name)) {
-					return M3U8ERR_TAG_NAME_INVALID;
+				if (attribute_end == cursor) {
+					return M3U8ERR_ATTRIBUTE_EMPTY;
 				}
 				
-				tag.type = m3u8tag_unstringify(name);
+				char* const separator = memchr(cursor, *EQUAL, (size_t) (attribute_end - cursor));
 				
-				if (tag.type == 0) {
-					return M3U8ERR_TAG_NAME_INVALID;
+				if (separator == NULL) {
+					return M3U8ERR_ATTRIBUTE_MISSING_VALUE;
 				}
 				
-				// RFC 8216 states that the EXTM3U tag must be the first line of every Media Playlist and Master Playlist
-				if (current_line.index == 0 && tag.type != EXTM3U) {
-					return M3U8ERR_PLAYLIST_INVALID;
+				if (separator == cursor) {
+					return M3U8ERR_ATTRIBUTE_MISSING_NAME;
 				}
 				
-				tag.vtype = m3u8tag_get_vtype(tag);
+				// RFC 8216 states that an attribute name is only valid if it contains characters from the set [A-Z], [0-9], and '-'
+				if (!namesafe(cursor, (size_t) (separator - cursor))) {
+					return M3U8ERR_ATTRIBUTE_NAME_INVALID;
+				}
 				
-				const char* const lend = strchr(line, '\0');
+				*separator = '\0';
 				
-				/*
-				According to RFC 8216, an M3U8 tag may or may not require a value to be supplied after it.
-				For those tags for which a value is required, there are basically three types of values accepted:
+				struct M3U8Attribute attr = {
+					.key = cursor,
+					.value = separator + 1
+				};
 				
-				* A list of key=value pairs delimited with a comma (e.g., "X-EXT-EXAMPLE:key=value,anotherkey=anothervalue").
-				* A list of items delimited with a comma (e.g., "X-EXT-EXAMPLE:9999,Some string").
-				* A single-value one (e.g., "X-EXT-EXAMPLE:value").
-				*/
-				switch (tag.vtype) {
-					case M3U8TAGV_NONE: {
-						if (end != lend) {
-							return M3U8ERR_TAG_TRAILING_OPTIONS;
-						}
-						
-						break;
-					}
-					case M3U8TAGV_ATTRIBUTES_LIST: {
-						if (end == lend) {
-							return M3U8ERR_TAG_MISSING_ATTRIBUTES;
-						}
-						
-						end++;
-						
-						start = end;
-						end = strstr(start, COMMA);
-						
-						while (1) {
-							if (end == NULL) {
-								end = lend;
-							}
-							
-							const size_t attribute_size = (size_t) (end - start);
-							
-							if (attribute_size < 1) {
-								return M3U8ERR_ATTRIBUTE_EMPTY;
-							}
-							
-							char attribute[attribute_size + 1];
-							memcpy(attribute, start, attribute_size);
-							attribute[attribute_size] = '\0';
-							
-							const char* separator = strstr(start, EQUAL);
-							
-							if (separator == NULL) {
-								return M3U8ERR_ATTRIBUTE_MISSING_VALUE;
-							}
-							
-							struct M3U8Attribute attr = {0};
-							
-							const size_t key_size = (size_t) (separator - start);
-							
-							if (key_size < 1) {
-								return M3U8ERR_ATTRIBUTE_MISSING_NAME;
-							}
-							
-							attr.key = malloc(key_size + 1);
-							
-							if (attr.key == NULL) {
-								return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
-							}
-							
-							memcpy(attr.key, start, key_size);
-							attr.key[key_size] = '\0';
-							
-							// RFC 8216 states that an attribute name is only valid if it contains characters from the set [A-Z], [0-9], and '-'
-							if (!namesafe(attr.key)) {
-								free(attr.key);
-								return M3U8ERR_ATTRIBUTE_NAME_INVALID;
-							}
-							
-							// RFC 8216 states that there must not have duplicate attributes within the same tag
-							for (size_t index = 0; index < tag.attributes.offset; index++) {
-								const struct M3U8Attribute* const attribute = &tag.attributes.items[index];
-								
-								const int already_exists = (strcmp(attribute->key, attr.key) == 0);
-								
-								if (already_exists) {
-									free(attr.key);
-									return M3U8ERR_ATTRIBUTE_DUPLICATE;
-								}
-							}
-							
-							if (separator != end) {
-								separator++;
-							}
-							
-							if (*separator == *QUOTATION_MARK) {
-								separator++;
-								
-								const char* value_end = strstr(separator, QUOTATION_MARK);
-								
-								if (value_end == NULL) {
-									return UERR_M3U8_UNTERMINATED_STRING_LITERAL;
-								}
-								
-								end = value_end;
-								attr.is_quoted = 1;
-							}
-							
-							const size_t value_size = (size_t) (separator == end ? 0 : end - separator);
-							
-							if (value_size < 1) {
-								return M3U8ERR_ATTRIBUTE_MISSING_VALUE;
-							}
-							
-							attr.value = malloc(value_size + 1);
-							
-							if (attr.value == NULL) {
-								return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
-							}
-							
-							memcpy(attr.value, separator, value_size);
-							attr.value[value_size] = '\0';
-							
-							const size_t size = tag.attributes.size + sizeof(*tag.attributes.items) * 1;
-							struct M3U8Attribute* items = realloc(tag.attributes.items, size);
-							
-							if (items == NULL) {
-								return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
-							}
-							
-							tag.attributes.items = items;
-							tag.attributes.size = size;
-							
-							tag.attributes.items[tag.attributes.offset++] = attr;
-							
-							if (end == lend) {
-								break;
-							}
-							
-							start = end;
-							start++;
-							
-							if (*start == *COMMA) {
-								start++;
-							}
-							
-							end = strstr(start, COMMA);
-						}
-						
-						break;
+				// RFC 8216 states that there must not have duplicate attributes within the same tag
+				for (size_t index = 0; index < tag->attributes.offset; index++) {
+					const struct M3U8Attribute* const attribute = &tag->attributes.items[index];
+					
+					const int already_exists = (strcmp(attribute->key, attr.key) == 0);
+					
+					if (already_exists) {
+						return M3U8ERR_ATTRIBUTE_DUPLICATE;
 					}
-					case M3U8TAGV_ITEMS_LIST: {
-						if (end == lend) {
-							return M3U8ERR_TAG_MISSING_ITEMS;
-						}
-						
-						end++;
-						
-						start = end;
-						end = strstr(start, COMMA);
-						
-						while (1) {
-							if (end == NULL) {
-								end = lend;
-							}
-							
-							const size_t value_size = (size_t) (end - start);
-							/*
-							if (value_size < 1) {
-								return M3U8ERR_ITEM_EMPTY;
-							}
-							*/
-							
-							if (value_size > 0) {
-								struct M3U8Item item = {0};
-								
-								item.value = malloc(value_size + 1);
-								
-								if (item.value == NULL) {
-									return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
-								}
-								
-								memcpy(item.value, start, value_size);
-								item.value[value_size] = '\0';
-								
-								const size_t size = tag.items.size + sizeof(*tag.items.items) * 1;
-								struct M3U8Item* items = realloc(tag.items.items, size);
-								
-								if (items == NULL) {
-									return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
-								}
-								
-								tag.items.items = items;
-								tag.items.size = size;
-								
-								tag.items.items[tag.items.offset++] = item;
-							}
-							
-							if (end == lend) {
-								break;
-							}
-							
-							start = end;
-							start++;
-							
-							if (*start == *COMMA) {
-								start++;
-							}
-							
-							end = strstr(start, COMMA);
-						}
-						
-						break;
+				}
+				
+				char* value_end = attribute_end;
+				
+				// Where the next attribute begins; NULL if this is the last one
+				char* next = (attribute_end == lend) ? NULL : attribute_end + 1;
+				
+				if (attr.value != lend && *attr.value == *QUOTATION_MARK) {
+					attr.value++;
+					
+					value_end = memchr(attr.value, *QUOTATION_MARK, (size_t) (lend - attr.value));
+					
+					if (value_end == NULL) {
+						return UERR_M3U8_UNTERMINATED_STRING_LITERAL;
 					}
-					case M3U8TAGV_SINGLE_VALUE: {
-						if (end == lend) {
-							return M3U8ERR_TAG_MISSING_VALUE;
-						}
-						
-						end++;
-						
-						start = end;
-						end = lend;
-						
-						const size_t value_size = (size_t) (end - start);
-						
-						if (value_size < 1) {
-							return M3U8ERR_TAG_MISSING_VALUE;
-						}
-						
-						tag.value = malloc(value_size + 1);
-						
-						if (tag.value == NULL) {
-							return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
-						}
-						
-						memcpy(tag.value, start, value_size);
-						tag.value[value_size] = '\0';
-						
-						break;
+					
+					next = value_end + 1;
+					
+					if (next == lend) {
+						next = NULL;
+					} else if (*next == *COMMA) {
+						next++;
 					}
+					
+					attr.is_quoted = 1;
 				}
 				
-				/*
-				There is nothing in RFC 8216 explicitly saying that these tags cannot appear multiple times in the same playlist file,
-				but based on their common usage, I judged that they don't need to appear multiple times or would not make sense if they were specified multiple times.
-				*/
-				if ((tag.type == EXT_X_VERSION || tag.type == EXT_X_TARGETDURATION
-					|| tag.type ==  EXT_X_MEDIA_SEQUENCE || tag.type == EXT_X_ENDLIST
-					|| tag.type ==  EXTM3U || tag.type ==  EXT_X_PLAYLIST_TYPE
-					|| tag.type == EXT_X_I_FRAMES_ONLY) && (tags & tag.type) != 0) {
-					return M3U8ERR_TAG_DUPLICATE;
+				if (value_end == attr.value) {
+					return M3U8ERR_ATTRIBUTE_MISSING_VALUE;
 				}
 				
-				tags |= tag.type;
+				*value_end = '\0';
 				
-				const size_t size = playlist->tags.size + sizeof(*playlist->tags.items) * 1;
-				struct M3U8Tag* items = (struct M3U8Tag*) realloc(playlist->tags.items, size);
+				tag->attributes.items[tag->attributes.offset++] = attr;
 				
-				if (items == NULL) {
-					return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+				if (next == NULL) {
+					break;
 				}
 				
-				playlist->tags.items = items;
-				playlist->tags.size = size;
-				
-				playlist->tags.items[playlist->tags.offset++] = tag;
-				
-				break;
+				cursor = next;
 			}
-			case M3U8_PLAYLIST_COMMENT: {
-				break; // Does anyone even read these comments?!
+			
+			break;
+		}
+		case M3U8TAGV_ITEMS_LIST: {
+			if (!has_value) {
+				return M3U8ERR_TAG_MISSING_ITEMS;
 			}
-			case M3U8_PLAYLIST_URI: {
-				struct M3U8Tag* const tag = &playlist->tags.items[playlist->tags.offset - 1];
+			
+			char* cursor = end + 1;
+			
+			const size_t capacity = scan_count(cursor, lend, *COMMA) + 1;
+			
+			tag->items.size = capacity * sizeof(*tag->items.items);
+			tag->items.items = m3u8arena_alloc(arena, tag->items.size);
+			
+			if (tag->items.items == NULL) {
+				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+			}
+			
+			while (1) {
+				char* item_end = memchr(cursor, *COMMA, (size_t) (lend - cursor));
 				
-				// Only the EXT-X-KEY, EXT-X-STREAM-INF and EXTINF tags are allowed to have an URI
-				if (!(tag->type == EXT_X_KEY || tag->type == EXT_X_STREAM_INF || tag->type == EXTINF)) {
-					return M3U8ERR_PLAYLIST_INVALID;
+				if (item_end == NULL) {
+					item_end = lend;
 				}
 				
-				tag->uri = malloc(sizeof(line));
+				// Empty items are silently ignored
+				if (item_end != cursor) {
+					const struct M3U8Item item = {
+						.value = cursor
+					};
+					
+					tag->items.items[tag->items.offset++] = item;
+				}
 				
-				if (tag->uri == NULL) {
-					return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+				if (item_end == lend) {
+					break;
 				}
 				
-				strcpy(tag->uri, line);
+				*item_end = '\0';
+				
+				cursor = item_end + 1;
+			}
+			
+			break;
+		}
+		case M3U8TAGV_SINGLE_VALUE: {
+			if (!has_value) {
+				return M3U8ERR_TAG_MISSING_VALUE;
 			}
+			
+			tag->value = end + 1;
+			
+			if (tag->value == lend) {
+				return M3U8ERR_TAG_MISSING_VALUE;
+			}
+			
+			break;
 		}
 	}
 	
@@ -574,124 +559,572 @@ int m3u8_parse(struct M3U8Playlist* const playlist, const char* const s) {
 	
 }
 
-void m3u8_free(struct M3U8Playlist* const playlist) {
+static size_t m3u8_arena_estimate(const char* const s, const char* const send) {
+	/*
+	Estimates how much arena space is needed to parse the playlist in the worst case:
+	one tag per line and one attribute per delimiter. This way, even playlists with
+	thousands of segments fit inside the first arena block.
+	*/
+	
+	const size_t lines = scan_count(s, send, *LF) + 1;
+	const size_t delimiters = scan_count(s, send, *COMMA);
+	
+	const size_t size = (
+		(lines * sizeof(struct M3U8Tag)) +
+		((delimiters + lines) * sizeof(struct M3U8Attribute)) +
+		(lines * M3U8_ARENA_ALIGNMENT * 2)
+	);
+	
+	return size;
+	
+}
 
-	for (size_t index = 0; index < playlist->tags.offset; index++) {
-		struct M3U8Tag* const tag = &playlist->tags.items[index];
-		
-		for (size_t index = 0; index < tag->attributes.offset; index++) {
-			struct M3U8Attribute* const attribute = &tag->attributes.items[index];
+static int m3u8_is_tag(const char* const line, const size_t size) {
+	
+	return (size > 3 && *line == *HASHTAG && memcmp(line + 1, "EXT", 3) == 0);
+	
+}
+
+static int m3u8_parse_line(
+	struct M3U8Playlist* const playlist,
+	enum M3U8TagType* const tags,
+	char* const line,
+	const size_t size
+) {
+	/*
+	Parses a single non-blank line, with any tag continuations already joined into it.
+	The line is modified in place and must outlive the playlist; line[size] must be writable.
+	*/
+	
+	int type = 0;
+	
+	if (*line == *HASHTAG) {
+		type = m3u8_is_tag(line, size) ? M3U8_PLAYLIST_TAG : M3U8_PLAYLIST_COMMENT;
+	} else {
+		type = M3U8_PLAYLIST_URI;
+	}
+	
+	// RFC 8216 states that the first line in the playlist must be the 'EXTM3U' tag; neither comments nor URIs are allowed before this
+	if (playlist->tags.offset == 0 && type != M3U8_PLAYLIST_TAG) {
+		return M3U8ERR_PLAYLIST_INVALID;
+	}
+	
+	switch (type) {
+		case M3U8_PLAYLIST_TAG: {
+			struct M3U8Tag tag = {0};
+			
+			const int code = m3u8_parse_tag(playlist->arena, &tag, line, size);
+			
+			if (code != M3U8ERR_SUCCESS) {
+				return code;
+			}
+			
+			// RFC 8216 states that the EXTM3U tag must be the first line of every Media Playlist and Master Playlist
+			if (playlist->tags.offset == 0 && tag.type != EXTM3U) {
+				return M3U8ERR_PLAYLIST_INVALID;
+			}
+			
+			/*
+			There is nothing in RFC 8216 explicitly saying that these tags cannot appear multiple times in the same playlist file,
+			but based on their common usage, I judged that they don't need to appear multiple times or would not make sense if they were specified multiple times.
+			*/
+			if ((tag.type == EXT_X_VERSION || tag.type == EXT_X_TARGETDURATION
+				|| tag.type ==  EXT_X_MEDIA_SEQUENCE || tag.type == EXT_X_ENDLIST
+				|| tag.type ==  EXTM3U || tag.type ==  EXT_X_PLAYLIST_TYPE
+				|| tag.type == EXT_X_I_FRAMES_ONLY) && (*tags & tag.type) != 0) {
+				return M3U8ERR_TAG_DUPLICATE;
+			}
 			
-			free(attribute->key);
-			attribute->key = NULL;
+			*tags |= tag.type;
 			
-			free(attribute->value);
-			attribute->value = NULL;
+			if (m3u8tags_append(playlist->arena, &playlist->tags, &tag) != M3U8ERR_SUCCESS) {
+				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+			}
+			
+			break;
+		}
+		case M3U8_PLAYLIST_COMMENT: {
+			break; // Does anyone even read these comments?!
+		}
+		case M3U8_PLAYLIST_URI: {
+			struct M3U8Tag* const tag = &playlist->tags.items[playlist->tags.offset - 1];
+			
+			// Only the EXT-X-KEY, EXT-X-STREAM-INF and EXTINF tags are allowed to have an URI
+			if (!m3u8tag_accepts_uri(tag)) {
+				return M3U8ERR_PLAYLIST_INVALID;
+			}
+			
+			line[size] = '\0';
+			tag->uri = line;
+		}
+	}
+	
+	return M3U8ERR_SUCCESS;
+	
+}
+
+static int m3u8_parse_lines(struct M3U8Playlist* const playlist, char* const s, const char* const send) {
+	
+	const size_t lines = scan_count(s, send, *LF) + 1;
+	
+	playlist->tags.offset = 0;
+	playlist->tags.size = lines * sizeof(*playlist->tags.items);
+	playlist->tags.items = m3u8arena_alloc(playlist->arena, playlist->tags.size);
+	
+	if (playlist->tags.items == NULL) {
+		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	struct ReadLines readlines = {0};
+	readlines_init(&readlines, s, (size_t) (send - s));
+	
+	struct Line current_line = {0};
+	
+	enum M3U8TagType tags = 0;
+	
+	while (readlines_next(&readlines, &current_line) != NULL) {
+		// Blank lines are ignored
+		if (current_line.size == 0) {
+			continue;
 		}
 		
-		tag->attributes.offset = 0;
-		tag->attributes.size = 0;
-		free(tag->attributes.items);
-		tag->attributes.items = NULL;
+		char* const line = (char*) current_line.begin;
+		size_t line_size = current_line.size;
+		
+		/*
+		In RFC 8216, Section 8.6, it is stated that M3U8 tags can continue on the next line by
+		specifying a backslash ('\') at the end of the line.
 		
-		for (size_t index = 0; index < tag->items.offset; index++) {
-			struct M3U8Item* const item = &tag->items.items[index];
+		The continuation is moved back right after the current line; this is safe because
+		it always lies ahead of it within the same string.
+		*/
+		while (m3u8_is_tag(line, line_size) && line[line_size - 1] == *BACKSLASH) {
+			if (readlines_next(&readlines, &current_line) == NULL) {
+				return M3U8ERR_PLAYLIST_LINE_UNTERMINATED;
+			}
+			
+			// Remove the backslash and trailing whitespaces from the line
+			line_size--;
 			
-			free(item->value);
-			item->value = NULL;
+			while (isspace((unsigned char) line[line_size - 1])) {
+				line_size--;
+			}
+			
+			memmove(line + line_size, current_line.begin, current_line.size);
+			line_size += current_line.size;
+		}
+		
+		const int code = m3u8_parse_line(playlist, &tags, line, line_size);
+		
+		if (code != M3U8ERR_SUCCESS) {
+			return code;
+		}
+	}
+	
+	return M3U8ERR_SUCCESS;
+	
+}
+
+int m3u8_parse_inplace(struct M3U8Playlist* const playlist, char* const s) {
+	/*
+	Parses the playlist without copying it. Keys, values, items and URIs are slices of
+	the supplied string (which gets modified in the process), so it must outlive the playlist.
+	Every other piece of memory is taken from a single arena owned by the playlist.
+	*/
+	
+	const char* const send = strchr(s, '\0');
+	
+	playlist->arena = m3u8arena_new(m3u8_arena_estimate(s, send));
+	
+	if (playlist->arena == NULL) {
+		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	const int code = m3u8_parse_lines(playlist, s, send);
+	
+	if (code != M3U8ERR_SUCCESS) {
+		m3u8_free(playlist);
+	}
+	
+	return code;
+	
+}
+
+int m3u8_parse(struct M3U8Playlist* const playlist, const char* const s) {
+	/*
+	Same as m3u8_parse_inplace(), except that the string is first copied into the arena,
+	so the caller is free to release it right after this returns.
+	*/
+	
+	const char* const send = strchr(s, '\0');
+	const size_t size = (size_t) (send - s) + 1;
+	
+	playlist->arena = m3u8arena_new(m3u8_arena_estimate(s, send) + size + M3U8_ARENA_ALIGNMENT);
+	
+	if (playlist->arena == NULL) {
+		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	char* const copy = m3u8arena_alloc(playlist->arena, size);
+	memcpy(copy, s, size);
+	
+	const int code = m3u8_parse_lines(playlist, copy, copy + (size - 1));
+	
+	if (code != M3U8ERR_SUCCESS) {
+		m3u8_free(playlist);
+	}
+	
+	return code;
+	
+}
+
+void m3u8_free(struct M3U8Playlist* const playlist) {
+	
+	if (playlist->arena != NULL) {
+		m3u8arena_free(playlist->arena);
+		playlist->arena = NULL;
+	}
+	
+	playlist->tags.offset = 0;
+	playlist->tags.size = 0;
+	playlist->tags.items = NULL;
+	
+}
+
+static int m3u8parser_emit(struct M3U8Parser* const parser, const int finished) {
+	/*
+	Hands every complete tag that was not emitted yet to the callback. A tag that may be
+	followed by an URI is only complete once the next line arrives (or the playlist ends).
+	*/
+	
+	const struct M3U8Tags* const tags = &parser->playlist->tags;
+	
+	while (parser->emitted < tags->offset) {
+		struct M3U8Tag* const tag = &tags->items[parser->emitted];
+		
+		const int last = (parser->emitted == (tags->offset - 1));
+		
+		if (last && !finished && tag->uri == NULL && m3u8tag_accepts_uri(tag)) {
+			break;
 		}
 		
-		tag->items.offset = 0;
-		tag->items.size = 0;
-		free(tag->items.items);
-		tag->items.items = NULL;
+		if (parser->callback(tag, parser->userdata) != 0) {
+			return M3U8ERR_CALLBACK_FAILURE;
+		}
 		
-		free(tag->uri);
-		tag->uri = NULL;
+		parser->emitted++;
+	}
+	
+	return M3U8ERR_SUCCESS;
+	
+}
+
+static int m3u8parser_line(struct M3U8Parser* const parser, const char* const begin, const size_t size) {
+	/*
+	Handles a complete physical line. The line is copied into the arena of the playlist
+	(joined with any pending tag continuations) and parsed from there.
+	*/
+	
+	const char* start = begin;
+	const char* end = begin + size;
+	
+	while (start != end && isspace((unsigned char) *start)) {
+		start++;
+	}
+	
+	while (end != start && isspace((unsigned char) *(end - 1))) {
+		end--;
+	}
+	
+	size_t line_size = (size_t) (end - start);
+	
+	if (parser->continuation.slength > 0) {
+		if (m3u8parser_append(&parser->continuation, start, line_size) != M3U8ERR_SUCCESS) {
+			return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		start = parser->continuation.s;
+		line_size = parser->continuation.slength;
+	}
+	
+	// Blank lines are ignored
+	if (line_size == 0) {
+		return M3U8ERR_SUCCESS;
+	}
+	
+	// See RFC 8216, Section 8.6; the rest of this tag comes in the next line
+	if (m3u8_is_tag(start, line_size) && start[line_size - 1] == *BACKSLASH) {
+		line_size--;
+		
+		while (isspace((unsigned char) start[line_size - 1])) {
+			line_size--;
+		}
 		
-		free(tag->value);
-		tag->value = NULL;
+		if (parser->continuation.slength == 0) {
+			if (m3u8parser_append(&parser->continuation, start, line_size) != M3U8ERR_SUCCESS) {
+				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+			}
+		}
+		
+		parser->continuation.slength = line_size;
+		
+		return M3U8ERR_SUCCESS;
+	}
+	
+	char* const line = m3u8arena_alloc(parser->playlist->arena, line_size + 1);
+	
+	if (line == NULL) {
+		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	memcpy(line, start, line_size);
+	
+	parser->continuation.slength = 0;
+	
+	const int code = m3u8_parse_line(parser->playlist, &parser->tags, line, line_size);
+	
+	if (code != M3U8ERR_SUCCESS) {
+		return code;
 	}
 	
+	return m3u8parser_emit(parser, 0);
+	
+}
+
+int m3u8parser_init(
+	struct M3U8Parser* const parser,
+	struct M3U8Playlist* const playlist,
+	int (*callback)(struct M3U8Tag* const tag, void* const userdata),
+	void* const userdata
+) {
+	/*
+	Prepares a push parser that fills the playlist with whatever is fed to it through m3u8parser_feed(),
+	calling the callback for each tag as soon as it is complete. The tag passed to the callback may be
+	modified, but the pointer itself must not be kept; the tags array is reallocated as the playlist grows.
+	*/
+	
+	memset(parser, 0, sizeof(*parser));
+	
+	parser->playlist = playlist;
+	parser->callback = callback;
+	parser->userdata = userdata;
+	
+	sha256_init(&parser->parsed);
+	
 	playlist->tags.offset = 0;
 	playlist->tags.size = 0;
-	free(playlist->tags.items);
 	playlist->tags.items = NULL;
 	
+	playlist->arena = m3u8arena_new(M3U8_ARENA_BLOCK_SIZE);
+	
+	if (playlist->arena == NULL) {
+		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	return M3U8ERR_SUCCESS;
+	
 }
 
-int m3u8_dumpf(const struct M3U8Playlist* const playlist, struct FStream* const stream) {
+int m3u8parser_feed(struct M3U8Parser* const parser, const char* const chunk, const size_t size) {
 	
-	for (size_t index = 0; index < playlist->tags.offset; index++) {
-		const struct M3U8Tag* const tag = &playlist->tags.items[index];
+	if (parser->code != M3U8ERR_SUCCESS) {
+		return parser->code;
+	}
+	
+	const char* start = chunk;
+	const char* const end = chunk + size;
+	
+	/*
+	Skip whatever was already consumed before the transfer was restarted. The tags parsed from those
+	bytes were acted upon already, so they must be the very same bytes; once the skipped part is
+	over, it is checked against what was parsed.
+	*/
+	if (parser->position < parser->consumed) {
+		const size_t remaining = parser->consumed - parser->position;
+		const size_t skip = (remaining < size) ? remaining : size;
+		
+		sha256_update(&parser->replayed, start, skip);
+		
+		start += skip;
+		parser->position += skip;
+		
+		if (parser->position == parser->consumed) {
+			struct SHA256 parsed = parser->parsed;
+			
+			unsigned char expected[SHA256_DIGEST_SIZE];
+			unsigned char received[SHA256_DIGEST_SIZE];
+			
+			sha256_final(&parsed, expected);
+			sha256_final(&parser->replayed, received);
+			
+			if (memcmp(expected, received, sizeof(expected)) != 0) {
+				parser->code = M3U8ERR_PLAYLIST_CHANGED;
+				return parser->code;
+			}
+		}
+	}
+	
+	sha256_update(&parser->parsed, start, (size_t) (end - start));
+	
+	parser->position += (size_t) (end - start);
+	
+	if (parser->position > parser->consumed) {
+		parser->consumed = parser->position;
+	}
+	
+	while (start != end) {
+		const char* const lend = scan_byte(start, end, *LF);
 		
-		if (fstream_write(stream, HASHTAG, strlen(HASHTAG)) == -1) {
-			return -1;
+		// Keep the incomplete line around until the rest of it arrives
+		if (lend == NULL) {
+			parser->code = m3u8parser_append(&parser->pending, start, (size_t) (end - start));
+			break;
 		}
 		
-		const char* const name = m3u8tag_stringify(tag->type);
+		if (parser->pending.slength > 0) {
+			parser->code = m3u8parser_append(&parser->pending, start, (size_t) (lend - start));
+			
+			if (parser->code == M3U8ERR_SUCCESS) {
+				parser->code = m3u8parser_line(parser, parser->pending.s, parser->pending.slength);
+			}
+			
+			parser->pending.slength = 0;
+		} else {
+			parser->code = m3u8parser_line(parser, start, (size_t) (lend - start));
+		}
 		
-		if (fstream_write(stream, name, strlen(name)) == -1) {
-			return -1;
+		if (parser->code != M3U8ERR_SUCCESS) {
+			break;
 		}
 		
+		start = lend + 1;
+	}
+	
+	return parser->code;
+	
+}
+
+void m3u8parser_rewind(struct M3U8Parser* const parser) {
+	/*
+	Prepares the parser for the playlist being transmitted again from the beginning (e.g., after a
+	failed transfer was restarted); the bytes that were already consumed are skipped, as long as
+	they turn out to be the same as before (see m3u8parser_feed()).
+	*/
+	
+	parser->position = 0;
+	
+	sha256_init(&parser->replayed);
+	
+}
+
+int m3u8parser_finish(struct M3U8Parser* const parser) {
+	/*
+	Flushes the last line (which might not be followed by a line feed) and emits the remaining tags.
+	*/
+	
+	if (parser->code != M3U8ERR_SUCCESS) {
+		return parser->code;
+	}
+	
+	// The playlist was transmitted again, but came out shorter than before
+	if (parser->position < parser->consumed) {
+		parser->code = M3U8ERR_PLAYLIST_CHANGED;
+		return parser->code;
+	}
+	
+	if (parser->pending.slength > 0) {
+		parser->code = m3u8parser_line(parser, parser->pending.s, parser->pending.slength);
+		parser->pending.slength = 0;
+		
+		if (parser->code != M3U8ERR_SUCCESS) {
+			return parser->code;
+		}
+	}
+	
+	if (parser->continuation.slength > 0) {
+		parser->code = M3U8ERR_PLAYLIST_LINE_UNTERMINATED;
+		return parser->code;
+	}
+	
+	parser->code = m3u8parser_emit(parser, 1);
+	
+	return parser->code;
+	
+}
+
+void m3u8parser_free(struct M3U8Parser* const parser) {
+	/*
+	Releases the line buffers of the parser; the playlist itself is left alone and must be released with m3u8_free().
+	*/
+	
+	buffer_free(&parser->pending);
+	buffer_free(&parser->continuation);
+	
+}
+
+static size_t m3u8_put(char* const s, const size_t offset, const char* const value, const int convert_slashes) {
+	/*
+	Copies the value into the buffer at the specified offset, if there is a buffer at all.
+	Returns the size of the value.
+	*/
+	
+	const size_t size = strlen(value);
+	
+	if (s == NULL) {
+		return size;
+	}
+	
+	char* const destination = s + offset;
+	memcpy(destination, value, size);
+	
+	if (convert_slashes) {
+		for (size_t index = 0; index < size; index++) {
+			char* const ch = &destination[index];
+			
+			if (*ch == *BACKSLASH) {
+				*ch = *SLASH;
+			}
+		}
+	}
+	
+	return size;
+	
+}
+
+static size_t m3u8_render(const struct M3U8Playlist* const playlist, char* const s) {
+	/*
+	Renders the playlist into the buffer and returns the number of bytes written.
+	When the buffer is NULL, nothing is written and only the required size is computed.
+	*/
+	
+	size_t offset = 0;
+	
+	for (size_t index = 0; index < playlist->tags.offset; index++) {
+		const struct M3U8Tag* const tag = &playlist->tags.items[index];
+		
+		offset += m3u8_put(s, offset, HASHTAG, 0);
+		offset += m3u8_put(s, offset, m3u8tag_stringify(tag->type), 0);
+		
 		switch (tag->vtype) {
 			case M3U8TAGV_NONE: {
 				break; // Nothing to do
 			}
 			case M3U8TAGV_ATTRIBUTES_LIST: {
 				for (size_t index = 0; index < tag->attributes.offset; index++) {
-					if (index == 0) {
-						if (fstream_write(stream, COLON, strlen(COLON)) == -1) {
-							return -1;
-						}
-					} else {
-						if (fstream_write(stream, COMMA, strlen(COMMA)) == -1) {
-							return -1;
-						}
-					}
-					
 					const struct M3U8Attribute* const attribute = &tag->attributes.items[index];
 					
-					if (fstream_write(stream, attribute->key, strlen(attribute->key)) == -1) {
-						return -1;
-					}
-					
-					if (fstream_write(stream, EQUAL, strlen(EQUAL)) == -1) {
-						return -1;
-					}
+					offset += m3u8_put(s, offset, (index == 0) ? COLON : COMMA, 0);
+					offset += m3u8_put(s, offset, attribute->key, 0);
+					offset += m3u8_put(s, offset, EQUAL, 0);
 					
 					if (attribute->is_quoted) {
-						if (fstream_write(stream, QUOTATION_MARK, strlen(QUOTATION_MARK)) == -1) {
-							return -1;
-						}
+						offset += m3u8_put(s, offset, QUOTATION_MARK, 0);
 					}
 					
-					if (strcmp(attribute->key, "URI") == 0) {
-						char value[strlen(attribute->value) + 1];
-						strcpy(value, attribute->value);
-						
-						for (size_t index = 0; index < strlen(value); index++) {
-							char* ch = &value[index];
-							
-							if (*ch == *BACKSLASH) {
-								*ch = *SLASH;
-							}
-						}
-						
-						if (fstream_write(stream, value, strlen(value)) == -1) {
-							return -1;
-						}
-					} else {
-						if (fstream_write(stream, attribute->value, strlen(attribute->value)) == -1) {
-							return -1;
-						}
-					}
+					offset += m3u8_put(s, offset, attribute->value, strcmp(attribute->key, "URI") == 0);
 					
 					if (attribute->is_quoted) {
-						if (fstream_write(stream, QUOTATION_MARK, strlen(QUOTATION_MARK)) == -1) {
-							return -1;
-						}
+						offset += m3u8_put(s, offset, QUOTATION_MARK, 0);
 					}
 				}
 				
@@ -699,63 +1132,71 @@ int m3u8_dumpf(const struct M3U8Playlist* const playlist, struct FStream* const
 			}
 			case M3U8TAGV_ITEMS_LIST: {
 				for (size_t index = 0; index < tag->items.offset; index++) {
-					if (index == 0) {
-						if (fstream_write(stream, COLON, strlen(COLON)) == -1) {
-							return -1;
-						}
-					} else {
-						if (fstream_write(stream, COMMA, strlen(COMMA)) == -1) {
-							return -1;
-						}
-					}
-					
 					const struct M3U8Item* const item = &tag->items.items[index];
 					
-					if (fstream_write(stream, item->value, strlen(item->value)) == -1) {
-						return -1;
-					}
+					offset += m3u8_put(s, offset, (index == 0) ? COLON : COMMA, 0);
+					offset += m3u8_put(s, offset, item->value, 0);
 				}
 				
 				break;
 			}
 			case M3U8TAGV_SINGLE_VALUE: {
-				if (fstream_write(stream, COLON, strlen(COLON)) == -1) {
-					return -1;
-				}
-				
-				if (fstream_write(stream, tag->value, strlen(tag->value)) == -1) {
-					return -1;
-				}
+				offset += m3u8_put(s, offset, COLON, 0);
+				offset += m3u8_put(s, offset, tag->value, 0);
 			}
 		}
 		
 		if (tag->uri != NULL) {
-			if (fstream_write(stream, LF, strlen(LF)) == -1) {
-				return -1;
-			}
-			
-			char uri[strlen(tag->uri) + 1];
-			strcpy(uri, tag->uri);
-			
-			for (size_t index = 0; index < strlen(uri); index++) {
-				char* ch = &uri[index];
-				
-				if (*ch == *BACKSLASH) {
-					*ch = *SLASH;
-				}
-			}
-			
-			if (fstream_write(stream, uri, strlen(uri)) == -1) {
-				return -1;
-			}
+			offset += m3u8_put(s, offset, LF, 0);
+			offset += m3u8_put(s, offset, tag->uri, 1);
 		}
 		
-		if (fstream_write(stream, LF, strlen(LF)) == -1) {
-			return -1;
-		}
+		offset += m3u8_put(s, offset, LF, 0);
+	}
+	
+	return offset;
+	
+}
+
+int m3u8_dumps(const struct M3U8Playlist* const playlist, buffer_t* const buffer) {
+	/*
+	Serializes the playlist into a single buffer. The exact size is computed upfront,
+	so the buffer is allocated only once. The caller must release it with buffer_free().
+	*/
+	
+	const size_t size = m3u8_render(playlist, NULL);
+	
+	char* const s = malloc(size + 1);
+	
+	if (s == NULL) {
+		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 	}
 	
-	return 0;
+	m3u8_render(playlist, s);
+	s[size] = '\0';
+	
+	buffer->s = s;
+	buffer->slength = size;
+	
+	return M3U8ERR_SUCCESS;
+	
+}
+
+int m3u8_dumpf(const struct M3U8Playlist* const playlist, struct FStream* const stream) {
+	
+	buffer_t buffer __buffer_free__ = {0};
+	
+	const int code = m3u8_dumps(playlist, &buffer);
+	
+	if (code != M3U8ERR_SUCCESS) {
+		return code;
+	}
+	
+	if (fstream_write(stream, buffer.s, buffer.slength) == -1) {
+		return M3U8ERR_IO_WRITE_FAILURE;
+	}
+	
+	return M3U8ERR_SUCCESS;
 	
 }
 
@@ -798,6 +1239,12 @@ const char* strm3u8err(const int code) {
 			return "This M3U8 playlist contains a line that was not terminated";
 		case M3U8ERR_ATTRIBUTE_NOT_FOUND:
 			return "This M3U8 attribute does not exists within the specified M3U8 tag";
+		case M3U8ERR_IO_WRITE_FAILURE:
+			return "Could not write data to output file";
+		case M3U8ERR_CALLBACK_FAILURE:
+			return "The tag callback reported a failure";
+		case M3U8ERR_PLAYLIST_CHANGED:
+			return "The playlist changed between two transmissions of it";
 		default:
 			return "Unknown error";
 	}
@@ -826,6 +1273,10 @@ int m3u8tag_setattr(
 	const char* const key,
 	const char* const value
 ) {
+	/*
+	The parsed value is a slice of the playlist text and is left untouched; the attribute
+	is simply pointed to a copy of the new value taken from the arena of the playlist.
+	*/
 	
 	struct M3U8Attribute* const attribute = m3u8tag_getattr(tag, key);
 	
@@ -833,15 +1284,13 @@ int m3u8tag_setattr(
 		return M3U8ERR_ATTRIBUTE_NOT_FOUND;
 	}
 	
-	free(attribute->value);
-	
-	attribute->value = malloc(strlen(value) + 1);
+	char* const copy = m3u8arena_strdup(tag->arena, value);
 	
-	if (attribute->value == NULL) {
+	if (copy == NULL) {
 		return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 	}
 	
-	strcpy(attribute->value, value);
+	attribute->value = copy;
 	
 	return M3U8ERR_SUCCESS;
 	
@@ -852,50 +1301,49 @@ int m3u8tag_set(
 	const enum M3U8TagSetType what,
 	const void* const value
 ) {
+	/*
+	Like m3u8tag_setattr(), this never writes to the memory the tag currently points to;
+	the new contents are copied into the arena of the playlist instead.
+	*/
 	
 	switch (what) {
 		case M3U8TAG_SET_URI: {
-			free(tag->uri);
+			char* const copy = m3u8arena_strdup(tag->arena, value);
 			
-			tag->uri = malloc(strlen(value) + 1);
-			
-			if (tag->uri == NULL) {
+			if (copy == NULL) {
 				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 			}
 			
-			strcpy(tag->uri, value);
+			tag->uri = copy;
 			
 			break;
 		}
 		case M3U8TAG_SET_VALUE: {
-			free(tag->value);
-			
-			tag->value = malloc(strlen(value) + 1);
+			char* const copy = m3u8arena_strdup(tag->arena, value);
 			
-			if (tag->value == NULL) {
+			if (copy == NULL) {
 				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 			}
 			
-			strcpy(tag->value, value);
+			tag->value = copy;
 			
 			break;
 		}
 		case M3U8TAG_SET_ATTRIBUTES: {
 			const struct M3U8Attributes* const attributes = (const struct M3U8Attributes* const) value;
 			
-			tag->attributes.size = attributes->size;
-			tag->attributes.items = malloc(tag->attributes.size);
+			struct M3U8Attribute* const items = m3u8arena_alloc(tag->arena, attributes->size);
 			
-			if (tag->attributes.items == NULL) {
+			if (items == NULL) {
 				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 			}
 			
 			for (size_t index = 0; index < attributes->offset; index++) {
 				const struct M3U8Attribute* const source = &attributes->items[index];
 				
-				struct M3U8Attribute destination = {
-					.key = malloc(strlen(source->key) + 1),
-					.value = malloc(strlen(source->value) + 1),
+				const struct M3U8Attribute destination = {
+					.key = m3u8arena_strdup(tag->arena, source->key),
+					.value = m3u8arena_strdup(tag->arena, source->value),
 					.is_quoted = source->is_quoted
 				};
 				
@@ -907,40 +1355,42 @@ int m3u8tag_set(
 					return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 				}
 				
-				strcpy(destination.key, source->key);
-				strcpy(destination.value, source->value);
-				
-				tag->attributes.items[tag->attributes.offset++] = destination;
+				items[index] = destination;
 			}
 			
+			tag->attributes.offset = attributes->offset;
+			tag->attributes.size = attributes->size;
+			tag->attributes.items = items;
+			
 			break;
 		}
 		case M3U8TAG_SET_ITEMS: {
 			const struct M3U8Items* const items = (const struct M3U8Items* const) value;
 			
-			tag->items.size = items->size;
-			tag->items.items = malloc(tag->items.size);
+			struct M3U8Item* const destinations = m3u8arena_alloc(tag->arena, items->size);
 			
-			if (tag->items.items == NULL) {
+			if (destinations == NULL) {
 				return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 			}
 			
 			for (size_t index = 0; index < items->offset; index++) {
 				const struct M3U8Item* const source = &items->items[index];
 				
-				struct M3U8Item destination = {
-					.value = malloc(strlen(source->value) + 1)
+				const struct M3U8Item destination = {
+					.value = m3u8arena_strdup(tag->arena, source->value)
 				};
 				
 				if (destination.value == NULL) {
 					return M3U8ERR_MEMORY_ALLOCATE_FAILURE;
 				}
 				
-				strcpy(destination.value, source->value);
-				
-				tag->items.items[tag->items.offset++] = destination;
+				destinations[index] = destination;
 			}
 			
+			tag->items.offset = items->offset;
+			tag->items.size = items->size;
+			tag->items.items = destinations;
+			
 			break;
 		}
 	}
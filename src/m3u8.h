@@ -1,6 +1,8 @@
 #include <stdio.h>
 
 #include "fstream.h"
+#include "buffer.h"
+#include "sha256.h"
 
 #define M3U8ERR_SUCCESS 0 /* Success */
 #define M3U8ERR_MEMORY_ALLOCATE_FAILURE -1 /* Could not allocate memory */
@@ -28,6 +30,10 @@
 
 #define M3U8ERR_IO_WRITE_FAILURE -18 /* Could not write data to output file */
 
+#define M3U8ERR_CALLBACK_FAILURE -19 /* The tag callback reported a failure */
+
+#define M3U8ERR_PLAYLIST_CHANGED -20 /* The playlist changed between two transmissions of it */
+
 enum M3U8TagVType {
 	M3U8TAGV_NONE, /* This M3U8 tag does not expect any value to be supplied */
 	M3U8TAGV_ATTRIBUTES_LIST,  /* This M3U8 tag expects a list of attributes to be supplied */
@@ -82,6 +88,8 @@ struct M3U8Items {
 	struct M3U8Item* items;
 };
 
+struct M3U8Arena;
+
 struct M3U8Tag {
 	enum M3U8TagType type;
 	enum M3U8TagVType vtype;
@@ -89,6 +97,7 @@ struct M3U8Tag {
 	struct M3U8Items items;
 	char* value;
 	char* uri;
+	struct M3U8Arena* arena;
 };
 
 struct M3U8Tags {
@@ -99,11 +108,40 @@ struct M3U8Tags {
 
 struct M3U8Playlist {
 	struct M3U8Tags tags;
+	struct M3U8Arena* arena;
 };
 
 int m3u8_parse(struct M3U8Playlist* const playlist, const char* const s);
+int m3u8_parse_inplace(struct M3U8Playlist* const playlist, char* const s);
 void m3u8_free(struct M3U8Playlist* const playlist);
 
+struct M3U8Parser {
+	struct M3U8Playlist* playlist;
+	int (*callback)(struct M3U8Tag* const tag, void* const userdata);
+	void* userdata;
+	enum M3U8TagType tags; /* Tags seen so far; used to catch duplicates */
+	size_t emitted; /* Number of tags already handed to the callback */
+	buffer_t pending; /* Incomplete line left from the previous chunk */
+	buffer_t continuation; /* Tag whose continuation is yet to come */
+	size_t position; /* Offset within the current transmission of the playlist */
+	size_t consumed; /* Number of bytes parsed so far */
+	struct SHA256 parsed; /* Hash of the bytes parsed so far */
+	struct SHA256 replayed; /* Hash of the bytes skipped in the current transmission */
+	int code;
+};
+
+int m3u8parser_init(
+	struct M3U8Parser* const parser,
+	struct M3U8Playlist* const playlist,
+	int (*callback)(struct M3U8Tag* const tag, void* const userdata),
+	void* const userdata
+);
+int m3u8parser_feed(struct M3U8Parser* const parser, const char* const chunk, const size_t size);
+void m3u8parser_rewind(struct M3U8Parser* const parser);
+int m3u8parser_finish(struct M3U8Parser* const parser);
+void m3u8parser_free(struct M3U8Parser* const parser);
+
+int m3u8_dumps(const struct M3U8Playlist* const playlist, buffer_t* const buffer);
 int m3u8_dumpf(const struct M3U8Playlist* const playlist, struct FStream* const stream);
 
 const char* strm3u8err(const int code);
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #if defined(_WIN32)
 	#include <stdio.h>
@@ -13,6 +14,7 @@
 
 #if !defined(_WIN32)
 	#include <sys/resource.h>
+	#include <unistd.h>
 #endif
 
 #include <curl/curl.h>
@@ -38,6 +40,16 @@
 #include "cir.h"
 #include "terminal.h"
 #include "ffmpeg.h"
+#include "threads.h"
+#include "writer.h"
+#include "fsindex.h"
+#include "statedb.h"
+#include "sha256.h"
+#include "job.h"
+#include "progress.h"
+#include "resources.h"
+#include "credentials.h"
+#include "trace.h"
 
 #if defined(_WIN32) && defined(_UNICODE)
 	#include "wio.h"
@@ -45,379 +57,2045 @@
 
 #define PAGINATION_MAX_ITEMS 15
 
+#define MUX_DEFAULT_WORKERS 1
+#define MUX_DEFAULT_BACKLOG 2
+
+#define DOWNLOAD_DEFAULT_BUFFER_SIZE (256 * 1024)
+#define DOWNLOAD_DEFAULT_BUFFERS 64
+
+#define VERIFY_DEFAULT_WORKERS 4
+
+#define ATTACHMENT_DEFAULT_TRANSFERS 8
+
+// Connections kept open by the daemon, split between the jobs running at the same time
+#define DAEMON_DEFAULT_CONNECTIONS 30
+
+/*
+Files still being written are kept in this (hidden) directory within the resource's own
+directory, so that publishing them is a rename within the same file system.
+*/
+#define PARTIAL_DIRECTORY ".ara-partial"
+#define PARTIAL_OUTPUT "output"
+
 static const char LOCAL_ACCOUNTS_FILENAME[] = "accounts.json";
+static const char LOCAL_STATE_FILENAME[] = "state.jsonl";
 
-static void curl_poll(struct Download* dqueue, const size_t dcount, size_t* total_done) {
+static size_t get_env_size(const char* const key, const size_t fallback) {
+	/*
+	Reads a non-negative integer from the environment variable, if it is set.
+	*/
 	
-	CURLM* curl_multi = get_global_curl_multi();
+	const char* const value = getenv(key);
+	
+	if (value == NULL || *value == '\0') {
+		return fallback;
+	}
 	
-	int still_running = 1;
+	char* end = NULL;
+	const unsigned long number = strtoul(value, &end, 10);
 	
-	curl_progress_cb(NULL, (const curl_off_t) dcount, (const curl_off_t) *total_done, 0, 0);
+	if (*end != '\0' || *value == '-') {
+		return fallback;
+	}
 	
-	while (still_running) {
-		CURLMcode mc = curl_multi_perform(curl_multi, &still_running);
-		
-		if (still_running) {
-			mc = curl_multi_poll(curl_multi, NULL, 0, 1000, NULL);
+	return (size_t) number;
+	
+}
+
+static int download_start(struct Download* const download, struct Writer* const writer) {
+	/*
+	Opens the output file of a queued download and hands its transfer to the global multi handle.
+	Its contents are written to disk by the writer, off the thread that runs the transfers.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	CURLM* const curl_multi = get_global_curl_multi();
+	
+	download->file = writer_open(writer, download->filename, download->digest);
+	
+	if (download->file == NULL) {
+		return -1;
+	}
+	
+	curl_easy_setopt(download->handle, CURLOPT_WRITEFUNCTION, curl_write_async_cb);
+	curl_easy_setopt(download->handle, CURLOPT_WRITEDATA, (void*) download->file);
+	curl_multi_add_handle(curl_multi, download->handle);
+	
+	return 0;
+	
+}
+
+static int downloads_queue(struct Downloads* const downloads, CURL* const handle, char* const filename) {
+	/*
+	Appends a download to the queue. The queue takes ownership of the handle.
+	*/
+	
+	if ((downloads->offset + 1) * sizeof(*downloads->items) > downloads->size) {
+		const size_t size = (downloads->offset == 0 ? 64 : downloads->offset * 2) * sizeof(*downloads->items);
+		struct Download* const items = realloc(downloads->items, size);
+		
+		if (items == NULL) {
+			curl_easy_cleanup(handle);
+			return UERR_MEMORY_ALLOCATE_FAILURE;
 		}
-			
-		CURLMsg* msg = NULL;
-		int msgs_left = 0;
 		
-		int should_continue = 0;
+		downloads->items = items;
+		downloads->size = size;
+	}
+	
+	const struct Download download = {
+		.handle = handle,
+		.filename = filename
+	};
+	
+	downloads->items[downloads->offset++] = download;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static void download_account(struct Progress* const progress, struct Download* const download, CURL* const handle) {
+	/*
+	Accounts for whatever the transfer received since it was last looked at.
+	*/
+	
+	curl_off_t received = 0;
+	curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+	
+	// A transfer that is retried starts over
+	if ((long long) received < download->received) {
+		download->received = 0;
+	}
+	
+	// The host is only looked up once data arrives, so that it is the one redirects ended up at
+	if (download->host == 0 && (long long) received > download->received) {
+		char* url = NULL;
+		curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
 		
-		while ((msg = curl_multi_info_read(curl_multi, &msgs_left))) {
-			if (msg->msg == CURLMSG_DONE) {
-				struct Download* download = NULL;
-				
-				for (size_t index = 0; index < dcount; index++) {
-					struct Download* const subdownload = &dqueue[index];
-					
-					if (subdownload->handle == msg->easy_handle) {
-						download = subdownload;
-						break;
-					}
-				}
-				
-				curl_multi_remove_handle(curl_multi, msg->easy_handle);
-				
-				if (msg->data.result == CURLE_OK) {
-					curl_easy_cleanup(msg->easy_handle);
-					fstream_close(download->stream);
-					
-					(*total_done)++;
-					curl_progress_cb(NULL, (const curl_off_t) dcount, (const curl_off_t) *total_done, 0, 0);
-				} else {
-					fstream_seek(download->stream, 0, FSTREAM_SEEK_BEGIN);
-					curl_multi_add_handle(curl_multi, msg->easy_handle);
-					
-					if (!should_continue) {
-						should_continue = 1;
-					}
-				}
-			}
+		CURLU* cu __curl_url_cleanup__ = curl_url();
+		char* host __curl_free__ = NULL;
+		
+		if (url != NULL && cu != NULL && curl_url_set(cu, CURLUPART_URL, url, 0) == CURLUE_OK && curl_url_get(cu, CURLUPART_HOST, &host, 0) == CURLUE_OK) {
+			download->host = progress_host(progress, host);
 		}
+	}
+	
+	progress_receive(progress, download->host, (long long) received - download->received);
+	
+	download->received = (long long) received;
+	
+}
+
+static void downloads_progress(const struct Downloads* const downloads, size_t* const first_pending, const size_t started) {
+	/*
+	Reports the combined progress of every queued download: finished downloads count by their
+	size, ongoing ones by what they received so far (see progress.c).
+	
+	Since the size of each download is known from here on, disk space is reserved for its file
+	as well (see writer_allocate()); that is left to the writer, which owns the file.
+	
+	Paused transfers are resumed here too.
+	*/
+	
+	while (*first_pending < started && downloads->items[*first_pending].handle == NULL) {
+		(*first_pending)++;
+	}
+	
+	long long current = 0;
+	long long remaining = 0;
+	size_t active = 0;
+	
+	for (size_t index = *first_pending; index < started; index++) {
+		struct Download* const download = &downloads->items[index];
+		CURL* const handle = download->handle;
 		
-		if (should_continue) {
-			still_running = 1;
+		if (handle == NULL) {
 			continue;
 		}
 		
-		if (mc) {
-			break;
+		download_account(downloads->progress, download, handle);
+		
+		curl_off_t length = 0;
+		curl_easy_getinfo(handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+		
+		current += download->received;
+		active++;
+		
+		if (length > 0 && (long long) length > download->received) {
+			remaining += (long long) length - download->received;
+		}
+		
+		if (length > 0 && writer_allocate(download->file, (long long) length) == -1) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+		}
+		
+		// Transfers that were paused for lack of a buffer to write into are resumed once one is free
+		if (download->retry_at == 0 && download->file->paused && writer_resume(download->file)) {
+			curl_easy_pause(handle, CURLPAUSE_CONT);
 		}
 	}
 	
+	progress_report(downloads->progress, current, remaining, active, downloads->offset - started);
+	
 }
 
-static int m3u8_download(const char* const url, const char* const output) {
+struct M3U8Download {
+	const char* url;
+	const char* output;
+	CURLU* cu;
+	int segment_number;
+	struct Downloads* downloads;
+	struct M3U8Playlist playlist;
+	struct M3U8Parser parser;
+	CURL* handle;
+	int added; /* Whether the transfer was handed to the multi handle (and holds a transfer slot) */
+	size_t retries; /* Number of times the transfer of the playlist was retried */
+	long long retry_at; /* When the failed transfer is to be tried again (see get_monotonic_clock()); 0 if it is not waiting */
+};
+
+static int curl_poll(
+	struct Downloads* const downloads,
+	size_t* const total_done,
+	struct Writer* const writer,
+	struct M3U8Download* const playlists,
+	const size_t count
+) {
+	/*
+	Runs the global multi handle until every queued download is done. Downloads may be queued
+	while this runs; that is what happens when the transfers of M3U8 playlists are supplied,
+	since their tags are parsed (and their segments queued) as the playlists arrive.
+	
+	Failed transfers are retried the same way curl_easy_perform_retry() does it (see
+	curl_retry_after()), except that the transfer is set aside while it waits, so that the
+	others go on in the meantime.
+	
+	A transfer is only handed to the multi handle once it holds one of the slots of the
+	process-wide connection limit (see curl_slot_acquire()); whatever slots are still held
+	when this returns are given back.
+	*/
 	
 	CURLM* const curl_multi = get_global_curl_multi();
-	CURL* const curl_easy = get_global_curl_easy();
 	
-	buffer_t string __buffer_free__ = {0};
+	size_t slots __curl_slot_release__ = 0;
 	
-	curl_easy_setopt(curl_easy, CURLOPT_REFERER, url);
-	curl_easy_setopt(curl_easy, CURLOPT_URL, url);
-	curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, curl_write_string_cb);
-	curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, &string);
-	
-	if (curl_easy_perform_retry(curl_easy) != CURLE_OK) {
-		return UERR_CURL_FAILURE;
-	}
+	size_t started = 0;
+	size_t first_pending = 0;
 	
-	struct M3U8Playlist playlist = {0};
+	size_t pending_playlists = 0;
 	
-	if (m3u8_parse(&playlist, string.s) != M3U8ERR_SUCCESS) {
-		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-		return UERR_M3U8_PARSE_FAILURE;
+	for (size_t index = 0; index < count; index++) {
+		pending_playlists += (playlists[index].handle != NULL);
 	}
 	
-	int segment_number = 1;
-	
-	struct Download dl_queue[playlist.tags.offset];
-	size_t dl_total = 0;
-	size_t dl_done = 0;
-	
-	char playlist_filename[strlen(output) + strlen(DOT) + strlen(M3U8_FILE_EXTENSION) + 1];
-	strcpy(playlist_filename, output);
-	strcat(playlist_filename, DOT);
-	strcat(playlist_filename, M3U8_FILE_EXTENSION);
+	size_t retrying = 0;
 	
-	CURLU* cu __curl_url_cleanup__ = curl_url();
-	curl_url_set(cu, CURLUPART_URL, url, 0);
+	int still_running = 0;
 	
-	for (size_t index = 0; index < playlist.tags.offset; index++) {
-		struct M3U8Tag* const tag = &playlist.tags.items[index];
+	while (1) {
+		// Whether a transfer is being held back until a slot is given back
+		int waiting = 0;
 		
-		if (tag->type == EXT_X_KEY) {
-			struct M3U8Attribute* const attribute = m3u8tag_getattr(tag, "URI");
-			
-			curl_url_set(cu, CURLUPART_URL, url, 0);
-			curl_url_set(cu, CURLUPART_URL, attribute->value, 0);
-			
-			char* key_url __curl_free__ = NULL;
-			curl_url_get(cu, CURLUPART_URL, &key_url, 0);
-			
-			char* filename = malloc(strlen(output) + strlen(DOT) + strlen(KEY_FILE_EXTENSION) + 1);
-			strcpy(filename, output);
-			strcat(filename, DOT);
-			strcat(filename, KEY_FILE_EXTENSION);
-			
-			m3u8tag_setattr(tag, "URI", filename);
-			
-			CURL* handle = curl_easy_new();
-			
-			if (handle == NULL) {
-				fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-				return UERR_FAILURE;
-			}
-			
-			curl_easy_setopt(handle, CURLOPT_REFERER, url);
-			curl_easy_setopt(handle, CURLOPT_URL, key_url);
+		if (retrying > 0) {
+			const long long now = get_monotonic_clock();
 			
-			struct FStream* stream = fstream_open(filename, FSTREAM_WRITE);
-			
-			if (stream == NULL && errno == EMFILE) {
-				curl_poll(dl_queue, dl_total, &dl_done);
-				stream = fstream_open(filename, FSTREAM_WRITE);
+			for (size_t index = 0; index < count; index++) {
+				struct M3U8Download* const playlist = &playlists[index];
+				
+				// The playlist is handed to the multi handle again along with the ones not started yet
+				if (playlist->retry_at != 0 && now >= playlist->retry_at) {
+					playlist->retry_at = 0;
+					retrying--;
+				}
 			}
 			
-			if (stream == NULL) {
-				const struct SystemError error = get_system_error();
+			for (size_t index = first_pending; index < started && !waiting; index++) {
+				struct Download* const download = &downloads->items[index];
+				
+				if (!(download->handle != NULL && download->retry_at != 0 && now >= download->retry_at)) {
+					continue;
+				}
+				
+				if (!curl_slot_acquire(0)) {
+					waiting = 1;
+					break;
+				}
 				
-				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", filename, error.message);
-				return UERR_FAILURE;
+				slots++;
+				
+				download->retry_at = 0;
+				retrying--;
+				
+				curl_multi_add_handle(curl_multi, download->handle);
 			}
+		}
+		
+		for (size_t index = 0; index < count && !waiting; index++) {
+			struct M3U8Download* const playlist = &playlists[index];
 			
-			curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_file_cb);
-			curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*) stream);
-			curl_multi_add_handle(curl_multi, handle);
-			
-			struct Download download = {
-				.handle = handle,
-				.filename = filename,
-				.stream = stream
-			};
-			
-			dl_queue[dl_total++] = download;
-			
-			curl_url_set(cu, CURLUPART_URL, url, 0);
-			curl_url_set(cu, CURLUPART_URL, tag->uri, 0);
-			
-			char* segment_url __curl_free__ = NULL;
-			curl_url_get(cu, CURLUPART_URL, &segment_url, 0);
-			
-			handle = curl_easy_new();
-			
-			if (handle == NULL) {
-				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar inicializar o cliente HTTP!\r\n");
-				return UERR_FAILURE;
+			if (playlist->handle == NULL || playlist->added || playlist->retry_at != 0) {
+				continue;
 			}
 			
-			curl_easy_setopt(handle, CURLOPT_REFERER, url);
-			curl_easy_setopt(handle, CURLOPT_URL, segment_url);
-			
-			char value[intlen(segment_number) + 1];
-			snprintf(value, sizeof(value), "%i", segment_number);
-			
-			char* segment_filename = malloc(strlen(output) + strlen(DOT) + strlen(value) + strlen(DOT) + strlen(TS_FILE_EXTENSION) + 1);
-			strcpy(segment_filename, output);
-			strcat(segment_filename, DOT);
-			strcat(segment_filename, value);
-			strcat(segment_filename, DOT);
-			strcat(segment_filename, TS_FILE_EXTENSION);
+			if (!curl_slot_acquire(0)) {
+				waiting = 1;
+				break;
+			}
 			
-			m3u8tag_set(tag, M3U8TAG_SET_URI, segment_filename);
+			slots++;
 			
-			stream = fstream_open(segment_filename, FSTREAM_WRITE);
+			playlist->added = 1;
+			curl_multi_add_handle(curl_multi, playlist->handle);
+		}
+		
+		while (!waiting && started < downloads->offset && (downloads->limit == 0 || started - *total_done < downloads->limit)) {
+			struct Download* const download = &downloads->items[started];
 			
-			if (stream == NULL && errno == EMFILE) {
-				curl_poll(dl_queue, dl_total, &dl_done);
-				stream = fstream_open(segment_filename, FSTREAM_WRITE);
+			if (!curl_slot_acquire(0)) {
+				waiting = 1;
+				break;
 			}
 			
-			if (stream == NULL) {
-				const struct SystemError error = get_system_error();
-				
-				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", filename, error.message);
-				return UERR_FAILURE;
+			slots++;
+			
+			if (download_start(download, writer) == 0) {
+				started++;
+				continue;
 			}
 			
-			curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_file_cb);
-			curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*) stream);
-			curl_multi_add_handle(curl_multi, handle);
+			curl_slot_release(1);
+			slots--;
 			
-			download = (struct Download) {
-				.handle = handle,
-				.filename = segment_filename,
-				.stream = stream
-			};
+			// Too many open files; wait for some of the ongoing downloads to finish
+			if (errno == EMFILE && started > *total_done) {
+				break;
+			}
 			
-			dl_queue[dl_total++] = download;
+			const struct SystemError error = get_system_error();
 			
-			segment_number++;
-		} else if (tag->type == EXTINF && tag->uri != NULL) {
-			curl_url_set(cu, CURLUPART_URL, url, 0);
-			curl_url_set(cu, CURLUPART_URL, tag->uri, 0);
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", download->filename, error.message);
+			return UERR_FAILURE;
+		}
+		
+		downloads_progress(downloads, &first_pending, started);
+		
+		CURLMcode mc = curl_multi_perform(curl_multi, &still_running);
+		
+		/*
+		Transfers waiting to be retried are checked on at least once a second; those waiting for a
+		slot more often, as the slot may be given back by another thread.
+		*/
+		if (still_running || retrying > 0 || waiting) {
+			mc = curl_multi_poll(curl_multi, NULL, 0, waiting ? 100 : 1000, NULL);
+		}
+		
+		CURLMsg* msg = NULL;
+		int msgs_left = 0;
+		
+		int should_continue = 0;
+		
+		while ((msg = curl_multi_info_read(curl_multi, &msgs_left))) {
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
 			
-			char* segment_url __curl_free__ = NULL;
-			curl_url_get(cu, CURLUPART_URL, &segment_url, 0);
+			CURL* const handle = msg->easy_handle;
+			const CURLcode result = msg->data.result;
 			
-			char value[intlen(segment_number) + 1];
-			snprintf(value, sizeof(value), "%i", segment_number);
+			trace_transfer(handle, result);
 			
-			char* filename = malloc(strlen(output) + strlen(DOT) + strlen(value) + strlen(DOT) + strlen(TS_FILE_EXTENSION) + 1);
-			strcpy(filename, output);
-			strcat(filename, DOT);
-			strcat(filename, value);
-			strcat(filename, DOT);
-			strcat(filename, TS_FILE_EXTENSION);
+			curl_multi_remove_handle(curl_multi, handle);
 			
-			m3u8tag_set(tag, M3U8TAG_SET_URI, filename);
+			curl_slot_release(1);
+			slots--;
 			
-			CURL* handle = curl_easy_new();
+			struct M3U8Download* playlist = NULL;
 			
-			if (handle == NULL) {
-				fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-				return UERR_FAILURE;
+			for (size_t index = 0; index < count; index++) {
+				if (playlists[index].handle == handle) {
+					playlist = &playlists[index];
+					break;
+				}
 			}
 			
-			curl_easy_setopt(handle, CURLOPT_REFERER, url);
-			curl_easy_setopt(handle, CURLOPT_URL, segment_url);
+			if (playlist != NULL) {
+				struct M3U8Parser* const parser = &playlist->parser;
+				
+				playlist->added = 0;
+				
+				if (parser->code != M3U8ERR_SUCCESS) {
+					curl_easy_cleanup(handle);
+					playlist->handle = NULL;
+					
+					if (parser->code == M3U8ERR_PLAYLIST_CHANGED) {
+						fprintf(stderr, "- A playlist em '%s' mudou entre uma tentativa de conexão e outra!\r\n", playlist->url);
+					}
+					
+					return UERR_M3U8_PARSE_FAILURE;
+				}
+				
+				if (result == CURLE_OK) {
+					curl_easy_cleanup(handle);
+					playlist->handle = NULL;
+					
+					pending_playlists--;
+					
+					if (m3u8parser_finish(parser) != M3U8ERR_SUCCESS) {
+						return UERR_M3U8_PARSE_FAILURE;
+					}
+				} else {
+					size_t delay = 0;
+					
+					if (!curl_retry_after(handle, result, &playlist->retries, &delay)) {
+						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar baixar a playlist em '%s': %s\r\n", playlist->url, curl_easy_strerror(result));
+						return UERR_CURL_FAILURE;
+					}
+					
+					// The playlist is transmitted again from the start; the part already parsed must not change
+					m3u8parser_rewind(parser);
+					
+					playlist->retry_at = get_monotonic_clock() + (long long) delay * 1000000;
+					retrying++;
+				}
+				
+				should_continue = 1;
+				
+				continue;
+			}
 			
-			struct FStream* stream = fstream_open(filename, FSTREAM_WRITE);
+			struct Download* download = NULL;
 			
-			if (stream == NULL && errno == EMFILE) {
-				curl_poll(dl_queue, dl_total, &dl_done);
-				stream = fstream_open(filename, FSTREAM_WRITE);
+			for (size_t index = first_pending; index < started; index++) {
+				struct Download* const subdownload = &downloads->items[index];
+				
+				if (subdownload->handle == handle) {
+					download = subdownload;
+					break;
+				}
 			}
 			
-			if (stream == NULL) {
-				const struct SystemError error = get_system_error();
+			if (result == CURLE_OK) {
+				download_account(downloads->progress, download, handle);
+				progress_complete(downloads->progress, download->received);
+				
+				if (download->keep) {
+					download->finished = handle;
+				} else {
+					curl_easy_cleanup(handle);
+				}
+				
+				// The writer has already reported whatever went wrong
+				const int status = writer_close(download->file);
+				
+				download->handle = NULL;
+				download->file = NULL;
+				
+				if (status == -1) {
+					return UERR_FSTREAM_FAILURE;
+				}
+				
+				(*total_done)++;
+			} else {
+				size_t delay = 0;
 				
-				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", filename, error.message);
-				return UERR_FAILURE;
+				if (!curl_retry_after(handle, result, &download->retries, &delay)) {
+					char* url = NULL;
+					curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+					
+					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar baixar o arquivo de '%s': %s\r\n", url == NULL ? download->filename : url, curl_easy_strerror(result));
+					return UERR_CURL_FAILURE;
+				}
+				
+				if (writer_rewind(download->file) == -1) {
+					return UERR_FSTREAM_FAILURE;
+				}
+				
+				download->retry_at = get_monotonic_clock() + (long long) delay * 1000000;
+				retrying++;
 			}
 			
-			curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_file_cb);
-			curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*) stream);
-			curl_multi_add_handle(curl_multi, handle);
-			
-			struct Download download = {
-				.handle = handle,
-				.filename = filename,
-				.stream = stream
-			};
-			
-			dl_queue[dl_total++] = download;
-			
-			segment_number++;
+			should_continue = 1;
 		}
 		
+		if (mc) {
+			break;
+		}
+		
+		if (still_running || should_continue || waiting || started < downloads->offset || pending_playlists > 0 || retrying > 0) {
+			continue;
+		}
+		
+		break;
 	}
 	
-	curl_poll(dl_queue, dl_total, &dl_done);
+	downloads_progress(downloads, &first_pending, started);
 	
-	erase_line();
+	// The files are about to be read; make sure everything has been written
+	if (writer_wait(writer) > 0) {
+		return UERR_FSTREAM_FAILURE;
+	}
 	
-	printf("+ Exportando lista de reprodução M3U8 para '%s'\r\n", playlist_filename);
-	 
-	struct FStream* const stream = fstream_open(playlist_filename, FSTREAM_WRITE);
+	return UERR_SUCCESS;
 	
-	if (stream == NULL) {
-		const struct SystemError error = get_system_error();
-		
-		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", playlist_filename, error.message);
+}
+
+static int m3u8_queue_download(struct M3U8Download* const context, const char* const uri, char* const filename) {
+	
+	curl_url_set(context->cu, CURLUPART_URL, context->url, 0);
+	curl_url_set(context->cu, CURLUPART_URL, uri, 0);
+	
+	char* url __curl_free__ = NULL;
+	curl_url_get(context->cu, CURLUPART_URL, &url, 0);
+	
+	CURL* const handle = curl_easy_new();
+	
+	if (handle == NULL) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar inicializar o cliente HTTP!\r\n");
 		return UERR_FAILURE;
 	}
-			
-	const int status = m3u8_dumpf(&playlist, stream);
 	
-	m3u8_free(&playlist);
+	curl_easy_setopt(handle, CURLOPT_REFERER, context->url);
+	curl_easy_setopt(handle, CURLOPT_URL, url);
 	
-	if (status != M3U8ERR_SUCCESS) {
-		const struct SystemError error = get_system_error();
+	return downloads_queue(context->downloads, handle, filename);
+	
+}
+
+static int m3u8_download_tag(struct M3U8Tag* const tag, void* const userdata) {
+	/*
+	Called by the M3U8 parser for each complete tag while the playlist is still being downloaded.
+	Keys and media segments are queued for download right away and their URIs are rewritten to
+	point to the local files.
+	*/
+	
+	struct M3U8Download* const context = (struct M3U8Download*) userdata;
+	
+	if (tag->type == EXT_X_KEY) {
+		struct M3U8Attribute* const attribute = m3u8tag_getattr(tag, "URI");
 		
-		fstream_close(stream);
+		if (attribute == NULL) {
+			return UERR_SUCCESS;
+		}
 		
-		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar exportar a lista de reprodução para '%s': %s\r\n", playlist_filename, error.message);
-		return UERR_FAILURE;
+		char* const filename = malloc(strlen(context->output) + strlen(DOT) + strlen(KEY_FILE_EXTENSION) + 1);
+		
+		if (filename == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		strcpy(filename, context->output);
+		strcat(filename, DOT);
+		strcat(filename, KEY_FILE_EXTENSION);
+		
+		const int code = m3u8_queue_download(context, attribute->value, filename);
+		
+		if (code != UERR_SUCCESS) {
+			free(filename);
+			return code;
+		}
+		
+		m3u8tag_setattr(tag, "URI", filename);
+		
+		if (tag->uri == NULL) {
+			return UERR_SUCCESS;
+		}
+	} else if (!(tag->type == EXTINF && tag->uri != NULL)) {
+		return UERR_SUCCESS;
 	}
 	
-	fstream_close(stream);
+	char value[intlen(context->segment_number) + 1];
+	snprintf(value, sizeof(value), "%i", context->segment_number);
+	
+	char* const filename = malloc(strlen(context->output) + strlen(DOT) + strlen(value) + strlen(DOT) + strlen(TS_FILE_EXTENSION) + 1);
+	
+	if (filename == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	strcpy(filename, context->output);
+	strcat(filename, DOT);
+	strcat(filename, value);
+	strcat(filename, DOT);
+	strcat(filename, TS_FILE_EXTENSION);
+	
+	const int code = m3u8_queue_download(context, tag->uri, filename);
+	
+	if (code != UERR_SUCCESS) {
+		free(filename);
+		return code;
+	}
+	
+	m3u8tag_set(tag, M3U8TAG_SET_URI, filename);
 	
-	printf("+ Concatenando seguimentos de mídia baixados para um único arquivo em '%s'\r\n", output);
+	context->segment_number++;
 	
-	const char* const input[] = {playlist_filename, NULL};
+	return UERR_SUCCESS;
+	
+}
+
+struct Rendition {
+	const char* url;
+	const char* output;
+};
+
+struct MediaMux {
+	char* destination;
+	char* partial; /* Where the destination is written to before being published; NULL to write it in place */
+	size_t count;
+	struct FFmpegInput* inputs;
+	buffer_t* contents;
+	char** filenames;
+	struct FFmpegOptions options;
+	struct Downloads downloads; /* Intermediate files, removed once the streams have been copied */
+	long long* size; /* Where the size of the output goes once it is written; NULL if it is not wanted */
+};
+
+static void media_mux_release_inputs(void* const data) {
+	/*
+	Removes the intermediate files and frees everything that only the copy of the streams needs.
+	*/
 	
-	const int code = ffmpeg_copy_streams(input, output);
+	struct MediaMux* const mux = (struct MediaMux*) data;
 	
-	for (size_t index = 0; index < dl_total; index++) {
-		struct Download* const download = &dl_queue[index];
+	for (size_t index = 0; index < mux->downloads.offset; index++) {
+		struct Download* const download = &mux->downloads.items[index];
 		
 		remove_file(download->filename);
 		free(download->filename);
 	}
 	
-	remove_file(playlist_filename);
+	free(mux->downloads.items);
 	
-	if (code != 0) {
-		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar concatenar os seguimentos de mídia de '%s' para um único arquivo em '%s': %s\r\n", playlist_filename, output, av_err2str(code));
-		return UERR_FAILURE;
+	mux->downloads.offset = 0;
+	mux->downloads.size = 0;
+	mux->downloads.items = NULL;
+	
+	for (size_t index = 0; index < mux->count; index++) {
+		if (mux->contents != NULL) {
+			buffer_free(&mux->contents[index]);
+		}
+		
+		if (mux->filenames != NULL) {
+			free(mux->filenames[index]);
+		}
 	}
 	
-	curl_easy_setopt(curl_easy, CURLOPT_REFERER, NULL);
-	curl_easy_setopt(curl_easy, CURLOPT_URL, NULL);
-	curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, NULL);
-	curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, NULL);
+	free(mux->inputs);
+	free(mux->contents);
+	free(mux->filenames);
 	
-	return UERR_SUCCESS;
+	mux->inputs = NULL;
+	mux->contents = NULL;
+	mux->filenames = NULL;
 	
 }
 
-#if defined(_WIN32) && defined(_UNICODE)
-	#define main wmain
-	int wmain(void);
-#endif
+static void media_mux_free(void* const data) {
+	
+	struct MediaMux* const mux = (struct MediaMux*) data;
+	
+	media_mux_release_inputs(mux);
+	
+	free(mux->destination);
+	free(mux->partial);
+	free(mux);
+	
+}
 
-int main(void) {
+static int media_mux_copy(const struct MediaMux* const mux) {
+	/*
+	Copies the streams of every rendition into the destination in a single pass.
+	*/
 	
-	#if defined(_WIN32)
-		_setmaxstdio(2048);
+	const char* const output = (mux->partial == NULL) ? mux->destination : mux->partial;
+	
+	if (mux->count > 1) {
+		printf("+ Copiando canais de vídeo e áudio para uma única mídia em '%s'\r\n", mux->destination);
+	} else {
+		printf("+ Concatenando seguimentos de mídia baixados para um único arquivo em '%s'\r\n", mux->destination);
+	}
+	
+	struct FFmpegStats stats = {0};
+	
+	const long long started = trace_clock();
+	const int code = ffmpeg_copy_inputs(mux->inputs, mux->count, output, &mux->options, &stats);
+	
+	trace_span("ffmpeg_copy_inputs", mux->destination, started);
+	
+	if (code != 0) {
+		remove_file(output);
 		
-		#if defined(_UNICODE)
-			_setmode(_fileno(stdout), _O_WTEXT);
-			_setmode(_fileno(stderr), _O_WTEXT);
-			_setmode(_fileno(stdin), _O_WTEXT);
-		#endif
-	#else
-		struct rlimit rlim = {0};
-		getrlimit(RLIMIT_NOFILE, &rlim);
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar copiar os canais de mídia para um único arquivo em '%s': %s\r\n", mux->destination, av_err2str(code));
+		return UERR_FAILURE;
+	}
+	
+	printf("+ Canais de mídia copiados para '%s' (abertura: %.2fs, cópia: %.2fs)\r\n", mux->destination, (double) stats.open / AV_TIME_BASE, (double) stats.copy / AV_TIME_BASE);
+	
+	if (mux->size != NULL) {
+		*mux->size = (long long) stats.size;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int media_mux_publish(const struct MediaMux* const mux) {
+	/*
+	Moves the output of the mux into place.
+	*/
+	
+	if (mux->partial != NULL) {
+		const long long started = trace_clock();
+		const int status = move_file(mux->partial, mux->destination);
 		
-		rlim.rlim_cur = rlim.rlim_max;
-		setrlimit(RLIMIT_NOFILE, &rlim);
-	#endif
+		trace_span("move_file", mux->destination, started);
+		
+		if (status == -1) {
+			const struct SystemError error = get_system_error();
+			
+			remove_file(mux->partial);
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover o arquivo de '%s' para '%s': %s\r\n", mux->partial, mux->destination, error.message);
+			return UERR_FAILURE;
+		}
+	}
 	
-	#ifndef __HAIKU__
-		if (is_administrator()) {
-			fprintf(stderr, "- Você não precisa e nem deve executar este programa com privilégios elevados!\r\n");
-			return EXIT_FAILURE;
+	printf("+ Mídia exportada para '%s'\r\n", mux->destination);
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int media_mux_run(void* const data) {
+	/*
+	Copies the streams of every rendition into the destination, then moves the output into place.
+	The intermediate files are removed as soon as the copy is done, rather than once the job is.
+	This runs on a worker thread of the mux pool.
+	*/
+	
+	struct MediaMux* const mux = (struct MediaMux*) data;
+	
+	const int code = media_mux_copy(mux);
+	
+	media_mux_release_inputs(mux);
+	
+	if (code != UERR_SUCCESS) {
+		return code;
+	}
+	
+	return media_mux_publish(mux);
+	
+}
+
+static int media_mux_prepare(
+	struct MediaMux* const mux,
+	const enum MediaType type,
+	struct M3U8Download* const contexts,
+	const struct Rendition* const renditions,
+	const size_t count,
+	const char* const destination,
+	const char* const partial,
+	long long* const size
+) {
+	/*
+	Gathers everything the mux needs into a job that owns all of it, so that it can run while
+	the downloads of the next media are already underway.
+	
+	The rewritten M3U8 playlists never touch the disk; they are rendered into memory and handed
+	straight to the HLS demuxer. Their would-be filenames are only used to resolve the segments.
+	*/
+	
+	mux->count = count;
+	mux->inputs = calloc(count, sizeof(*mux->inputs));
+	mux->contents = calloc(count, sizeof(*mux->contents));
+	mux->filenames = calloc(count, sizeof(*mux->filenames));
+	mux->destination = malloc(strlen(destination) + 1);
+	
+	if (mux->inputs == NULL || mux->contents == NULL || mux->filenames == NULL || mux->destination == NULL) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	strcpy(mux->destination, destination);
+	
+	mux->size = size;
+	
+	if (partial != NULL) {
+		mux->partial = malloc(strlen(partial) + 1);
+		
+		if (mux->partial == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		strcpy(mux->partial, partial);
+	}
+	
+	mux->options.mode = FFMPEG_COPY_MERGE;
+	mux->options.buffer_size = get_env_size("ARA_MUX_BUFFER_SIZE", 0);
+	mux->options.faststart = get_env_size("ARA_MUX_FASTSTART", 0) != 0;
+	
+	for (size_t index = 0; index < count; index++) {
+		const char* const output = renditions[index].output;
+		
+		const size_t size = strlen(output) + (type == MEDIA_M3U8 ? strlen(DOT) + strlen(M3U8_FILE_EXTENSION) : 0) + 1;
+		char* const filename = malloc(size);
+		
+		if (filename == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		strcpy(filename, output);
+		
+		mux->filenames[index] = filename;
+		
+		struct FFmpegInput* const input = &mux->inputs[index];
+		
+		input->filename = filename;
+		
+		/*
+		The segments of a playlist are MPEG-TS files whose codec parameters show up within their first
+		packets, and single files are usually MP4 files, which carry them in their header; neither needs
+		to be probed at length.
+		*/
+		input->fast_open = 1;
+		
+		if (type == MEDIA_SINGLE) {
+			continue;
+		}
+		
+		strcat(filename, DOT);
+		strcat(filename, M3U8_FILE_EXTENSION);
+		
+		buffer_t* const contents = &mux->contents[index];
+		
+		const int status = m3u8_dumps(&contexts[index].playlist, contents);
+		
+		if (status != M3U8ERR_SUCCESS) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar exportar a lista de reprodução para '%s': %s\r\n", filename, strm3u8err(status));
+			return UERR_FAILURE;
+		}
+		
+		input->format = "hls";
+		input->buffer = contents->s;
+		input->size = contents->slength;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int media_download(
+	const enum MediaType type,
+	const struct Rendition* const renditions,
+	const size_t count,
+	const char* const destination,
+	const char* const partial,
+	struct ThreadPool* const muxers,
+	struct Writer* const writer,
+	struct Progress* const progress,
+	char* const digest,
+	long long* const size
+) {
+	/*
+	Downloads every rendition of a media (e.g., its audio and video streams) at the same time
+	and queues the copy of their streams into the destination to the mux pool. All of their transfers
+	share the global multi handle, so renditions served by the same host reuse its connections, and
+	their progress is reported as a whole.
+	
+	The output of each rendition is where its file (or the segments of its playlist) is downloaded
+	to; a lone single file is downloaded straight to the destination instead.
+	
+	If a partial filename is given, the destination is written there and only renamed to the
+	destination once complete; otherwise it is written in place.
+	
+	If a buffer (of SHA256_HEX_SIZE characters) is given, the digest (in hex) of a lone single file
+	is put into it, as it is hashed while being written. The output of a mux is written by
+	libavformat, which seeks back and rewrites parts of it, and is left without one; its size is put
+	into size instead, once the mux pool is done with it. Otherwise, size is set to (-1).
+	*/
+	
+	CURLM* const curl_multi = get_global_curl_multi();
+	
+	struct Downloads downloads = {
+		.progress = progress
+	};
+	size_t dl_done = 0;
+	
+	/*
+	Downloads of single files are queued first; everything past them are the segments of
+	M3U8 playlists. All of them are removed in the end, except for a lone single file, which
+	is the destination itself.
+	*/
+	size_t singles = 0;
+	
+	struct M3U8Download contexts[count];
+	memset(contexts, 0, sizeof(contexts));
+	
+	struct SHA256 sha256 = {0};
+	sha256_init(&sha256);
+	
+	if (digest != NULL) {
+		*digest = '\0';
+	}
+	
+	if (size != NULL) {
+		*size = -1;
+	}
+	
+	int result = UERR_SUCCESS;
+	
+	for (size_t index = 0; index < count; index++) {
+		const struct Rendition* const rendition = &renditions[index];
+		
+		CURL* const handle = curl_easy_new();
+		
+		if (handle == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar inicializar o cliente HTTP!\r\n");
+			result = UERR_FAILURE;
+			break;
+		}
+		
+		curl_easy_setopt(handle, CURLOPT_URL, rendition->url);
+		
+		if (type == MEDIA_SINGLE) {
+			const char* const output = (count == 1) ? (partial == NULL ? destination : partial) : rendition->output;
+			
+			printf("+ Baixando arquivo de mídia de '%s' para '%s'\r\n", rendition->url, output);
+			
+			curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+			
+			char* const filename = malloc(strlen(output) + 1);
+			
+			if (filename == NULL) {
+				curl_easy_cleanup(handle);
+				
+				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+				result = UERR_MEMORY_ALLOCATE_FAILURE;
+				break;
+			}
+			
+			strcpy(filename, output);
+			
+			result = downloads_queue(&downloads, handle, filename);
+			
+			if (result != UERR_SUCCESS) {
+				free(filename);
+				
+				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+				break;
+			}
+			
+			if (count == 1 && digest != NULL) {
+				downloads.items[downloads.offset - 1].digest = &sha256;
+			}
+			
+			singles++;
+			
+			continue;
+		}
+		
+		printf("+ Baixando seguimentos de mídia de '%s' para '%s'\r\n", rendition->url, rendition->output);
+		
+		struct M3U8Download* const context = &contexts[index];
+		
+		context->url = rendition->url;
+		context->output = rendition->output;
+		context->segment_number = 1;
+		context->downloads = &downloads;
+		context->cu = curl_url();
+		
+		if (context->cu == NULL || m3u8parser_init(&context->parser, &context->playlist, m3u8_download_tag, context) != M3U8ERR_SUCCESS) {
+			curl_easy_cleanup(handle);
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+			result = UERR_MEMORY_ALLOCATE_FAILURE;
+			break;
+		}
+		
+		/*
+		The playlist goes through the multi handle too and is parsed as it arrives, so that the first
+		segments start downloading while the rest of a long playlist is still on its way.
+		*/
+		curl_easy_setopt(handle, CURLOPT_REFERER, rendition->url);
+		curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_m3u8_cb);
+		curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*) &context->parser);
+		
+		// Handed to the multi handle by curl_poll(), once it holds a transfer slot
+		context->handle = handle;
+	}
+	
+	if (result == UERR_SUCCESS) {
+		const long long started = trace_clock();
+		
+		result = curl_poll(&downloads, &dl_done, writer, contexts, type == MEDIA_M3U8 ? count : 0);
+		
+		trace_span("media_download", destination, started);
+		
+		erase_line();
+		
+		if (result == UERR_M3U8_PARSE_FAILURE) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		}
+	}
+	
+	if (result == UERR_SUCCESS && type == MEDIA_SINGLE && count == 1 && partial != NULL) {
+		const long long started = trace_clock();
+		const int status = move_file(partial, destination);
+		
+		trace_span("move_file", destination, started);
+		
+		if (status == -1) {
+			const struct SystemError error = get_system_error();
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover o arquivo de '%s' para '%s': %s\r\n", partial, destination, error.message);
+			result = UERR_FAILURE;
+		}
+	}
+	
+	// A lone single file was already downloaded to the destination; there is nothing to copy
+	if (result == UERR_SUCCESS && !(type == MEDIA_SINGLE && count == 1)) {
+		struct MediaMux* const mux = calloc(1, sizeof(*mux));
+		
+		if (mux == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			result = UERR_MEMORY_ALLOCATE_FAILURE;
+		} else {
+			// The downloaded files now belong to the job, which removes them once it is done
+			mux->downloads = downloads;
+			
+			downloads.offset = 0;
+			downloads.size = 0;
+			downloads.items = NULL;
+			
+			result = media_mux_prepare(mux, type, contexts, renditions, count, destination, partial, size);
+			
+			if (result != UERR_SUCCESS) {
+				media_mux_free(mux);
+			} else if (threadpool_submit(muxers, media_mux_run, media_mux_free, mux) != 0) {
+				result = UERR_FAILURE;
+			}
+		}
+	}
+	
+	for (size_t index = 0; index < count; index++) {
+		struct M3U8Download* const context = &contexts[index];
+		
+		if (context->handle != NULL) {
+			curl_multi_remove_handle(curl_multi, context->handle);
+			curl_easy_cleanup(context->handle);
+		}
+		
+		if (context->cu != NULL) {
+			curl_url_cleanup(context->cu);
+			m3u8parser_free(&context->parser);
+			m3u8_free(&context->playlist);
+		}
+	}
+	
+	for (size_t index = 0; index < downloads.offset; index++) {
+		struct Download* const download = &downloads.items[index];
+		
+		if (download->handle != NULL) {
+			curl_multi_remove_handle(curl_multi, download->handle);
+			curl_easy_cleanup(download->handle);
+		}
+		
+		if (download->file != NULL) {
+			writer_close(download->file);
+		}
+	}
+	
+	// Files cannot be removed while they are still being written to
+	writer_wait(writer);
+	
+	if (result == UERR_SUCCESS && type == MEDIA_SINGLE && count == 1 && digest != NULL) {
+		unsigned char output[SHA256_DIGEST_SIZE];
+		sha256_final(&sha256, output);
+		
+		sha256_hex(output, digest);
+	}
+	
+	for (size_t index = 0; index < downloads.offset; index++) {
+		struct Download* const download = &downloads.items[index];
+		
+		if (index >= singles || count > 1 || result != UERR_SUCCESS) {
+			remove_file(download->filename);
+		}
+		
+		free(download->filename);
+	}
+	
+	free(downloads.items);
+	
+	return result;
+	
+}
+
+static void writer_wakeup(void* const data) {
+	
+	curl_multi_wakeup((CURLM*) data);
+	
+}
+
+static const char* get_validator(CURL* const handle) {
+	/*
+	Returns the ETag (or failing that, the Last-Modified date) the server sent along with the last
+	transfer, or a null pointer if it sent neither.
+	*/
+	
+	#if LIBCURL_VERSION_NUM >= 0x075300
+		struct curl_header* header = NULL;
+		
+		if (curl_easy_header(handle, "ETag", 0, CURLH_HEADER, -1, &header) == CURLHE_OK) {
+			return header->value;
+		}
+		
+		if (curl_easy_header(handle, "Last-Modified", 0, CURLH_HEADER, -1, &header) == CURLHE_OK) {
+			return header->value;
 		}
 	#endif
 	
-	av_log_set_level(AV_LOG_ERROR);
+	return NULL;
+	
+}
+
+static int state_save(
+	struct StateDB* const state,
+	const enum StateKind kind,
+	const char* const id,
+	const char* const path,
+	const char* const url,
+	const char* const digest,
+	const long long size,
+	CURL* const handle
+) {
+	/*
+	Records an item as complete, along with the digest and size of its contents if known (size is
+	(-1) otherwise). If the handle that downloaded the item is given, the validator of the transfer
+	is recorded too, and so is its size if none was given.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (state == NULL || id == NULL) {
+		return 0;
+	}
+	
+	curl_off_t transferred = -1;
+	
+	if (handle != NULL) {
+		curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &transferred);
+	}
+	
+	const struct StateRecord record = {
+		.kind = kind,
+		.id = (char*) id,
+		.path = (char*) path,
+		.url = (char*) url,
+		.size = (size == -1) ? (long long) transferred : size,
+		.validator = (handle == NULL) ? NULL : (char*) get_validator(handle),
+		.digest = (char*) digest
+	};
+	
+	return statedb_put(state, &record);
+	
+}
+
+static int attachments_download(
+	struct Attachments* const attachments,
+	const char* const directory,
+	const char* const partial_directory,
+	const int kof,
+	struct FSIndex* const fsindex,
+	struct Writer* const writer,
+	struct Progress* const progress,
+	struct StateDB* const state,
+	const char* const state_file
+) {
+	/*
+	Downloads the attachments that are not in the directory yet. Their transfers share the global
+	multi handle, up to ARA_ATTACHMENT_TRANSFERS of them at a time, so that a module with dozens
+	of small files is not spent waiting on one round trip after another.
+	
+	Each attachment is written to the partial directory (hashed as it is written) and only
+	renamed into its place within the directory once every transfer is done.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const size_t count = attachments->offset;
+	
+	if (count < 1) {
+		return 0;
+	}
+	
+	CURLM* const curl_multi = get_global_curl_multi();
+	
+	struct Downloads downloads = {
+		.limit = get_env_size("ARA_ATTACHMENT_TRANSFERS", ATTACHMENT_DEFAULT_TRANSFERS),
+		.progress = progress
+	};
+	
+	struct Attachment* queued[count];
+	struct SHA256 digests[count];
+	
+	int result = UERR_SUCCESS;
+	
+	for (size_t index = 0; index < count; index++) {
+		struct Attachment* const attachment = &attachments->items[index];
+		
+		attachment->path = malloc(strlen(directory) + strlen(PATH_SEPARATOR) + (kof ? strlen(attachment->filename) : strlen(attachment->short_filename)) + 1);
+		
+		if (attachment->path == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			result = UERR_MEMORY_ALLOCATE_FAILURE;
+			break;
+		}
+		
+		strcpy(attachment->path, directory);
+		strcat(attachment->path, PATH_SEPARATOR);
+		strcat(attachment->path, kof ? attachment->filename : attachment->short_filename);
+		
+		if (fsindex_file_exists(fsindex, attachment->path) == 1) {
+			fprintf(stderr, "- O arquivo '%s' já foi previamente baixado, ele não sofrerá alterações\r\n", attachment->path);
+			continue;
+		}
+		
+		// Attachments are downloaded side by side; the position keeps files with the same name apart
+		char position[intlen((int) index) + 1];
+		snprintf(position, sizeof(position), "%zu", index);
+		
+		char* const location = malloc(strlen(partial_directory) + strlen(PATH_SEPARATOR) + strlen(position) + strlen(DOT) + strlen(attachment->short_filename) + 1);
+		
+		if (location == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			result = UERR_MEMORY_ALLOCATE_FAILURE;
+			break;
+		}
+		
+		strcpy(location, partial_directory);
+		strcat(location, PATH_SEPARATOR);
+		strcat(location, position);
+		strcat(location, DOT);
+		strcat(location, attachment->short_filename);
+		
+		fprintf(stderr, "- O arquivo '%s' não existe, ele será baixado\r\n", attachment->path);
+		printf("+ Baixando de '%s' para '%s'\r\n", attachment->url, location);
+		
+		CURL* const handle = curl_easy_new();
+		
+		if (handle == NULL) {
+			free(location);
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar inicializar o cliente HTTP!\r\n");
+			result = UERR_FAILURE;
+			break;
+		}
+		
+		curl_easy_setopt(handle, CURLOPT_URL, attachment->url);
+		curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+		
+		result = downloads_queue(&downloads, handle, location);
+		
+		if (result != UERR_SUCCESS) {
+			free(location);
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			break;
+		}
+		
+		const size_t offset = downloads.offset - 1;
+		struct Download* const download = &downloads.items[offset];
+		
+		sha256_init(&digests[offset]);
+		
+		// The handle is kept so that the validator of the response can be recorded along with the file
+		download->digest = &digests[offset];
+		download->keep = 1;
+		
+		queued[offset] = attachment;
+	}
+	
+	if (result == UERR_SUCCESS && downloads.offset > 0) {
+		size_t done = 0;
+		
+		result = curl_poll(&downloads, &done, writer, NULL, 0);
+		
+		erase_line();
+	}
+	
+	for (size_t index = 0; index < downloads.offset; index++) {
+		struct Download* const download = &downloads.items[index];
+		
+		if (download->handle != NULL) {
+			curl_multi_remove_handle(curl_multi, download->handle);
+			curl_easy_cleanup(download->handle);
+		}
+		
+		if (download->file != NULL) {
+			writer_close(download->file);
+		}
+	}
+	
+	// Files cannot be moved (nor removed) while they are still being written to
+	writer_wait(writer);
+	
+	/*
+	Transfers either all finish or are all given up on; once they have finished, every attachment
+	is published on its own, so that one that cannot be moved into place does not take the ones
+	after it down with it.
+	*/
+	const int transferred = result;
+	
+	for (size_t index = 0; index < downloads.offset; index++) {
+		struct Download* const download = &downloads.items[index];
+		const struct Attachment* const attachment = queued[index];
+		
+		int published = 0;
+		
+		if (transferred == UERR_SUCCESS) {
+			unsigned char digest[SHA256_DIGEST_SIZE];
+			sha256_final(&digests[index], digest);
+			
+			char attachment_digest[SHA256_HEX_SIZE];
+			sha256_hex(digest, attachment_digest);
+			
+			printf("+ Movendo arquivo de '%s' para '%s'\r\n", download->filename, attachment->path);
+			
+			const long long started = trace_clock();
+			const int status = move_file(download->filename, attachment->path);
+			
+			trace_span("move_file", attachment->path, started);
+			
+			if (status == -1) {
+				const struct SystemError error = get_system_error();
+				
+				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover o arquivo de '%s' para '%s': %s\r\n", download->filename, attachment->path, error.message);
+				result = UERR_FAILURE;
+			} else {
+				published = 1;
+				
+				curl_off_t size = -1;
+				curl_easy_getinfo(download->finished, CURLINFO_SIZE_DOWNLOAD_T, &size);
+				
+				if (fsindex_add_file(fsindex, attachment->path, (long long) size, (long long) time(NULL)) == -1) {
+					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+					result = UERR_MEMORY_ALLOCATE_FAILURE;
+				} else if (state_save(state, STATE_FILE, attachment->id, attachment->path, attachment->url, attachment_digest, -1, download->finished) == -1) {
+					const struct SystemError error = get_system_error();
+					
+					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o estado dos downloads em '%s': %s\r\n", state_file, error.message);
+					result = UERR_FAILURE;
+				}
+			}
+		}
+		
+		if (!published) {
+			remove_file(download->filename);
+		}
+		
+		curl_easy_cleanup(download->finished);
+		free(download->filename);
+	}
+	
+	free(downloads.items);
+	
+	return result == UERR_SUCCESS ? 0 : -1;
+	
+}
+
+struct Verification {
+	const char* path;
+	const char* digest; /* NULL if only the size is known */
+	long long size;
+	int mismatch;
+};
+
+static int verification_run(void* const data) {
+	
+	struct Verification* const verification = (struct Verification*) data;
+	
+	// Muxed medias are recorded along with their size only; a truncated one is caught all the same
+	if (verification->digest == NULL) {
+		long long size = 0;
+		
+		const int status = get_file_size(verification->path, &size);
+		
+		if (status == -1) {
+			const struct SystemError error = get_system_error();
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar ler o arquivo em '%s': %s\r\n", verification->path, error.message);
+			return -1;
+		}
+		
+		verification->mismatch = (status == 0 || size != verification->size);
+		
+		return 0;
+	}
+	
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	char hex[SHA256_HEX_SIZE];
+	
+	if (sha256_file(verification->path, digest) == -1) {
+		const struct SystemError error = get_system_error();
+		
+		// A file that was removed is as good as a corrupted one; any other error stops the verification
+		if (file_exists(verification->path) == 0) {
+			verification->mismatch = 1;
+			return 0;
+		}
+		
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar ler o arquivo em '%s': %s\r\n", verification->path, error.message);
+		return -1;
+	}
+	
+	sha256_hex(digest, hex);
+	
+	verification->mismatch = (strcmp(hex, verification->digest) != 0);
+	
+	return 0;
+	
+}
+
+static int state_verify(struct StateDB* const state, const size_t workers) {
+	/*
+	Hashes every file recorded along with a digest (on a pool of workers) and compares the result
+	with the record; files recorded along with their size only are compared by size. Files that no longer match (or no longer exist) are removed, and neither they
+	nor the pages they belong to are considered complete anymore, so that they get downloaded
+	again. If any file cannot be read, nothing is removed.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	size_t count = 0;
+	
+	for (size_t position = 0; position < state->size; position++) {
+		const struct StateRecord* const record = &state->items[position];
+		
+		if (record->path != NULL && record->kind == STATE_FILE && *record->id != '\0' && (record->digest != NULL || record->size != -1)) {
+			count++;
+		}
+	}
+	
+	if (count == 0) {
+		return 0;
+	}
+	
+	printf("+ Verificando a integridade de %zu arquivos previamente baixados\r\n", count);
+	
+	struct Verification* const verifications = calloc(count, sizeof(*verifications));
+	
+	if (verifications == NULL) {
+		return -1;
+	}
+	
+	size_t index = 0;
+	
+	for (size_t position = 0; position < state->size; position++) {
+		const struct StateRecord* const record = &state->items[position];
+		
+		if (record->path != NULL && record->kind == STATE_FILE && *record->id != '\0' && (record->digest != NULL || record->size != -1)) {
+			verifications[index].path = record->path;
+			verifications[index].digest = record->digest;
+			verifications[index].size = record->size;
+			index++;
+		}
+	}
+	
+	struct ThreadPool pool = {0};
+	
+	if (threadpool_init(&pool, workers, workers * 2) != 0) {
+		free(verifications);
+		return -1;
+	}
+	
+	for (size_t index = 0; index < count; index++) {
+		if (threadpool_submit(&pool, verification_run, NULL, &verifications[index]) != 0) {
+			break;
+		}
+	}
+	
+	const size_t failures = threadpool_wait(&pool);
+	
+	threadpool_free(&pool);
+	
+	int status = (failures > 0) ? -1 : 0;
+	
+	for (size_t index = 0; status == 0 && index < count; index++) {
+		const struct Verification* const verification = &verifications[index];
+		
+		if (!verification->mismatch) {
+			continue;
+		}
+		
+		// The record (and its path along with it) is replaced below
+		char path[strlen(verification->path) + 1];
+		strcpy(path, verification->path);
+		
+		fprintf(stderr, "- O arquivo '%s' está corrompido ou incompleto, ele será baixado novamente\r\n", path);
+		
+		if (remove_file(path) == -1 || statedb_invalidate(state, STATE_FILE, path) == -1) {
+			status = -1;
+			break;
+		}
+		
+		// The files of a page are saved right within its directory
+		char* const separator = strrchr(path, *PATH_SEPARATOR);
+		
+		if (separator != NULL) {
+			*separator = '\0';
+			status = statedb_invalidate(state, STATE_PAGE, path);
+		}
+	}
+	
+	free(verifications);
+	
+	return status;
+	
+}
+
+static int login(const struct Job* const job, const struct ProviderMethods* const methods, struct Credentials* const credentials) {
+	/*
+	Logs in to the provider with the username and password given in the job, or asks the
+	user for them.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	char username[MAX_INPUT_SIZE] = {'\0'};
+	char password[MAX_INPUT_SIZE] = {'\0'};
+	
+	if (job->headless) {
+		if (job->username == NULL || job->password == NULL) {
+			fprintf(stderr, "- O usuário e a senha são obrigatórios para acessar uma nova conta!\r\n");
+			return -1;
+		}
+		
+		if (strlen(job->username) >= sizeof(username) || strlen(job->password) >= sizeof(password)) {
+			fprintf(stderr, "- O usuário ou a senha excedem o tamanho máximo permitido!\r\n");
+			return -1;
+		}
+		
+		strcpy(username, job->username);
+		strcpy(password, job->password);
+	} else {
+		input("> Insira seu usuário: ", username);
+		input("> Insira sua senha: ", password);
+	}
+	
+	const long long started = trace_clock();
+	const int code = (*methods->authorize)(username, password, credentials);
+	
+	trace_span("authorize", username, started);
+	
+	switch (code) {
+		case UERR_SUCCESS:
+			break;
+		case UERR_CURL_FAILURE:
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
+			return -1;
+		default:
+			fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
+			return -1;
+	}
+	
+	return 0;
+	
+}
+
+static int save_account(const char* const filename, json_t* const tree, const struct Credentials* const credentials) {
+	/*
+	Adds the account to the saved ones (taking the place of any saved account with the same
+	username) and writes them all to the file.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	size_t index = 0;
+	const json_t* item = NULL;
+	
+	json_array_foreach(tree, index, item) {
+		const json_t* const username = json_object_get(item, "username");
+		
+		if (json_is_string(username) && strcmp(json_string_value(username), credentials->username) == 0) {
+			json_array_remove(tree, index);
+			break;
+		}
+	}
+	
+	json_t* const obj = json_object();
+	
+	if (obj == NULL) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return -1;
+	}
+	
+	json_object_set_new(obj, "username", json_string(credentials->username));
+	json_object_set_new(obj, "access_token", credentials->access_token == NULL ? json_null() : json_string(credentials->access_token));
+	json_object_set_new(obj, "cookie_jar", credentials->cookie_jar == NULL ? json_null() : json_string(credentials->cookie_jar));
+	
+	json_array_append_new(tree, obj);
+	
+	struct FStream* const stream = fstream_open(filename, FSTREAM_WRITE);
+	
+	if (stream == NULL) {
+		const struct SystemError error = get_system_error();
+		
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", filename, error.message);
+		return -1;
+	}
+	
+	const int rcode = json_dump_callback(tree, json_dump_cb, (void*) stream, JSON_COMPACT);
+	
+	if (rcode != 0) {
+		const struct SystemError error = get_system_error();
+		
+		fstream_close(stream);
+		remove_file(filename);
+		
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar exportar o arquivo de credenciais para '%s': %s\r\n", filename, error.message);
+		return -1;
+	}
+	
+	fstream_close(stream);
+	
+	return 0;
+	
+}
+
+static int queue_resources(const char* const answer, const struct Resources* const resources, struct Resource* const queue, size_t* const count) {
+	/*
+	Fills the queue with the resources picked by the answer: a comma-separated list of positions
+	and ranges of positions (e.g. "1,3-5"), or "*" for all of them.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	*count = 0;
+	
+	if (strcmp(answer, "*") == 0) {
+		for (size_t index = 0; index < resources->offset; index++) {
+			queue[(*count)++] = resources->items[index];
+		}
+		
+		return 0;
+	}
+	
+	const char* start = answer;
+	
+	for (size_t index = 0; index < strlen(answer) + 1; index++) {
+		const char* const ch = &answer[index];
+		
+		if (!(*ch == *COMMA || (*ch == '\0' && index > 0))) {
+			continue;
+		}
+		
+		const size_t size = (size_t) (ch - start);
+		
+		if (size < 1) {
+			fprintf(stderr, "- Não podem haver valores vazios dentre as escolhas!\r\n");
+			return -1;
+		}
+		
+		char value[size + 1];
+		memcpy(value, start, size);
+		value[size] = '\0';
+		
+		const char* hyphen = strstr(value, HYPHEN);
+		
+		if (hyphen == NULL) {
+			 if (!isnumeric(value)) {
+				fprintf(stderr, "- O valor inserido é inválido ou não reconhecido!\r\n");
+				return -1;
+			}
+			
+			const size_t position = (size_t) atoi(value);
+			
+			if (position < 1) {
+				fprintf(stderr, "- O valor mínimo de uma escolha deve ser >=1!\r\n");
+				return -1;
+			}
+			
+			if (position > resources->offset) {
+				fprintf(stderr, "- O valor máximo de uma escolha deve ser <=%zu!\r\n", resources->offset);
+				return -1;
+			}
+			
+			struct Resource resource = resources->items[position - 1];
+			
+			for (size_t index = 0; index < *count; index++) {
+				const struct Resource subresource = queue[index];
+				
+				if (subresource.id == resource.id) {
+					fprintf(stderr, "- Não podem haver conteúdos duplicados dentre as escolhas!\r\n");
+					return -1;
+				}
+			}
+			
+			queue[(*count)++] = resource;
+		} else {
+			size_t size = (size_t) (hyphen - value);
+			
+			if (size < 1) {
+				fprintf(stderr, "- O valor mínimo é obrigatório para intervalos de seleção!\r\n");
+				return -1;
+			}
+			
+			char mins[size + 1];
+			memcpy(mins, value, size);
+			mins[size] = '\0';
+			
+			const size_t min = (size_t) atoi(mins);
+			
+			if (min < 1) {
+				fprintf(stderr, "- O valor mínimo para este intervalo deve ser >=1!\r\n");
+				return -1;
+			}
+			
+			const char* const end = value + (sizeof(value) - 1);
+			hyphen++;
+			
+			size = (size_t) (end - hyphen);
+			
+			if (size < 1) {
+				fprintf(stderr, "- O valor máximo é obrigatório para intervalos de seleção!\r\n");
+				return -1;
+			}
+			
+			char maxs[size + 1];
+			memcpy(maxs, hyphen, size);
+			maxs[size] = '\0';
+			
+			const size_t max = (size_t) atoi(maxs);
+			
+			if (max > resources->offset) {
+				fprintf(stderr, "- O valor máximo para este intervalo deve ser <=%zu!\r\n", resources->offset);
+				return -1;
+			}
+			
+			for (size_t index = min; index < (max + 1); index++) {
+				const struct Resource resource = resources->items[index - 1];
+				
+				for (size_t index = 0; index < *count; index++) {
+					const struct Resource subresource = queue[index];
+					
+					if (subresource.id == resource.id) {
+						fprintf(stderr, "- Não podem haver conteúdos duplicados dentre as escolhas!\r\n");
+						return -1;
+					}
+				}
+				
+				queue[(*count)++] = resource;
+			}
+		}
+		
+		start = (ch + 1);
+	}
+	
+	return 0;
+	
+}
+
+static int prompt_selection(const struct Resources* const resources, struct Resource* const queue, size_t* const count, int* const kof) {
+	/*
+	Asks the user which resources to download and whether to keep the original names of
+	files and directories.
+	
+	Returns (0) on success, (-1) if the user gave up.
+	*/
+	
+	size_t start = 0;
+	size_t end = PAGINATION_MAX_ITEMS;
+	
+	char answer[MAX_INPUT_SIZE] = {'\0'};
+	
+	struct CIR cir __attribute__((__cleanup__(cir_free))) = {0};
+	cir_init(&cir);
+	
+	while (1) {
+		erase_screen();
+		
+		printf("+ Selecione o que deseja baixar:\r\n\r\n");
+		
+		if (end > resources->offset) {
+			end = resources->offset;
+		}
+		
+		for (size_t index = start; index < end; index++) {
+			const struct Resource* const resource = &resources->items[index];
+			printf("%zu. \r\nNome: %s\r\nQualificação: %s\r\nURL: %s\r\n\r\n", index + 1, resource->name, resource->qualification.name == NULL ? "N/A" : resource->qualification.name, resource->url);
+		}
+		
+		printf("> Digite sua escolha: %s", answer);
+		fflush(stdout);
+		
+		int enter_pressed = 0;
+		
+		while (1) {
+			const struct CIKey* const key = cir_get(&cir);
+			
+			int break_parent = 0;
+			
+			switch (key->type) {
+				case KEY_PAGE_UP:
+				case KEY_ARROW_LEFT:
+				case KEY_ARROW_UP:
+				case KEY_HOME: {
+					if (PAGINATION_MAX_ITEMS > start) {
+						break;
+					}
+					
+					end = start;
+					start -= PAGINATION_MAX_ITEMS;
+					
+					break_parent = 1;
+					
+					break;
+				}
+				case KEY_PAGE_DOWN:
+				case KEY_ARROW_RIGHT:
+				case KEY_ARROW_DOWN:
+				case KEY_END: {
+					if (end == resources->offset) {
+						break;
+					}
+					
+					start = end;
+					end += ((end + PAGINATION_MAX_ITEMS) < resources->offset) ? PAGINATION_MAX_ITEMS : resources->offset - end;
+					
+					break_parent = 1;
+					
+					break;
+				case KEY_DELETE:
+					if (strlen(answer) < 1) {
+						break;
+					}
+					
+					printf("\b \b");
+					fflush(stdout);
+					
+					*(strchr(answer, '\0') - 1) = '\0';
+					
+					break;
+				}
+				case KEY_ZERO:
+				case KEY_ONE:
+				case KEY_TWO:
+				case KEY_THREE:
+				case KEY_FOUR:
+				case KEY_FIVE:
+				case KEY_SIX:
+				case KEY_SEVEN:
+				case KEY_EIGHTH:
+				case KEY_NINE:
+				case KEY_HYPHEN:
+				case KEY_COMMA: {
+					strcat(answer, cir.tmp);
+					printf("%s", cir.tmp);
+					fflush(stdout);
+					break;
+				}
+				case KEY_ENTER: {
+					break_parent = 1;
+					enter_pressed = 1;
+					break;
+				}
+				case KEY_CTRL_BACKSLASH:
+				case KEY_CTRL_C:
+				case KEY_CTRL_D:
+					printf("\r\n");
+					return -1;
+				default:
+					break;
+			}
+			
+			if (break_parent) {
+				break;
+			}
+		}
+		
+		printf("\r\n");
+		
+		if (enter_pressed) {
+			break;
+		}
+	}
+	
+	while (queue_resources(answer, resources, queue, count) == -1) {
+		input("> Digite sua escolha: ", answer);
+	}
+	
+	if (*count > 1) {
+		printf("- %zu conteúdos foram enfileirados para serem baixados\r\n", *count);
+	}
+	
+	*kof = 0;
+	
+	printf("> Manter o nome original de arquivos e diretórios? (S/n) ");
+	fflush(stdout);
+	
+	while (1) {
+		const struct CIKey* const key = cir_get(&cir);
+		
+		switch (key->type) {
+			case KEY_SHIFT_S:
+			case KEY_S:
+			case KEY_SHIFT_Y:
+			case KEY_Y: {
+				printf("%s", cir.tmp);
+				fflush(stdout);
+				*kof = 1;
+				break;
+			}
+			case KEY_ENTER: {
+				printf("s");
+				fflush(stdout);
+				*kof = 1;
+				break;
+			}
+			case KEY_SHIFT_N:
+			case KEY_N: {
+				printf("%s", cir.tmp);
+				fflush(stdout);
+				*kof = 0;
+				break;
+			}
+			case KEY_CTRL_BACKSLASH:
+			case KEY_CTRL_C:
+			case KEY_CTRL_D:
+				printf("\r\n");
+				fflush(stdout);
+				return -1;
+			default:
+				continue;
+		}
+		
+		break;
+	}
+	
+	printf("\r\n");
+	
+	return 0;
+	
+}
+
+#if defined(_WIN32) && defined(_UNICODE)
+	#define main wmain
+	int wmain(int argc, wchar_t* argv[]);
+#endif
+
+static size_t find_provider(const char* const name) {
+	/*
+	Looks up a provider by its label or configuration directory.
+	
+	Returns its position in PROVIDERS plus one, or (0) if there is no such provider.
+	*/
+	
+	for (size_t index = 0; index < PROVIDERS_NUM; index++) {
+		const struct Provider provider = PROVIDERS[index];
+		
+		if (strcmp(name, provider.label) == 0 || strcmp(name, provider.directory) == 0) {
+			return index + 1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+struct DownloadQueue {
+	struct Resource* items;
+	size_t count;
+};
+
+static void download_queue_free(struct DownloadQueue* const queue) {
+	/*
+	Queued resources are copies of the ones listed by the provider and share their strings;
+	only what is filled in after they are queued belongs to them.
+	*/
+	
+	for (size_t index = 0; index < queue->count; index++) {
+		struct Resource* const resource = &queue->items[index];
+		
+		modules_free(&resource->modules);
+		
+		free(resource->path);
+		resource->path = NULL;
+	}
+	
+	queue->count = 0;
+	
+}
+
+static json_t* previous_page(json_t* const tree, const char* const id) {
+	/*
+	Looks up a page by its ID in the object tree exported by a previous run.
+	
+	Returns a borrowed reference to it, or a null pointer if there is no such page.
+	*/
+	
+	json_t* const jmodules = json_object_get(json_object_get(tree, "modules"), "items");
+	
+	size_t index = 0;
+	json_t* jmodule = NULL;
+	
+	json_array_foreach(jmodules, index, jmodule) {
+		json_t* const jpages = json_object_get(json_object_get(jmodule, "pages"), "items");
+		
+		size_t position = 0;
+		json_t* jpage = NULL;
+		
+		json_array_foreach(jpages, position, jpage) {
+			const char* const value = json_string_value(json_object_get(jpage, "id"));
+			
+			if (value != NULL && strcmp(value, id) == 0) {
+				return jpage;
+			}
+		}
+	}
 	
-	printf("+ Selecione o seu provedor de serviços:\r\n\r\n");
+	return NULL;
 	
-	for (size_t index = 0; index < PROVIDERS_NUM; index++) {
-		const struct Provider provider = PROVIDERS[index];
-		printf("%zu. \r\nNome: %s\r\nURL: %s\r\n\r\n", index + 1, provider.label, provider.url);
+}
+
+static int run_job(const struct Job* const job, const int shared) {
+	/*
+	Runs a job from start to finish: picks the provider and the account, lists and selects the
+	resources and downloads them. Whatever is not given in the job is asked interactively,
+	unless it is a headless one. Jobs run by the daemon are shared: they run alongside others
+	in the same process, so they leave the standard input alone and keep their temporary
+	files apart.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	size_t value = 0;
+	
+	if (job->headless) {
+		if (job->provider == NULL) {
+			fprintf(stderr, "- Nenhum provedor de serviços foi especificado!\r\n");
+			return -1;
+		}
+		
+		value = find_provider(job->provider);
+		
+		if (value == 0) {
+			fprintf(stderr, "- O provedor de serviços '%s' não existe ou não é suportado!\r\n", job->provider);
+			return -1;
+		}
+	} else {
+		printf("+ Selecione o seu provedor de serviços:\r\n\r\n");
+		
+		for (size_t index = 0; index < PROVIDERS_NUM; index++) {
+			const struct Provider provider = PROVIDERS[index];
+			printf("%zu. \r\nNome: %s\r\nURL: %s\r\n\r\n", index + 1, provider.label, provider.url);
+		}
+		
+		value = (size_t) input_integer(1, (int) PROVIDERS_NUM);
 	}
 	
-	int value = input_integer(1, (int) PROVIDERS_NUM);
-	
 	const struct Provider provider = PROVIDERS[value - 1];
 	const struct ProviderMethods methods = provider.methods;
 	
@@ -427,7 +2105,7 @@ int main(void) {
 		const struct SystemError error = get_system_error();
 		
 		fprintf(stderr, "- Não foi possível obter um diretório de configurações válido: %s\r\n", error.message);
-		return EXIT_FAILURE;
+		return -1;
 	}
 	
 	char configuration_directory[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(PROGRAM_NAME) + strlen(PATH_SEPARATOR) + strlen(provider.label) + 1];
@@ -447,7 +2125,7 @@ int main(void) {
 				const struct SystemError error = get_system_error();
 				
 				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o diretório em '%s': %s\r\n", configuration_directory, error.message);
-				return EXIT_FAILURE;
+				return -1;
 			}
 			
 			break;
@@ -456,7 +2134,7 @@ int main(void) {
 			const struct SystemError error = get_system_error();
 			
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o diretório em '%s': %s\r\n", configuration_directory, error.message);
-			return EXIT_FAILURE;
+			return -1;
 		}
 	}
 	
@@ -466,14 +2144,20 @@ int main(void) {
 		const struct SystemError error = get_system_error();
 		
 		fprintf(stderr, "- Não foi possível obter um diretório temporário válido: %s\r\n", error.message);
-		return EXIT_FAILURE;
+		return -1;
 	}
 	
-	char temporary_directory[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(PROGRAM_NAME) + 1];
+	char temporary_directory[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(PROGRAM_NAME) + (shared ? strlen(PATH_SEPARATOR) + strlen(provider.directory) : 0) + 1];
 	strcpy(temporary_directory, directory);
 	strcat(temporary_directory, PATH_SEPARATOR);
 	strcat(temporary_directory, PROGRAM_NAME);
 	
+	// Jobs running side by side get a directory of their own, so that one does not clean up after another
+	if (shared) {
+		strcat(temporary_directory, PATH_SEPARATOR);
+		strcat(temporary_directory, provider.directory);
+	}
+	
 	free(directory);
 	
 	switch (directory_exists(temporary_directory)) {
@@ -484,7 +2168,7 @@ int main(void) {
 				const struct SystemError error = get_system_error();
 				
 				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o diretório em '%s': %s\r\n", temporary_directory, error.message);
-				return EXIT_FAILURE;
+				return -1;
 			}
 			
 			break;
@@ -498,7 +2182,7 @@ int main(void) {
 						const struct SystemError error = get_system_error();
 						
 						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar remover os resquícios de arquivos temporários em '%s': %s\r\n", temporary_directory, error.message);
-						return EXIT_FAILURE;
+						return -1;
 					}
 					
 					break;
@@ -507,7 +2191,7 @@ int main(void) {
 					const struct SystemError error = get_system_error();
 					
 					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o diretório em '%s': %s\r\n", temporary_directory, error.message);
-					return EXIT_FAILURE;
+					return -1;
 				}
 			}
 			
@@ -517,7 +2201,7 @@ int main(void) {
 			const struct SystemError error = get_system_error();
 			
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o diretório em '%s': %s\r\n", temporary_directory, error.message);
-			return EXIT_FAILURE;
+			return -1;
 		}
 	}
 	
@@ -529,16 +2213,16 @@ int main(void) {
 	CURL* curl_easy = get_global_curl_easy();
 	
 	if (curl_easy == NULL) {
-		return EXIT_FAILURE;
+		return -1;
 	}
 	
 	CURLM* curl_multi = get_global_curl_multi();
 	
 	if (curl_multi == NULL) {
-		return EXIT_FAILURE;
+		return -1;
 	}
 	
-	struct Credentials credentials = {
+	struct Credentials credentials __attribute__((__cleanup__(credentials_free))) = {
 		.directory = configuration_directory
 	};
 	
@@ -549,23 +2233,26 @@ int main(void) {
 			const struct SystemError error = get_system_error();
 			
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar abrir o arquivo em '%s': %s\r\n", accounts_file, error.message);
-			return EXIT_FAILURE;
+			return -1;
 		}
 		
-		json_auto_t* tree = json_load_callback(json_load_cb, (void*) stream, 0, NULL);
+		size_t size = 0;
+		const char* const data = fstream_map(stream, &size);
+		
+		json_auto_t* tree = (data == NULL) ? NULL : json_loadb(data, size, 0, NULL);
 		
 		fstream_close(stream);
 		
 		if (tree == NULL || !json_is_array(tree)) {
 			fprintf(stderr, "- O arquivo de credenciais localizado em '%s' possui uma sintaxe inválida ou não reconhecida!\r\n", accounts_file);
-			return EXIT_FAILURE;
+			return -1;
 		}
 		
 		const size_t total_items = json_array_size(tree);
 		
 		if (total_items < 1) {
 			fprintf(stderr, "- O arquivo de credenciais localizado em '%s' não possui credenciais salvas!\r\n", accounts_file);
-			return EXIT_FAILURE;
+			return -1;
 		}
 		
 		struct Credentials items[total_items];
@@ -573,15 +2260,21 @@ int main(void) {
 		size_t index = 0;
 		const json_t* item = NULL;
 		
-		printf("+ Como você deseja acessar este serviço?\r\n\r\n");
-		printf("0.\r\nAdicionar e usar nova conta\r\n\r\n");
+		if (!job->headless) {
+			printf("+ Como você deseja acessar este serviço?\r\n\r\n");
+			printf("0.\r\nAdicionar e usar nova conta\r\n\r\n");
+		}
+		
+		// A saved account is picked by its username; giving a password as well logs in again
+		const char* const account = (job->account == NULL && job->password == NULL) ? job->username : job->account;
+		size_t selected = 0;
 		
 		json_array_foreach(tree, index, item) {
 			json_t* subobj = json_object_get(item, "username");
 			
 			if (subobj == NULL || !json_is_string(subobj)) {
 				fprintf(stderr, "- O arquivo de configurações localizado em '%s' possui um formato inválido!\r\n", accounts_file);
-				return EXIT_FAILURE;
+				return -1;
 			}
 			
 			const char* const username = json_string_value(subobj);
@@ -590,7 +2283,7 @@ int main(void) {
 			
 			if (subobj == NULL || (!json_is_null(subobj) && !json_is_string(subobj))) {
 				fprintf(stderr, "- O arquivo de configurações localizado em '%s' possui um formato inválido!\r\n", accounts_file);
-				return EXIT_FAILURE;
+				return -1;
 			}
 			
 			struct Credentials credentials = {0};
@@ -602,7 +2295,7 @@ int main(void) {
 			if (access_token != NULL) {
 				if (credentials.access_token == NULL) {
 					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-					return EXIT_FAILURE;
+					return -1;
 				}
 				
 				strcpy(credentials.access_token, access_token);
@@ -612,7 +2305,7 @@ int main(void) {
 			
 			if (subobj == NULL || (!json_is_null(subobj) && !json_is_string(subobj))) {
 				fprintf(stderr, "- O arquivo de configurações localizado em '%s' possui um formato inválido!\r\n", accounts_file);
-				return EXIT_FAILURE;
+				return -1;
 			}
 			
 			const char* const cookie_jar = json_is_null(subobj) ? NULL : json_string_value(subobj);
@@ -621,505 +2314,270 @@ int main(void) {
 			
 			if (cookie_jar != NULL) {
 				if (credentials.cookie_jar == NULL) {
-					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-					return EXIT_FAILURE;
-				}
-				
-				strcpy(credentials.cookie_jar, cookie_jar);
-			}
-			
-			items[index] = credentials;
-			
-			printf("%zu. \r\nAcessar usando a conta: '%s'\r\n\r\n", index + 1, username);
-		}
-		
-		const int value = input_integer(0, (int) total_items);
-		
-		if (value == 0) {
-			char username[MAX_INPUT_SIZE] = {'\0'};
-			input("> Insira seu usuário: ", username);
-			
-			char password[MAX_INPUT_SIZE] = {'\0'};
-			input("> Insira sua senha: ", password);
-			
-			const int code = (*methods.authorize)(username, password, &credentials);
-			
-			switch (code) {
-				case UERR_SUCCESS:
-					break;
-				case UERR_CURL_FAILURE:
-					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-					return EXIT_FAILURE;
-				default:
-					fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
-					return EXIT_FAILURE;
-			}
-			
-			struct FStream* const stream = fstream_open(accounts_file, FSTREAM_WRITE);
-			
-			if (stream == NULL) {
-				const struct SystemError error = get_system_error();
-				
-				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", accounts_file, error.message);
-				return EXIT_FAILURE;
-			}
-			
-			json_auto_t* subtree = json_object();
-			json_object_set_new(subtree, "username", json_string(credentials.username));
-			json_object_set_new(subtree, "access_token", credentials.access_token == NULL ? json_null() : json_string(credentials.access_token));
-			json_object_set_new(subtree, "cookie_jar", credentials.cookie_jar == NULL ? json_null() : json_string(credentials.cookie_jar));
-			
-			json_array_append(tree, subtree);
-			
-			const int rcode = json_dump_callback(tree, json_dump_cb, (void*) stream, JSON_COMPACT);
-			
-			if (rcode != 0) {
-				const struct SystemError error = get_system_error();
-				
-				fstream_close(stream);
-				remove_file(accounts_file);
-				
-				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar exportar o arquivo de credenciais para '%s': %s\r\n", accounts_file, error.message);
-				return EXIT_FAILURE;
-			}
-			
-			fstream_close(stream);
-		} else {
-			credentials = items[value - 1];
-		}
-	} else {
-		char username[MAX_INPUT_SIZE] = {'\0'};
-		input("> Insira seu usuário: ", username);
-		
-		char password[MAX_INPUT_SIZE] = {'\0'};
-		input("> Insira sua senha: ", password);
-		
-		const int code = (*methods.authorize)(username, password, &credentials);
-		
-		switch (code) {
-			case UERR_SUCCESS:
-				break;
-			case UERR_CURL_FAILURE:
-				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-				return EXIT_FAILURE;
-			default:
-				fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
-				return EXIT_FAILURE;
-		}
-		
-		struct FStream* const stream = fstream_open(accounts_file, FSTREAM_WRITE);
-		
-		if (stream == NULL) {
-			const struct SystemError error = get_system_error();
-			
-			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", accounts_file, error.message);
-			return EXIT_FAILURE;
-		}
-		
-		json_auto_t* tree = json_array();
-		json_auto_t* obj = json_object();
-		
-		if (tree == NULL || obj == NULL) {
-			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-			return EXIT_FAILURE;
-		}
-		
-		json_object_set_new(obj, "username", json_string(credentials.username));
-		json_object_set_new(obj, "access_token", credentials.access_token == NULL ? json_null() : json_string(credentials.access_token));
-		json_object_set_new(obj, "cookie_jar", credentials.cookie_jar == NULL ? json_null() : json_string(credentials.cookie_jar));
-			
-		json_array_append(tree, obj);
-		
-		const int rcode = json_dump_callback(tree, json_dump_cb, (void*) stream, JSON_COMPACT);
-		
-		if (rcode != 0) {
-			const struct SystemError error = get_system_error();
-			
-			fstream_close(stream);
-			remove_file(accounts_file);
-			
-			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar exportar o arquivo de credenciais para '%s': %s\r\n", accounts_file, error.message);
-			return EXIT_FAILURE;
-		}
-		
-		fstream_close(stream);
-	}
-	
-	printf("+ Obtendo lista de conteúdos disponíveis\r\n");
-	
-	struct Resources resources = {0};
-	
-	const int code = (*methods.get_resources)(&credentials, &resources);
-	
-	switch (code) {
-		case UERR_SUCCESS:
-			break;
-		case UERR_PROVIDER_SESSION_EXPIRED:
-			fprintf(stderr, "- Sua sessão expirou ou foi revogada, refaça o login!\r\n");
-			return EXIT_FAILURE;
-		case UERR_CURL_FAILURE:
-			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-			return EXIT_FAILURE;
-		default:
-			fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
-			return EXIT_FAILURE;
-	}
-	
-	if (resources.offset < 1) {
-		fprintf(stderr, "- Não foram encontrados conteúdos disponíveis para baixar!\r\n");
-		return EXIT_FAILURE;
-	}
-	
-	size_t start = 0;
-	size_t end = PAGINATION_MAX_ITEMS;
-	
-	char answer[MAX_INPUT_SIZE] = {'\0'};
-	
-	struct CIR cir __attribute__((__cleanup__(cir_free))) = {0};
-	cir_init(&cir);
-	
-	while (1) {
-		erase_screen();
-		
-		printf("+ Selecione o que deseja baixar:\r\n\r\n");
-		
-		if (end > resources.offset) {
-			end = resources.offset;
-		}
-		
-		for (size_t index = start; index < end; index++) {
-			const struct Resource* const resource = &resources.items[index];
-			printf("%zu. \r\nNome: %s\r\nQualificação: %s\r\nURL: %s\r\n\r\n", index + 1, resource->name, resource->qualification.name == NULL ? "N/A" : resource->qualification.name, resource->url);
-		}
-		
-		printf("> Digite sua escolha: %s", answer);
-		fflush(stdout);
-		
-		int enter_pressed = 0;
-		
-		while (1) {
-			const struct CIKey* const key = cir_get(&cir);
-			
-			int break_parent = 0;
-			
-			switch (key->type) {
-				case KEY_PAGE_UP:
-				case KEY_ARROW_LEFT:
-				case KEY_ARROW_UP:
-				case KEY_HOME: {
-					if (PAGINATION_MAX_ITEMS > start) {
-						break;
-					}
-					
-					end = start;
-					start -= PAGINATION_MAX_ITEMS;
-					
-					break_parent = 1;
-					
-					break;
-				}
-				case KEY_PAGE_DOWN:
-				case KEY_ARROW_RIGHT:
-				case KEY_ARROW_DOWN:
-				case KEY_END: {
-					if (end == resources.offset) {
-						break;
-					}
-					
-					start = end;
-					end += ((end + PAGINATION_MAX_ITEMS) < resources.offset) ? PAGINATION_MAX_ITEMS : resources.offset - end;
-					
-					break_parent = 1;
-					
-					break;
-				case KEY_DELETE:
-					if (strlen(answer) < 1) {
-						break;
-					}
-					
-					printf("\b \b");
-					fflush(stdout);
-					
-					*(strchr(answer, '\0') - 1) = '\0';
-					
-					break;
-				}
-				case KEY_ZERO:
-				case KEY_ONE:
-				case KEY_TWO:
-				case KEY_THREE:
-				case KEY_FOUR:
-				case KEY_FIVE:
-				case KEY_SIX:
-				case KEY_SEVEN:
-				case KEY_EIGHTH:
-				case KEY_NINE:
-				case KEY_HYPHEN:
-				case KEY_COMMA: {
-					strcat(answer, cir.tmp);
-					printf("%s", cir.tmp);
-					fflush(stdout);
-					break;
-				}
-				case KEY_ENTER: {
-					break_parent = 1;
-					enter_pressed = 1;
-					break;
-				}
-				case KEY_CTRL_BACKSLASH:
-				case KEY_CTRL_C:
-				case KEY_CTRL_D:
-					printf("\r\n");
-					return EXIT_FAILURE;
-				default:
-					break;
-			}
-			
-			if (break_parent) {
-				break;
-			}
-		}
-		
-		printf("\r\n");
-		
-		if (enter_pressed) {
-			break;
-		}
-	}
-	
-	struct Resource download_queue[resources.offset];
-	size_t queue_count = 0;
-	
-	while (1) {
-		if (queue_count > 0) {
-			queue_count = 0;
-		}
-		
-		const char* start = answer;
-		int err = 0;
-		
-		for (size_t index = 0; index < strlen(answer) + 1; index++) {
-			const char* const ch = &answer[index];
-			
-			if (!(*ch == *COMMA || (*ch == '\0' && index > 0))) {
-				continue;
+					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+					return -1;
+				}
+				
+				strcpy(credentials.cookie_jar, cookie_jar);
 			}
 			
-			const size_t size = (size_t) (ch - start);
+			items[index] = credentials;
 			
-			if (size < 1) {
-				fprintf(stderr, "- Não podem haver valores vazios dentre as escolhas!\r\n");
-				err = 1;
-				break;
+			if (account != NULL && strcmp(username, account) == 0) {
+				selected = index + 1;
 			}
 			
-			char value[size + 1];
-			memcpy(value, start, size);
-			value[size] = '\0';
-			
-			const char* hyphen = strstr(value, HYPHEN);
+			if (!job->headless) {
+				printf("%zu. \r\nAcessar usando a conta: '%s'\r\n\r\n", index + 1, username);
+			}
+		}
+		
+		size_t value = 0;
+		
+		if (!job->headless) {
+			value = (size_t) input_integer(0, (int) total_items);
+		} else if (account != NULL) {
+			if (selected == 0) {
+				fprintf(stderr, "- Nenhuma conta com o usuário '%s' foi encontrada em '%s'!\r\n", account, accounts_file);
+				return -1;
+			}
 			
-			if (hyphen == NULL) {
-				 if (!isnumeric(value)) {
-					fprintf(stderr, "- O valor inserido é inválido ou não reconhecido!\r\n");
-					err = 1;
-					break;
-				}
-				
-				const size_t position = (size_t) atoi(value);
-				
-				if (position < 1) {
-					fprintf(stderr, "- O valor mínimo de uma escolha deve ser >=1!\r\n");
-					err = 1;
-					break;
-				}
-				
-				if (position > resources.offset) {
-					fprintf(stderr, "- O valor máximo de uma escolha deve ser <=%zu!\r\n", resources.offset);
-					err = 1;
-					break;
-				}
-				
-				struct Resource resource = resources.items[position - 1];
-				
-				for (size_t index = 0; index < queue_count; index++) {
-					const struct Resource subresource = download_queue[index];
-					
-					if (subresource.id == resource.id) {
-						fprintf(stderr, "- Não podem haver conteúdos duplicados dentre as escolhas!\r\n");
-						err = 1;
-						break;
-					}
-				}
-				
-				if (err) {
-					break;
-				}
-				
-				download_queue[queue_count++] = resource;
-			} else {
-				size_t size = (size_t) (hyphen - value);
-				
-				if (size < 1) {
-					fprintf(stderr, "- O valor mínimo é obrigatório para intervalos de seleção!\r\n");
-					err = 1;
-					break;
-				}
-				
-				char mins[size + 1];
-				memcpy(mins, value, size);
-				mins[size] = '\0';
-				
-				const size_t min = (size_t) atoi(mins);
-				
-				if (min < 1) {
-					fprintf(stderr, "- O valor mínimo para este intervalo deve ser >=1!\r\n");
-					err = 1;
-					break;
-				}
-				
-				const char* const end = value + (sizeof(value) - 1);
-				hyphen++;
-				
-				size = (size_t) (end - hyphen);
-				
-				if (size < 1) {
-					fprintf(stderr, "- O valor máximo é obrigatório para intervalos de seleção!\r\n");
-					err = 1;
-					break;
-				}
-				
-				char maxs[size + 1];
-				memcpy(maxs, hyphen, size);
-				maxs[size] = '\0';
-				
-				const size_t max = (size_t) atoi(maxs);
-				
-				if (max > resources.offset) {
-					fprintf(stderr, "- O valor máximo para este intervalo deve ser <=%zu!\r\n", resources.offset);
-					err = 1;
-					break;
-				}
-				
-				for (size_t index = min; index < (max + 1); index++) {
-					const struct Resource resource = resources.items[index - 1];
-					
-					for (size_t index = 0; index < queue_count; index++) {
-						const struct Resource subresource = download_queue[index];
-						
-						if (subresource.id == resource.id) {
-							fprintf(stderr, "- Não podem haver conteúdos duplicados dentre as escolhas!\r\n");
-							err = 1;
-							break;
-						}
-					}
-					
-					if (err) {
-						break;
-					}
-					
-					download_queue[queue_count++] = resource;
-				}
+			value = selected;
+		} else if (job->username == NULL) {
+			if (total_items > 1) {
+				fprintf(stderr, "- Existe mais de uma conta salva em '%s'; especifique qual delas usar!\r\n", accounts_file);
+				return -1;
 			}
 			
-			start = (ch + 1);
+			value = 1;
 		}
 		
-		if (!err) {
-			break;
+		// Only the account in use is kept around
+		for (size_t index = 0; index < total_items; index++) {
+			if (index + 1 != value) {
+				credentials_free(&items[index]);
+			}
 		}
 		
-		input("> Digite sua escolha: ", answer);
+		if (value == 0) {
+			if (login(job, &methods, &credentials) == -1 || save_account(accounts_file, tree, &credentials) == -1) {
+				return -1;
+			}
+		} else {
+			credentials = items[value - 1];
+		}
+	} else {
+		json_auto_t* tree = json_array();
+		
+		if (tree == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+			return -1;
+		}
+		
+		if (login(job, &methods, &credentials) == -1 || save_account(accounts_file, tree, &credentials) == -1) {
+			return -1;
+		}
 	}
 	
-	if (queue_count > 1) {
-		printf("- %zu conteúdos foram enfileirados para serem baixados\r\n", queue_count);
+	printf("+ Obtendo lista de conteúdos disponíveis\r\n");
+	
+	struct Resources resources __attribute__((__cleanup__(resources_free))) = {0};
+	
+	const long long started = trace_clock();
+	const int code = (*methods.get_resources)(&credentials, &resources);
+	
+	trace_span("get_resources", NULL, started);
+	
+	switch (code) {
+		case UERR_SUCCESS:
+			break;
+		case UERR_PROVIDER_SESSION_EXPIRED:
+			fprintf(stderr, "- Sua sessão expirou ou foi revogada, refaça o login!\r\n");
+			return -1;
+		case UERR_CURL_FAILURE:
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
+			return -1;
+		default:
+			fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
+			return -1;
 	}
 	
-	int kof = 0;
+	if (resources.offset < 1) {
+		fprintf(stderr, "- Não foram encontrados conteúdos disponíveis para baixar!\r\n");
+		return -1;
+	}
 	
-	printf("> Manter o nome original de arquivos e diretórios? (S/n) ");
-	fflush(stdout);
+	struct Resource download_queue[resources.offset];
+	struct DownloadQueue queue __attribute__((__cleanup__(download_queue_free))) = {
+		.items = download_queue
+	};
 	
-	while (1) {
-		const struct CIKey* const key = cir_get(&cir);
+	int kof = 0;
+	
+	if (job->headless) {
+		if (job->selection == NULL) {
+			fprintf(stderr, "- Nenhum conteúdo foi selecionado para ser baixado!\r\n");
+			return -1;
+		}
 		
-		switch (key->type) {
-			case KEY_SHIFT_S:
-			case KEY_S:
-			case KEY_SHIFT_Y:
-			case KEY_Y: {
-				printf("%s", cir.tmp);
-				fflush(stdout);
-				kof = 1;
-				break;
-			}
-			case KEY_ENTER: {
-				printf("s");
-				fflush(stdout);
-				kof = 1;
-				break;
-			}
-			case KEY_SHIFT_N:
-			case KEY_N: {
-				printf("%s", cir.tmp);
-				fflush(stdout);
-				kof = 0;
-				break;
-			}
-			case KEY_CTRL_BACKSLASH:
-			case KEY_CTRL_C:
-			case KEY_CTRL_D:
-				printf("\r\n");
-				fflush(stdout);
-				return EXIT_FAILURE;
-			default:
-				continue;
+		if (queue_resources(job->selection, &resources, download_queue, &queue.count) == -1) {
+			return -1;
 		}
 		
-		break;
+		if (queue.count > 1) {
+			printf("- %zu conteúdos foram enfileirados para serem baixados\r\n", queue.count);
+		}
+		
+		kof = (job->keep_names != 0);
+	} else if (prompt_selection(&resources, download_queue, &queue.count, &kof) == -1) {
+		return -1;
 	}
 	
-	printf("\r\n");
+	if (!shared) {
+		fclose(stdin);
+	}
 	
-	cir_free(&cir);
+	char* current_directory __free__ = NULL;
+	char* cwd = job->directory;
 	
-	fclose(stdin);
+	if (cwd != NULL && directory_exists(cwd) != 1 && create_directory(cwd) == -1) {
+		const struct SystemError error = get_system_error();
+		
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o diretório em '%s': %s\r\n", cwd, error.message);
+		return -1;
+	}
 	
-	char* cwd = get_current_directory();
+	if (cwd == NULL) {
+		cwd = current_directory = get_current_directory();
+	}
 	
 	if (cwd == NULL) {
 		const struct SystemError error = get_system_error();
 		
 		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter o diretório de trabalho atual: %s\r\n", error.message);
-		return EXIT_FAILURE;
+		return -1;
 	}
 	
 	const int trailing_sep = (strlen(cwd) > 0 && *(strchr(cwd, '\0') - 1) == *PATH_SEPARATOR);
 	
-	for (size_t index = 0; index < queue_count; index++) {
+	/*
+	Copying the streams of a media into its final file (then publishing it) is left to a pool of
+	worker threads, so that the network is kept busy in the meantime. Each queued media holds on to
+	its downloaded files until its turn comes, hence the bound on the number of queued media.
+	Copies themselves never overlap (see ffmpeg_copy_inputs()); more workers only let the
+	publishing of a media run alongside the copy of the next one.
+	*/
+	const size_t mux_workers = get_env_size("ARA_MUX_WORKERS", MUX_DEFAULT_WORKERS);
+	const size_t mux_backlog = get_env_size("ARA_MUX_BACKLOG", MUX_DEFAULT_BACKLOG);
+	
+	struct ThreadPool muxers __attribute__((__cleanup__(threadpool_free))) = {0};
+	
+	if (threadpool_init(&muxers, mux_workers, mux_backlog) != 0) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+		return -1;
+	}
+	
+	/*
+	Downloaded data is written to disk on a thread of its own, so that a slow disk does not stall
+	the transfers. Transfers are paused while all of the buffers are waiting to be written.
+	*/
+	const size_t write_buffers = get_env_size("ARA_WRITE_BUFFERS", DOWNLOAD_DEFAULT_BUFFERS);
+	size_t write_buffer_size = get_env_size("ARA_WRITE_BUFFER_SIZE", DOWNLOAD_DEFAULT_BUFFER_SIZE);
+	
+	// cURL hands over data in chunks of up to this size, and each one must fit in a buffer
+	if (write_buffer_size < CURL_MAX_WRITE_SIZE) {
+		write_buffer_size = CURL_MAX_WRITE_SIZE;
+	}
+	
+	struct Writer writer __attribute__((__cleanup__(writer_free))) = {0};
+	
+	if (writer_init(&writer, write_buffers, write_buffer_size, writer_wakeup, (void*) curl_multi) != 0) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+		return -1;
+	}
+	
+	/*
+	The progress of the downloads is shown in the terminal (unless other jobs are running alongside
+	this one) and, if ARA_PROGRESS is set to a filename or to "fd:" followed by the number of an
+	inherited file descriptor, streamed there as JSON lines.
+	*/
+	struct Progress progress __attribute__((__cleanup__(progress_free))) = {0};
+	progress_init(&progress, provider.label, !shared);
+	
+	const char* const progress_target = getenv("ARA_PROGRESS");
+	
+	if (progress_target != NULL && *progress_target != '\0' && progress_open(&progress, progress_target) == -1) {
+		const struct SystemError error = get_system_error();
+		
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar abrir o destino do progresso dos downloads em '%s': %s\r\n", progress_target, error.message);
+		return -1;
+	}
+	
+	struct FSIndex fsindex __attribute__((__cleanup__(fsindex_free))) = {0};
+	
+	/*
+	Pages completed in earlier runs are skipped without fetching them again; the record of
+	what was completed lives in the configuration directory. Set ARA_STATE=0 to have every
+	page checked again.
+	*/
+	struct StateDB statedb __attribute__((__cleanup__(statedb_close))) = {0};
+	struct StateDB* state = NULL;
+	
+	char state_file[strlen(configuration_directory) + strlen(PATH_SEPARATOR) + strlen(LOCAL_STATE_FILENAME) + 1];
+	strcpy(state_file, configuration_directory);
+	strcat(state_file, PATH_SEPARATOR);
+	strcat(state_file, LOCAL_STATE_FILENAME);
+	
+	if (get_env_size("ARA_STATE", 1) != 0) {
+		if (statedb_open(&statedb, state_file) == -1) {
+			const struct SystemError error = get_system_error();
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar carregar o estado dos downloads em '%s': %s\r\n", state_file, error.message);
+			return -1;
+		}
+		
+		state = &statedb;
+		
+		// Set ARA_VERIFY=1 to check the files downloaded in earlier runs for corruption before resuming
+		if (get_env_size("ARA_VERIFY", 0) != 0 && state_verify(state, get_env_size("ARA_VERIFY_WORKERS", VERIFY_DEFAULT_WORKERS)) == -1) {
+			const struct SystemError error = get_system_error();
+			
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar verificar a integridade dos arquivos previamente baixados: %s\r\n", error.message);
+			return -1;
+		}
+	}
+	
+	int media_sequence = 0;
+	
+	// Set ARA_STAGING=0 to keep partial files in the temporary directory instead
+	const int staging = get_env_size("ARA_STAGING", 1) != 0;
+	
+	for (size_t index = 0; index < queue.count; index++) {
 		struct Resource* const resource = &download_queue[index];
 		
 		printf("+ Obtendo lista de módulos do produto '%s'\r\n", resource->name);
 		
+		const long long started = trace_clock();
 		const int code = (*methods.get_modules)(&credentials, resource);
 		
+		trace_span("get_modules", resource->name, started);
+		
 		switch (code) {
 			case UERR_SUCCESS:
 				break;
 			case UERR_CURL_FAILURE:
 				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-				return EXIT_FAILURE;
+				return -1;
 			default:
 				fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
-				return EXIT_FAILURE;
+				return -1;
 		}
 		
 		resource->path = malloc(strlen(cwd) + (trailing_sep ? 0 : strlen(PATH_SEPARATOR)) + (resource->qualification.id == NULL ? 0 : (kof ? strlen(resource->qualification.dirname) : strlen(resource->qualification.short_dirname)) + strlen(PATH_SEPARATOR)) + (kof ? strlen(resource->dirname) : strlen(resource->short_dirname)) + 1);
 		
 		if (resource->path == NULL) {
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-			return EXIT_FAILURE;
+			return -1;
 		}
 		
 		strcpy(resource->path, cwd);
@@ -1135,19 +2593,31 @@ int main(void) {
 		
 		strcat(resource->path, kof ? resource->dirname : resource->short_dirname);
 		
+		/*
+		Whatever is already in the directory of the resource is listed once, upfront; from here on, checking
+		whether its modules, pages and files exist (and creating their directories) is answered by the index.
+		*/
 		switch (directory_exists(resource->path)) {
 			case 1: {
 				fprintf(stderr, "- O diretório '%s' já existe, ele não será recriado\r\n", resource->path);
+				
+				if (fsindex_scan(&fsindex, resource->path) == -1) {
+					const struct SystemError error = get_system_error();
+					
+					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o diretório em '%s': %s\r\n", resource->path, error.message);
+					return -1;
+				}
+				
 				break;
 			}
 			case 0: {
 				fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", resource->path);
 				
-				if (create_directory(resource->path) == -1) {
+				if (fsindex_create_directory(&fsindex, resource->path) == -1) {
 					const struct SystemError error = get_system_error();
 					
 					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o diretório em '%s': %s\r\n", resource->path, error.message);
-					return EXIT_FAILURE;
+					return -1;
 				}
 				
 				break;
@@ -1156,7 +2626,44 @@ int main(void) {
 				const struct SystemError error = get_system_error();
 				
 				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o diretório em '%s': %s\r\n", resource->path, error.message);
-				return EXIT_FAILURE;
+				return -1;
+			}
+		}
+		
+		char staging_directory[strlen(resource->path) + strlen(PATH_SEPARATOR) + strlen(PARTIAL_DIRECTORY) + 1];
+		strcpy(staging_directory, resource->path);
+		strcat(staging_directory, PATH_SEPARATOR);
+		strcat(staging_directory, PARTIAL_DIRECTORY);
+		
+		/*
+		Downloads are written next to where they belong and renamed into place once complete. Unlike
+		moving them from the temporary directory (which is often on another file system), this never
+		copies their contents, and a file that exists under its final name is always a complete one.
+		*/
+		const char* const partial_directory = staging ? staging_directory : temporary_directory;
+		
+		if (staging) {
+			switch (fsindex_directory_exists(&fsindex, staging_directory)) {
+				case 1: {
+					if (remove_directory_contents(staging_directory) == -1) {
+						const struct SystemError error = get_system_error();
+						
+						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar remover os resquícios de arquivos temporários em '%s': %s\r\n", staging_directory, error.message);
+						return -1;
+					}
+					
+					break;
+				}
+				case 0: {
+					if (fsindex_create_directory(&fsindex, staging_directory) == -1) {
+						const struct SystemError error = get_system_error();
+						
+						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o diretório em '%s': %s\r\n", staging_directory, error.message);
+						return -1;
+					}
+					
+					break;
+				}
 			}
 		}
 		
@@ -1170,8 +2677,11 @@ int main(void) {
 				continue;
 			}
 			
+			const long long started = trace_clock();
 			const int code = (*methods.get_module)(&credentials, resource, module);
 			
+			trace_span("get_module", module->name, started);
+			
 			switch (code) {
 				case UERR_SUCCESS:
 					break;
@@ -1180,10 +2690,10 @@ int main(void) {
 					break;
 				case UERR_CURL_FAILURE:
 					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-					return EXIT_FAILURE;
+					return -1;
 				default:
 					fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
-					return EXIT_FAILURE;
+					return -1;
 			}
 			
 			printf("+ Verificando estado do módulo '%s'\r\n", module->name);
@@ -1192,14 +2702,14 @@ int main(void) {
 			
 			if (module->path == NULL) {
 				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-				return EXIT_FAILURE;
+				return -1;
 			}
 			
 			strcpy(module->path, resource->path);
 			strcat(module->path, PATH_SEPARATOR);
 			strcat(module->path, kof ? module->dirname : module->short_dirname);
 			
-			switch (directory_exists(module->path)) {
+			switch (fsindex_directory_exists(&fsindex, module->path)) {
 				case 1: {
 					fprintf(stderr, "- O diretório '%s' já existe, ele não será recriado\r\n", module->path);
 					break;
@@ -1207,114 +2717,21 @@ int main(void) {
 				case 0: {
 					fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", module->path);
 					
-					if (create_directory(module->path) == -1) {
+					if (fsindex_create_directory(&fsindex, module->path) == -1) {
 						const struct SystemError error = get_system_error();
 						
 						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o diretório em '%s': %s\r\n", module->path, error.message);
-						return EXIT_FAILURE;
+						return -1;
 					}
 					
 					break;
 				}
-				case -1: {
-					const struct SystemError error = get_system_error();
-					
-					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o diretório em '%s': %s\r\n", module->path, error.message);
-					return EXIT_FAILURE;
-				}
 			}
 			
-			curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 0L);
-			curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, curl_progress_cb);
-			curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 0L);
-			curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 1L);
-			curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, curl_write_file_cb);
-			
-			for (size_t index = 0; index < module->attachments.offset; index++) {
-				struct Attachment* const attachment = &module->attachments.items[index];
-				
-				attachment->path = malloc(strlen(module->path) + strlen(PATH_SEPARATOR) + (kof ? strlen(attachment->filename) : strlen(attachment->short_filename)) + 1);
-				
-				if (attachment->path == NULL) {
-					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-					return EXIT_FAILURE;
-				}
-			
-				strcpy(attachment->path, module->path);
-				strcat(attachment->path, PATH_SEPARATOR);
-				strcat(attachment->path, kof ? attachment->filename : attachment->short_filename);
-				
-				switch (file_exists(attachment->path)) {
-					case 1: {
-						fprintf(stderr, "- O arquivo '%s' já foi previamente baixado, ele não sofrerá alterações\r\n", attachment->path);
-						break;
-					}
-					case 0: {
-						char download_location[strlen(temporary_directory) + strlen(PATH_SEPARATOR) + strlen(attachment->short_filename) + 1];
-						strcpy(download_location, temporary_directory);
-						strcat(download_location, PATH_SEPARATOR);
-						strcat(download_location, attachment->short_filename);
-						
-						fprintf(stderr, "- O arquivo '%s' não existe, ele será baixado\r\n", attachment->path);
-						printf("+ Baixando de '%s' para '%s'\r\n", attachment->url, download_location);
-						
-						struct FStream* const stream = fstream_open(download_location, FSTREAM_WRITE);
-						
-						if (stream == NULL) {
-							const struct SystemError error = get_system_error();
-							
-							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", download_location, error.message);
-							return EXIT_FAILURE;
-						}
-						
-						curl_easy_setopt(curl_easy, CURLOPT_URL, attachment->url);
-						curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, (void*) stream);
-						
-						const CURLcode code = curl_easy_perform_retry(curl_easy);
-						
-						erase_line();
-						
-						fstream_close(stream);
-						
-						if (code != CURLE_OK) {
-							remove_file(download_location);
-							
-							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-							return EXIT_FAILURE;
-						}
-						
-						printf("+ Movendo arquivo de '%s' para '%s'\r\n", download_location, attachment->path);
-						
-						if (move_file(download_location, attachment->path) == -1) {
-							const struct SystemError error = get_system_error();
-							
-							remove_file(download_location);
-							
-							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover o arquivo de '%s' para '%s': %s\r\n", download_location, attachment->path, error.message);
-							return EXIT_FAILURE;
-						}
-						
-						remove_file(download_location);
-						
-						break;
-					}
-					case -1: {
-						const struct SystemError error = get_system_error();
-						
-						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o arquivo em '%s': %s\r\n", attachment->path, error.message);
-						return EXIT_FAILURE;
-					}
-				}
+			if (attachments_download(&module->attachments, module->path, partial_directory, kof, &fsindex, &writer, &progress, state, state_file) == -1) {
+				return -1;
 			}
 			
-			curl_easy_setopt(curl_easy, CURLOPT_URL, NULL);
-			curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, NULL);
-			curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, NULL);
-			curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 1L);
-			curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 60L);
-			curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, NULL);
-			curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 0L);
-			
 			printf("+ Obtendo lista de páginas do módulo '%s'\r\n", module->name);
 			
 			for (size_t index = 0; index < module->pages.offset; index++) {
@@ -1327,8 +2744,28 @@ int main(void) {
 					continue;
 				}
 				
+				page->path = malloc(strlen(module->path) + strlen(PATH_SEPARATOR) + (kof ? strlen(page->dirname) : strlen(page->short_dirname)) + 1);
+				
+				if (page->path == NULL) {
+					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+					return -1;
+				}
+				
+				strcpy(page->path, module->path);
+				strcat(page->path, PATH_SEPARATOR);
+				strcat(page->path, kof ? page->dirname : page->short_dirname);
+				
+				if (state != NULL && statedb_complete(state, STATE_PAGE, page->id, page->path)) {
+					fprintf(stderr, "- A página '%s' já foi baixada por completo anteriormente, pulando para a próxima\r\n", page->name);
+					page->is_complete = 1;
+					continue;
+				}
+				
+				const long long started = trace_clock();
 				const int code = (*methods.get_page)(&credentials, resource, page);
 				
+				trace_span("get_page", page->name, started);
+				
 				switch (code) {
 					case UERR_SUCCESS:
 						break;
@@ -1337,26 +2774,15 @@ int main(void) {
 						break;
 					case UERR_CURL_FAILURE:
 						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-						return EXIT_FAILURE;
+						return -1;
 					default:
 						fprintf(stderr, "- Ocorreu uma falha inesperada: %s\r\n", strurr(code));
-						return EXIT_FAILURE;
+						return -1;
 				}
 				
 				printf("+ Verificando estado da página '%s'\r\n", page->name);
 				
-				page->path = malloc(strlen(module->path) + strlen(PATH_SEPARATOR) + (kof ? strlen(page->dirname) : strlen(page->short_dirname)) + 1);
-				
-				if (page->path == NULL) {
-					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-					return EXIT_FAILURE;
-				}
-				
-				strcpy(page->path, module->path);
-				strcat(page->path, PATH_SEPARATOR);
-				strcat(page->path, kof ? page->dirname : page->short_dirname);
-				
-				switch (directory_exists(page->path)) {
+				switch (fsindex_directory_exists(&fsindex, page->path)) {
 					case 1: {
 						fprintf(stderr, "- O diretório '%s' já existe, ele não será recriado\r\n", page->path);
 						break;
@@ -1364,21 +2790,15 @@ int main(void) {
 					case 0: {
 						fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", page->path);
 						
-						if (create_directory(page->path) == -1) {
+						if (fsindex_create_directory(&fsindex, page->path) == -1) {
 							const struct SystemError error = get_system_error();
 							
 							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o diretório em '%s': %s\r\n", page->path, error.message);
-							return EXIT_FAILURE;
+							return -1;
 						}
 						
 						break;
 					}
-					case -1: {
-						const struct SystemError error = get_system_error();
-						
-						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o diretório em '%s': %s\r\n", page->path, error.message);
-						return EXIT_FAILURE;
-					}
 				}
 				
 				if (page->document.content != NULL) {
@@ -1386,14 +2806,14 @@ int main(void) {
 					
 					if (page->document.path == NULL) {
 						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-						return EXIT_FAILURE;
+						return -1;
 					}
 					
 					strcpy(page->document.path, page->path);
 					strcat(page->document.path, PATH_SEPARATOR);
 					strcat(page->document.path, kof ? page->document.filename : page->document.short_filename);
 					
-					switch (file_exists(page->document.path)) {
+					switch (fsindex_file_exists(&fsindex, page->document.path)) {
 						case 1: {
 							fprintf(stderr, "- O arquivo '%s' já foi previamente salvo, ele não sofrerá alterações\r\n", page->document.path);
 							break;
@@ -1407,9 +2827,13 @@ int main(void) {
 								const struct SystemError error = get_system_error();
 								
 								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", page->document.path, error.message);
-								return EXIT_FAILURE;
+								return -1;
 							}
 							
+							struct SHA256 sha256 = {0};
+							sha256_init(&sha256);
+							fstream_digest(stream, &sha256);
+							
 							const int status = fstream_write(stream, page->document.content, strlen(page->document.content));
 							
 							if (status == -1) {
@@ -1419,22 +2843,37 @@ int main(void) {
 								remove_file(page->document.path);
 								
 								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o documento em '%s': %s\r\n", page->document.path, error.message);
-								return EXIT_FAILURE;
+								return -1;
 							}
 							
 							fstream_close(stream);
 							
-							break;
-						}
-						case -1: {
-							const struct SystemError error = get_system_error();
+							if (fsindex_add_file(&fsindex, page->document.path, (long long) strlen(page->document.content), (long long) time(NULL)) == -1) {
+								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+								return -1;
+							}
+							
+							unsigned char digest[SHA256_DIGEST_SIZE];
+							sha256_final(&sha256, digest);
+							
+							char document_digest[SHA256_HEX_SIZE];
+							sha256_hex(digest, document_digest);
+							
+							if (state_save(state, STATE_FILE, page->document.id, page->document.path, NULL, document_digest, (long long) strlen(page->document.content), NULL) == -1) {
+								const struct SystemError error = get_system_error();
+								
+								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o estado dos downloads em '%s': %s\r\n", state_file, error.message);
+								return -1;
+							}
 							
-							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o arquivo em '%s': %s\r\n", page->document.path, error.message);
-							return EXIT_FAILURE;
+							break;
 						}
 					}
 				}
 				
+				// Set once a media of this page is handed over to the mux pool
+				int muxing = 0;
+				
 				for (size_t index = 0; index < page->medias.offset; index++) {
 					struct Media* const media = &page->medias.items[index];
 					
@@ -1445,7 +2884,7 @@ int main(void) {
 						
 						if (media_filename == NULL) {
 							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-							return EXIT_FAILURE;
+							return -1;
 						}
 						
 						strcpy(media_filename, page->path);
@@ -1458,7 +2897,7 @@ int main(void) {
 						
 						if (media_filename == NULL) {
 							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-							return EXIT_FAILURE;
+							return -1;
 						}
 						
 						strcpy(media_filename, page->path);
@@ -1467,8 +2906,9 @@ int main(void) {
 					}
 					
 					media->path = media_filename;
+					media->size = -1;
 					
-					switch (file_exists(media_filename)) {
+					switch (fsindex_file_exists(&fsindex, media_filename)) {
 						case 1: {
 							fprintf(stderr, "- O arquivo '%s' já foi previamente baixado, ele não sofrerá alterações\r\n", media_filename);
 							break;
@@ -1479,303 +2919,241 @@ int main(void) {
 							char* audio_path __free__ = NULL;
 							char* video_path __free__ = NULL;
 							
-							if (media->audio.url != NULL) {
-								audio_path = malloc(strlen(temporary_directory) + strlen(PATH_SEPARATOR) + strlen(media->audio.short_filename) + 1);
+							struct Rendition renditions[2] = {0};
+							size_t renditions_count = 0;
+							
+							/*
+							The temporary files of a media may still be in use by the mux pool while the next
+							one is downloading, so their names are prefixed with a sequence number.
+							*/
+							media_sequence++;
+							
+							char sequence[intlen(media_sequence) + 1];
+							snprintf(sequence, sizeof(sequence), "%i", media_sequence);
+							
+							char* partial_path __free__ = NULL;
+							
+							if (staging) {
+								const char* const short_filename = (media->video.url == NULL) ? media->audio.short_filename : media->video.short_filename;
 								
-								if (audio_path == NULL) {
+								// Named apart from the renditions, which may be single files with the same name
+								partial_path = malloc(strlen(partial_directory) + strlen(PATH_SEPARATOR) + strlen(sequence) + strlen(DOT) + strlen(PARTIAL_OUTPUT) + strlen(DOT) + strlen(short_filename) + 1);
+								
+								if (partial_path == NULL) {
 									fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-									return EXIT_FAILURE;
+									return -1;
 								}
 								
-								strcpy(audio_path, temporary_directory);
-								strcat(audio_path, PATH_SEPARATOR);
-								strcat(audio_path, media->audio.short_filename);
-								
-								switch (media->type) {
-									case MEDIA_M3U8: {
-										printf("+ Baixando seguimentos de mídia de '%s' para '%s'\r\n", media->audio.url, temporary_directory);
-										
-										if (m3u8_download(media->audio.url, audio_path) != UERR_SUCCESS) {
-											return EXIT_FAILURE;
-										}
-										
-										break;
-									}
-									case MEDIA_SINGLE: {
-										printf("+ Baixando arquivo de mídia de '%s' para '%s'\r\n", media->audio.url, audio_path);
-										
-										struct FStream* const stream = fstream_open(audio_path, FSTREAM_WRITE);
-										
-										if (stream == NULL) {
-											const struct SystemError error = get_system_error();
-											
-											fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n",  audio_path, error.message);
-											return EXIT_FAILURE;
-										}
-										
-										curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 0L);
-										curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, curl_progress_cb);
-										curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 0L);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, curl_write_file_cb);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, (void*) stream);
-										curl_easy_setopt(curl_easy, CURLOPT_URL, media->audio.url);
-										curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 1L);
-										
-										const CURLcode code = curl_easy_perform_retry(curl_easy);
-										
-										erase_line();
-										
-										fstream_close(stream);
-										
-										curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 1L);
-										curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 60L);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_URL, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 0L);
-										
-										if (code != CURLE_OK) {
-											remove_file(audio_path);
-											
-											fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-											return EXIT_FAILURE;
-										}
-										
-										break;
-									}
-								}
+								strcpy(partial_path, partial_directory);
+								strcat(partial_path, PATH_SEPARATOR);
+								strcat(partial_path, sequence);
+								strcat(partial_path, DOT);
+								strcat(partial_path, PARTIAL_OUTPUT);
+								strcat(partial_path, DOT);
+								strcat(partial_path, short_filename);
 							}
 							
 							if (media->video.url != NULL) {
-								video_path = malloc(strlen(temporary_directory) + strlen(PATH_SEPARATOR) + strlen(media->video.short_filename) + 1);
+								video_path = malloc(strlen(partial_directory) + strlen(PATH_SEPARATOR) + strlen(sequence) + strlen(DOT) + strlen(media->video.short_filename) + 1);
 								
 								if (video_path == NULL) {
 									fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-									return EXIT_FAILURE;
+									return -1;
 								}
 								
-								strcpy(video_path, temporary_directory);
+								strcpy(video_path, partial_directory);
 								strcat(video_path, PATH_SEPARATOR);
+								strcat(video_path, sequence);
+								strcat(video_path, DOT);
 								strcat(video_path, media->video.short_filename);
 								
-								switch (media->type) {
-									case MEDIA_M3U8: {
-										printf("+ Baixando seguimentos de mídia de '%s' para '%s'\r\n", media->video.url, temporary_directory);
-										
-										if (m3u8_download(media->video.url, video_path) != UERR_SUCCESS) {
-											return EXIT_FAILURE;
-										}
-										
-										break;
-									}
-									case MEDIA_SINGLE: {
-										printf("+ Baixando arquivo de mídia de '%s' para '%s'\r\n", media->video.url, video_path);
-										
-										struct FStream* const stream = fstream_open(video_path, FSTREAM_WRITE);
-										
-										if (stream == NULL) {
-											const struct SystemError error = get_system_error();
-											
-											fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n",  video_path, error.message);
-											return EXIT_FAILURE;
-										}
-										
-										curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 0L);
-										curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, curl_progress_cb);
-										curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 0L);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, curl_write_file_cb);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, (void*) stream);
-										curl_easy_setopt(curl_easy, CURLOPT_URL, media->video.url);
-										curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 1L);
-										
-										const CURLcode code = curl_easy_perform_retry(curl_easy);
-										
-										erase_line();
-										
-										fstream_close(stream);
-										
-										curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 1L);
-										curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 60L);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_URL, NULL);
-										curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 0L);
-										
-										if (code != CURLE_OK) {
-											remove_file(video_path);
-											
-											fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-											return EXIT_FAILURE;
-										}
-										
-										break;
-									}
-								}
+								renditions[renditions_count].url = media->video.url;
+								renditions[renditions_count].output = video_path;
+								renditions_count++;
 							}
 							
-							if (audio_path != NULL && video_path != NULL) {
-								const char* const file_extension = get_file_extension(video_path);
-								
-								char temporary_file[strlen(temporary_directory) + strlen(PATH_SEPARATOR) + strlen(media->video.id) + strlen(media->audio.id) + strlen(DOT) + strlen(file_extension) + 1];
-								strcpy(temporary_file, temporary_directory);
-								strcat(temporary_file, PATH_SEPARATOR);
-								strcat(temporary_file, media->video.id);
-								strcat(temporary_file, media->audio.id);
-								strcat(temporary_file, DOT);
-								strcat(temporary_file, file_extension);
-								
-								printf("+ Copiando canais de vídeo e áudio para uma única mídia em '%s'\r\n", temporary_file);
-								
-								const char* const inputs[] = {
-									video_path,
-									audio_path,
-									NULL
-								};
-								
-								const int code = ffmpeg_copy_streams(inputs, temporary_file);
-								
-								remove_file(audio_path);
-								remove_file(video_path);
+							if (media->audio.url != NULL) {
+								audio_path = malloc(strlen(partial_directory) + strlen(PATH_SEPARATOR) + strlen(sequence) + strlen(DOT) + strlen(media->audio.short_filename) + 1);
 								
-								if (code != 0) {
-									fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar copiar os canais de vídeo e áudio para uma única mídia em '%s': %s\r\n", temporary_file, av_err2str(code));
-									return EXIT_FAILURE;
+								if (audio_path == NULL) {
+									fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+									return -1;
 								}
 								
-								printf("+ Movendo arquivo de mídia de '%s' para '%s'\r\n", temporary_file, media_filename);
-								
-								if (move_file(temporary_file, media_filename) == -1) {
-									const struct SystemError error = get_system_error();
-									
-									fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover o arquivo de '%s' para '%s': %s\r\n", temporary_file, media_filename, error.message);
-									return EXIT_FAILURE;
-								}
-							} else {
-								const char* const source_file = audio_path == NULL ? video_path : audio_path;
+								strcpy(audio_path, partial_directory);
+								strcat(audio_path, PATH_SEPARATOR);
+								strcat(audio_path, sequence);
+								strcat(audio_path, DOT);
+								strcat(audio_path, media->audio.short_filename);
 								
-								printf("+ Movendo arquivo de mídia de '%s' para '%s'\r\n", source_file, media_filename);
+								renditions[renditions_count].url = media->audio.url;
+								renditions[renditions_count].output = audio_path;
+								renditions_count++;
+							}
+							
+							/*
+							The streams of every rendition are copied straight into the media file by the mux pool,
+							with the video stream coming first; meanwhile, the next media starts downloading.
+							*/
+							if (state != NULL && media->type == MEDIA_SINGLE && renditions_count == 1) {
+								media->digest = malloc(SHA256_HEX_SIZE);
 								
-								if (move_file(source_file, media_filename) == -1) {
-									const struct SystemError error = get_system_error();
-									
-									remove_file(source_file);
-									
-									fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover o arquivo de '%s' para '%s': %s\r\n", source_file, media_filename, error.message);
-									return EXIT_FAILURE;
+								if (media->digest == NULL) {
+									fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+									return -1;
 								}
+							}
+							
+							if (media_download(media->type, renditions, renditions_count, media_filename, partial_path, &muxers, &writer, &progress, media->digest, &media->size) != UERR_SUCCESS) {
+								return -1;
+							}
+							
+							// The size of a media is not known here (a muxed one is still being written by the mux pool), but its path is taken all the same
+							if (fsindex_add_file(&fsindex, media_filename, -1, (long long) time(NULL)) == -1) {
+								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+								return -1;
+							}
+							
+							// Only a media downloaded as a single file is in place already; muxed ones are still being written by the mux pool
+							if (!(media->type == MEDIA_SINGLE && renditions_count == 1)) {
+								muxing = 1;
+								break;
+							}
+							
+							const int is_audio = media->audio.url != NULL && media->video.url == NULL;
+							
+							if (state_save(state, STATE_FILE, is_audio ? media->audio.id : media->video.id, media_filename, is_audio ? media->audio.url : media->video.url, media->digest, -1, NULL) == -1) {
+								const struct SystemError error = get_system_error();
 								
-								remove_file(source_file);
+								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o estado dos downloads em '%s': %s\r\n", state_file, error.message);
+								return -1;
 							}
 							
 							break;
 						}
-						case -1: {
-							const struct SystemError error = get_system_error();
-							
-							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o arquivo em '%s': %s\r\n", media_filename, error.message);
-							return EXIT_FAILURE;
-						}
 					}
 				}
 				
-				curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 0L);
-				curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, curl_progress_cb);
-				curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 0L);
-				curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 1L);
-				curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, curl_write_file_cb);
+				if (attachments_download(&page->attachments, page->path, partial_directory, kof, &fsindex, &writer, &progress, state, state_file) == -1) {
+					return -1;
+				}
 				
-				for (size_t index = 0; index < page->attachments.offset; index++) {
-					struct Attachment* const attachment = &page->attachments.items[index];
+				// Pages with medias still being muxed are only recorded as complete once the mux pool is done
+				if (!muxing && state_save(state, STATE_PAGE, page->id, page->path, NULL, NULL, -1, NULL) == -1) {
+					const struct SystemError error = get_system_error();
 					
-					attachment->path = malloc(strlen(page->path) + strlen(PATH_SEPARATOR) + (kof ? strlen(attachment->filename) : strlen(attachment->short_filename)) + 1);
+					fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o estado dos downloads em '%s': %s\r\n", state_file, error.message);
+					return -1;
+				}
+			}
+		}
+	}
+	
+	const size_t mux_failures = threadpool_wait(&muxers);
+	
+	progress_finish(&progress);
+	
+	threadpool_free(&muxers);
+	writer_free(&writer);
+	fsindex_free(&fsindex);
+	
+	if (mux_failures > 0) {
+		return -1;
+	}
+	
+	if (staging) {
+		for (size_t index = 0; index < queue.count; index++) {
+			const struct Resource* const resource = &download_queue[index];
+			
+			if (resource->path == NULL) {
+				continue;
+			}
+			
+			char staging_directory[strlen(resource->path) + strlen(PATH_SEPARATOR) + strlen(PARTIAL_DIRECTORY) + 1];
+			strcpy(staging_directory, resource->path);
+			strcat(staging_directory, PATH_SEPARATOR);
+			strcat(staging_directory, PARTIAL_DIRECTORY);
+			
+			if (directory_exists(staging_directory) == 1) {
+				remove_recursive(staging_directory, 1);
+			}
+		}
+	}
+	
+	// Now that every media is in place, the pages (and medias) left unrecorded above are complete too
+	if (state != NULL) {
+		for (size_t index = 0; index < queue.count; index++) {
+			const struct Resource* const resource = &download_queue[index];
+			
+			for (size_t index = 0; index < resource->modules.offset; index++) {
+				const struct Module* const module = &resource->modules.items[index];
+				
+				for (size_t index = 0; index < module->pages.offset; index++) {
+					const struct Page* const page = &module->pages.items[index];
 					
-					if (attachment->path == NULL) {
-						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
-						return EXIT_FAILURE;
+					if (page->path == NULL || statedb_complete(state, STATE_PAGE, page->id, page->path)) {
+						continue;
 					}
 					
-					strcpy(attachment->path, page->path);
-					strcat(attachment->path, PATH_SEPARATOR);
-					strcat(attachment->path, kof ? attachment->filename : attachment->short_filename);
+					int status = 0;
 					
-					switch (file_exists(attachment->path)) {
-						case 1: {
-							fprintf(stderr, "- O arquivo '%s' já foi previamente baixado, ele não sofrerá alterações\r\n", attachment->path);
-							break;
+					for (size_t index = 0; index < page->medias.offset; index++) {
+						const struct Media* const media = &page->medias.items[index];
+						
+						if (media->path == NULL) {
+							continue;
 						}
-						case 0: {
-							char download_location[strlen(temporary_directory) + strlen(PATH_SEPARATOR) + strlen(attachment->short_filename) + 1];
-							strcpy(download_location, temporary_directory);
-							strcat(download_location, PATH_SEPARATOR);
-							strcat(download_location, attachment->short_filename);
-							
-							fprintf(stderr, "- O arquivo '%s' não existe, ele será baixado\r\n", attachment->path);
-							printf("+ Baixando de '%s' para '%s'\r\n", attachment->url, download_location);
-							
-							struct FStream* const stream = fstream_open(download_location, FSTREAM_WRITE);
-							
-							if (stream == NULL) {
-								const struct SystemError error = get_system_error();
-								
-								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", attachment->path, error.message);
-								return EXIT_FAILURE;
-							}
-							
-							curl_easy_setopt(curl_easy, CURLOPT_URL, attachment->url);
-							curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, (void*) stream);
-							
-							const CURLcode code = curl_easy_perform_retry(curl_easy);
-							
-							erase_line();
-							
-							fstream_close(stream);
-							
-							if (code != CURLE_OK) {
-								remove_file(download_location);
-								
-								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar conectar com o servidor HTTP: %s\r\n", get_global_curl_error());
-								return EXIT_FAILURE;
-							}
-							
-							printf("+ Movendo arquivo de '%s' para '%s'\r\n", download_location, attachment->path);
-							
-							if (move_file(download_location, attachment->path) == -1) {
-								const struct SystemError error = get_system_error();
-								
-								remove_file(download_location);
-								
-								fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover o arquivo de '%s' para '%s': %s\r\n", download_location, attachment->path, error.message);
-								return EXIT_FAILURE;
-							}
-							
-							break;
+						
+						const int is_audio = media->audio.url != NULL && media->video.url == NULL;
+						
+						if (!statedb_complete(state, STATE_FILE, is_audio ? media->audio.id : media->video.id, media->path)) {
+							status = state_save(state, STATE_FILE, is_audio ? media->audio.id : media->video.id, media->path, is_audio ? media->audio.url : media->video.url, media->digest, media->size, NULL);
 						}
-						case -1: {
-							const struct SystemError error = get_system_error();
-							
-							fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar obter informações sobre o arquivo em '%s': %s\r\n", attachment->path, error.message);
-							return EXIT_FAILURE;
+						
+						if (status == -1) {
+							break;
 						}
 					}
+					
+					if (status == 0) {
+						status = state_save(state, STATE_PAGE, page->id, page->path, NULL, NULL, -1, NULL);
+					}
+					
+					if (status == -1) {
+						const struct SystemError error = get_system_error();
+						
+						fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o estado dos downloads em '%s': %s\r\n", state_file, error.message);
+						return -1;
+					}
 				}
-				
-				curl_easy_setopt(curl_easy, CURLOPT_URL, NULL);
-				curl_easy_setopt(curl_easy, CURLOPT_WRITEFUNCTION, NULL);
-				curl_easy_setopt(curl_easy, CURLOPT_WRITEDATA, NULL);
-				curl_easy_setopt(curl_easy, CURLOPT_NOPROGRESS, 1L);
-				curl_easy_setopt(curl_easy, CURLOPT_TIMEOUT, 60L);
-				curl_easy_setopt(curl_easy, CURLOPT_XFERINFOFUNCTION, NULL);
-				curl_easy_setopt(curl_easy, CURLOPT_FOLLOWLOCATION, 0L);
 			}
 		}
+		
+		statedb_close(state);
 	}
 	
-	for (size_t index = 0; index < queue_count; index++) {
+	for (size_t index = 0; index < queue.count; index++) {
 		struct Resource* const resource = &download_queue[index];
 		
-		json_t* jresource = json_object();
+		char filename[strlen(resource->path) + strlen(DOT) + strlen(JSON_FILE_EXTENSION) + 1];
+		strcpy(filename, resource->path);
+		strcat(filename, DOT);
+		strcat(filename, JSON_FILE_EXTENSION);
+		
+		/*
+		Pages that were downloaded by a previous run are skipped before their contents are fetched,
+		so what is known about them is taken from the tree that run exported, which is about to be
+		overwritten.
+		*/
+		json_auto_t* jprevious = NULL;
+		struct FStream* const previous = fstream_open(filename, FSTREAM_READ);
+		
+		if (previous != NULL) {
+			jprevious = json_load_callback(json_load_cb, (void*) previous, 0, NULL);
+			fstream_close(previous);
+		}
+		
+		json_auto_t* jresource = json_object();
 		json_object_set_new(jresource, "type", json_string("Resource"));
 		json_object_set_new(jresource, "id", json_string(resource->id));
 		json_object_set_new(jresource, "name", json_string(resource->name));
@@ -1900,7 +3278,7 @@ int main(void) {
 							json_object_set_new(jmedias, "items", jitems);
 							json_object_set_new(jpage, "medias", jmedias);
 						}
-								
+						
 						if (page->attachments.offset < 1) {
 							json_object_set_new(jpage, "attachments", json_null());
 						} else {
@@ -1927,6 +3305,14 @@ int main(void) {
 							json_object_set_new(jpage, "attachments", jattachments);
 						}
 						
+						json_t* const jold = page->is_complete ? previous_page(jprevious, page->id) : NULL;
+						
+						if (jold != NULL) {
+							json_object_set(jpage, "document", json_object_get(jold, "document"));
+							json_object_set(jpage, "medias", json_object_get(jold, "medias"));
+							json_object_set(jpage, "attachments", json_object_get(jold, "attachments"));
+						}
+						
 						json_object_set_new(jpage, "is_locked", page->is_locked ? json_true() : json_false());
 						json_object_set_new(jpage, "path", json_string(page->path));
 						
@@ -1948,11 +3334,6 @@ int main(void) {
 		
 		json_object_set_new(jresource, "path", json_string(resource->path));
 		
-		char filename[strlen(resource->path) + strlen(DOT) + strlen(JSON_FILE_EXTENSION) + 1];
-		strcpy(filename, resource->path);
-		strcat(filename, DOT);
-		strcat(filename, JSON_FILE_EXTENSION);
-		
 		printf("- Exportando árvore de objetos para '%s'\r\n", filename);
 		
 		struct FStream* const stream = fstream_open(filename, FSTREAM_WRITE);
@@ -1961,7 +3342,7 @@ int main(void) {
 			const struct SystemError error = get_system_error();
 			
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar criar o arquivo em '%s': %s\r\n", filename, error.message);
-			return EXIT_FAILURE;
+			return -1;
 		}
 		
 		const int code = json_dump_callback(jresource, json_dump_cb, (void*) stream, JSON_COMPACT);
@@ -1973,13 +3354,217 @@ int main(void) {
 			remove_file(filename);
 			
 			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar exportar a árvore de objetos para '%s': %s\r\n", filename, error.message);
-			return EXIT_FAILURE;
+			return -1;
 		}
 		
 		fstream_close(stream);
 		
 	}
 	
-	return EXIT_SUCCESS;
+	return 0;
+	
+}
+
+struct Lane {
+	const struct Job** jobs;
+	size_t count;
+	size_t failures;
+};
+
+static int lane_run(void* const data) {
+	/*
+	Runs the jobs of a single provider, one after another. Jobs of the same provider share its
+	configuration directory (saved accounts and the state of the downloads), so they never
+	run side by side.
+	
+	Returns (0) even if some of the jobs failed, so that the jobs of other providers are
+	still run; the failures are counted in the lane instead.
+	*/
+	
+	struct Lane* const lane = data;
+	
+	lane->failures = 0;
+	
+	for (size_t index = 0; index < lane->count; index++) {
+		const struct Job* const job = lane->jobs[index];
+		
+		printf("+ Executando tarefa do provedor '%s' (%zu/%zu)\r\n", job->provider, index + 1, lane->count);
+		
+		if (run_job(job, 1) != 0) {
+			fprintf(stderr, "- A tarefa do provedor '%s' (%zu/%zu) não foi concluída!\r\n", job->provider, index + 1, lane->count);
+			lane->failures++;
+		}
+		
+		// The next job may be of another account; it must not pick up the cookies of this one
+		free_global_curl();
+	}
+	
+	return 0;
+	
+}
+
+static int run_daemon(const struct Job* const defaults) {
+	/*
+	Runs the jobs listed in the daemon file from a single process. Jobs are grouped by provider
+	and the groups run side by side, up to the number of workers in the file; cURL handles are
+	per thread, but they share resolved host names, TLS sessions and connections (see curl.c),
+	and the connection limit (ARA_CONNECTIONS) is a budget of the whole process: a group takes
+	whatever part of it the others leave unused.
+	
+	Each group muxes its media on the workers of its own jobs, but FFmpeg is not safe to run on
+	several threads at once; ffmpeg_copy_inputs() takes a lock shared by the whole process, so
+	the copies of all groups still run one at a time.
+	
+	Returns (0) on success, (-1) if any of the jobs failed.
+	*/
+	
+	struct Daemon daemon __attribute__((__cleanup__(daemon_free))) = {0};
+	
+	if (daemon_load(&daemon, defaults) == -1) {
+		return -1;
+	}
+	
+	for (size_t index = 0; index < daemon.count; index++) {
+		const struct Job* const job = &daemon.jobs[index];
+		
+		if (find_provider(job->provider) == 0) {
+			fprintf(stderr, "- O provedor de serviços '%s' não existe ou não é suportado!\r\n", job->provider);
+			return -1;
+		}
+	}
+	
+	const struct Job* jobs[daemon.count];
+	struct Lane lanes[PROVIDERS_NUM];
+	
+	size_t lanes_count = 0;
+	size_t position = 0;
+	
+	for (size_t value = 1; value <= PROVIDERS_NUM; value++) {
+		struct Lane* const lane = &lanes[lanes_count];
+		
+		lane->jobs = &jobs[position];
+		lane->count = 0;
+		lane->failures = 0;
+		
+		for (size_t index = 0; index < daemon.count; index++) {
+			const struct Job* const job = &daemon.jobs[index];
+			
+			if (find_provider(job->provider) == value) {
+				jobs[position++] = job;
+				lane->count++;
+			}
+		}
+		
+		if (lane->count > 0) {
+			lanes_count++;
+		}
+	}
+	
+	const size_t workers = daemon.workers < lanes_count ? daemon.workers : lanes_count;
+	const size_t connections = get_env_size("ARA_CONNECTIONS", DAEMON_DEFAULT_CONNECTIONS);
+	
+	// Whatever cURL shares between threads must be set up before any of them starts
+	if (init_global_curl() == -1) {
+		return -1;
+	}
+	
+	set_global_curl_connections(connections < 1 ? 1 : (long) connections);
+	
+	while (1) {
+		struct ThreadPool pool = {0};
+		
+		if (threadpool_init(&pool, workers, lanes_count) != 0) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar alocar memória do sistema!\r\n");
+			return -1;
+		}
+		
+		for (size_t index = 0; index < lanes_count; index++) {
+			threadpool_submit(&pool, lane_run, NULL, &lanes[index]);
+		}
+		
+		threadpool_wait(&pool);
+		threadpool_free(&pool);
+		
+		size_t failures = 0;
+		
+		for (size_t index = 0; index < lanes_count; index++) {
+			failures += lanes[index].failures;
+		}
+		
+		if (daemon.interval == 0) {
+			return failures > 0 ? -1 : 0;
+		}
+		
+		if (failures > 0) {
+			fprintf(stderr, "- %zu de %zu tarefas não foram concluídas; elas serão executadas novamente na próxima sincronização\r\n", failures, daemon.count);
+		}
+		
+		printf("+ Aguardando %zu segundos até a próxima sincronização\r\n", daemon.interval);
+		
+		#ifdef _WIN32
+			Sleep((DWORD) (daemon.interval * 1000));
+		#else
+			sleep((unsigned int) daemon.interval);
+		#endif
+	}
+	
+}
+
+int main(int argc, argument_t* argv[]) {
+	
+	#if defined(_WIN32)
+		_setmaxstdio(2048);
+		
+		#if defined(_UNICODE)
+			_setmode(_fileno(stdout), _O_WTEXT);
+			_setmode(_fileno(stderr), _O_WTEXT);
+			_setmode(_fileno(stdin), _O_WTEXT);
+		#endif
+	#else
+		struct rlimit rlim = {0};
+		getrlimit(RLIMIT_NOFILE, &rlim);
+		
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+	#endif
+	
+	#ifndef __HAIKU__
+		if (is_administrator()) {
+			fprintf(stderr, "- Você não precisa e nem deve executar este programa com privilégios elevados!\r\n");
+			return EXIT_FAILURE;
+		}
+	#endif
+	
+	av_log_set_level(AV_LOG_ERROR);
+	
+	struct Job job __attribute__((__cleanup__(job_free))) = {0};
+	
+	switch (job_parse(&job, argc, argv)) {
+		case 0:
+			break;
+		case 1:
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+	}
+	
+	/*
+	If ARA_TRACE is set to a filename, the phases of the run and each of its transfers are
+	traced there in the Trace Event format of Chrome (it can be loaded into Perfetto).
+	*/
+	const char* const trace_target = getenv("ARA_TRACE");
+	
+	if (trace_target != NULL && *trace_target != '\0' && trace_open(trace_target) == -1) {
+		const struct SystemError error = get_system_error();
+		
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar abrir o arquivo de rastreamento em '%s': %s\r\n", trace_target, error.message);
+		return EXIT_FAILURE;
+	}
+	
+	if (job.daemon != NULL) {
+		return run_daemon(&job) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	
+	return run_job(&job, 0) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 	
 }
@@ -7,6 +7,7 @@
 
 #if !defined(_WIN32)
 	#include <unistd.h>
+	#include <time.h>
 #endif
 
 #include "symbols.h"
@@ -393,3 +394,26 @@ char* find_exe(const char* const name) {
 	return NULL;
 	
 }
+
+long long get_monotonic_clock(void) {
+	/*
+	Returns the time elapsed since an arbitrary point in the past, in microseconds. The clock
+	never goes backwards, so it is fit for measuring intervals.
+	*/
+	
+	#if defined(_WIN32)
+		LARGE_INTEGER frequency = {0};
+		LARGE_INTEGER counter = {0};
+		
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&counter);
+		
+		return (long long) ((counter.QuadPart / frequency.QuadPart) * 1000000 + ((counter.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+	#else
+		struct timespec now = {0};
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		
+		return (long long) now.tv_sec * 1000000 + (long long) now.tv_nsec / 1000;
+	#endif
+	
+}
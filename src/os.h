@@ -6,5 +6,6 @@ char* get_configuration_directory(void);
 char* get_temporary_directory(void);
 char* get_home_directory(void);
 char* find_exe(const char* const name);
+long long get_monotonic_clock(void);
 
 #pragma once
@@ -0,0 +1,351 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "progress.h"
+#include "fstream.h"
+#include "filesystem.h"
+#include "terminal.h"
+#include "errors.h"
+#include "os.h"
+#include "cleanup.h"
+
+/*
+Aggregated progress of the downloads of a job: bytes received and expected across every transfer,
+throughput (overall and per host), the number of running and queued transfers and an estimate
+of the time left.
+
+What is expected is only known as far as the transfers go: running transfers count by their
+size (when the server tells it), and queued ones by the average size of the transfers done so
+far. Transfers of resources not listed yet are not accounted for at all, so the total grows
+as the job goes on.
+
+The progress is shown in the terminal and may also be streamed, as one JSON object per line,
+to a file or to a file descriptor the process inherited.
+*/
+
+#define PROGRESS_SAMPLE_INTERVAL 1000000
+#define PROGRESS_RENDER_INTERVAL 250000
+#define PROGRESS_EMIT_INTERVAL 1000000
+
+// Weight of the newest sample in the smoothed rates
+#define PROGRESS_RATE_WEIGHT 0.3
+
+static const char PROGRESS_FD_PREFIX[] = "fd:";
+
+static const char* const SIZE_UNITS[] = {"B", "KB", "MB", "GB", "TB"};
+
+static void format_size(const double size, char* const destination, const size_t length) {
+	
+	double value = size;
+	size_t unit = 0;
+	
+	while (value >= 1024 && unit + 1 < sizeof(SIZE_UNITS) / sizeof(*SIZE_UNITS)) {
+		value /= 1024;
+		unit++;
+	}
+	
+	snprintf(destination, length, unit == 0 ? "%.0f %s" : "%.1f %s", value, SIZE_UNITS[unit]);
+	
+}
+
+static double progress_smooth(const double rate, const double sample) {
+	
+	return rate == 0 ? sample : rate * (1 - PROGRESS_RATE_WEIGHT) + sample * PROGRESS_RATE_WEIGHT;
+	
+}
+
+static void progress_estimate(const struct Progress* const progress, long long* const done, long long* const expected, long long* const eta) {
+	/*
+	Works out the bytes done and expected so far, and the number of seconds left at the
+	current rate; (-1) if that cannot be told yet.
+	*/
+	
+	const long long average = progress->completed == 0 ? 0 : progress->completed_bytes / (long long) progress->completed;
+	const long long left = progress->remaining + average * (long long) progress->queued;
+	
+	*done = progress->completed_bytes + progress->current;
+	*expected = *done + left;
+	*eta = (progress->rate < 1 || (left == 0 && progress->active + progress->queued > 0)) ? -1 : (long long) ((double) left / progress->rate);
+	
+}
+
+void progress_init(struct Progress* const progress, const char* const label, const int render) {
+	
+	memset(progress, 0, sizeof(*progress));
+	
+	progress->label = label;
+	progress->render = render;
+	progress->started = get_monotonic_clock();
+	progress->sampled_at = progress->started;
+	
+}
+
+int progress_open(struct Progress* const progress, const char* const target) {
+	/*
+	Streams the progress as JSON lines to the target, which is either the name of a file (appended
+	to, so that several jobs may share it) or "fd:" followed by the number of an inherited file
+	descriptor.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (strncmp(target, PROGRESS_FD_PREFIX, strlen(PROGRESS_FD_PREFIX)) == 0) {
+		const char* const value = target + strlen(PROGRESS_FD_PREFIX);
+		
+		char* end = NULL;
+		const long fd = strtol(value, &end, 10);
+		
+		if (*value == '\0' || *end != '\0' || fd < 0) {
+			return -1;
+		}
+		
+		progress->output = fstream_fdopen((int) fd);
+	} else {
+		progress->output = fstream_open(target, file_exists(target) == 1 ? FSTREAM_APPEND : FSTREAM_WRITE);
+	}
+	
+	return progress->output == NULL ? -1 : 0;
+	
+}
+
+size_t progress_host(struct Progress* const progress, const char* const name) {
+	/*
+	Looks up the host, adding it if it is not known yet.
+	
+	Returns its position within the hosts plus one, or (0) on error.
+	*/
+	
+	for (size_t index = 0; index < progress->hosts_count; index++) {
+		if (strcmp(progress->hosts[index].name, name) == 0) {
+			return index + 1;
+		}
+	}
+	
+	struct ProgressHost* const hosts = realloc(progress->hosts, (progress->hosts_count + 1) * sizeof(*hosts));
+	
+	if (hosts == NULL) {
+		return 0;
+	}
+	
+	progress->hosts = hosts;
+	
+	struct ProgressHost* const host = &progress->hosts[progress->hosts_count];
+	
+	memset(host, 0, sizeof(*host));
+	
+	host->name = malloc(strlen(name) + 1);
+	
+	if (host->name == NULL) {
+		return 0;
+	}
+	
+	strcpy(host->name, name);
+	
+	return ++progress->hosts_count;
+	
+}
+
+void progress_receive(struct Progress* const progress, const size_t host, const long long bytes) {
+	/*
+	Accounts for bytes received from the host (as returned by progress_host(); 0 if unknown).
+	*/
+	
+	progress->received += bytes;
+	
+	if (host != 0) {
+		progress->hosts[host - 1].received += bytes;
+	}
+	
+}
+
+void progress_complete(struct Progress* const progress, const long long size) {
+	/*
+	Accounts for a transfer that is done, along with the size of its contents.
+	*/
+	
+	progress->completed++;
+	progress->completed_bytes += size;
+	
+}
+
+static void progress_emit(struct Progress* const progress, const char* const event, const long long now) {
+	/*
+	Writes the progress as a line of JSON. If the line cannot be written, nothing else is.
+	*/
+	
+	long long done = 0;
+	long long expected = 0;
+	long long eta = 0;
+	
+	progress_estimate(progress, &done, &expected, &eta);
+	
+	json_auto_t* tree = json_object();
+	json_t* const hosts = json_array();
+	
+	if (tree == NULL || hosts == NULL) {
+		json_decref(hosts);
+		return;
+	}
+	
+	json_object_set_new(tree, "event", json_string(event));
+	json_object_set_new(tree, "job", progress->label == NULL ? json_null() : json_string(progress->label));
+	json_object_set_new(tree, "elapsed", json_real((double) (now - progress->started) / 1000000));
+	json_object_set_new(tree, "bytes", json_integer((json_int_t) done));
+	json_object_set_new(tree, "expected", json_integer((json_int_t) expected));
+	json_object_set_new(tree, "received", json_integer((json_int_t) progress->received));
+	json_object_set_new(tree, "rate", json_real(progress->rate));
+	json_object_set_new(tree, "eta", eta == -1 ? json_null() : json_integer((json_int_t) eta));
+	json_object_set_new(tree, "active", json_integer((json_int_t) progress->active));
+	json_object_set_new(tree, "queued", json_integer((json_int_t) progress->queued));
+	json_object_set_new(tree, "completed", json_integer((json_int_t) progress->completed));
+	
+	for (size_t index = 0; index < progress->hosts_count; index++) {
+		const struct ProgressHost* const host = &progress->hosts[index];
+		
+		json_t* const item = json_object();
+		
+		json_object_set_new(item, "host", json_string(host->name));
+		json_object_set_new(item, "bytes", json_integer((json_int_t) host->received));
+		json_object_set_new(item, "rate", json_real(host->rate));
+		
+		json_array_append_new(hosts, item);
+	}
+	
+	json_object_set_new(tree, "hosts", hosts);
+	
+	char* line __free__ = json_dumps(tree, JSON_COMPACT);
+	
+	if (line == NULL) {
+		return;
+	}
+	
+	// Written in one go, so that lines of jobs sharing the output do not interleave
+	const size_t length = strlen(line);
+	line[length] = '\n';
+	
+	const int status = fstream_write(progress->output, line, length + 1);
+	
+	if (status == -1 || fstream_flush(progress->output) == -1) {
+		const struct SystemError error = get_system_error();
+		
+		fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar exportar o progresso dos downloads: %s\r\n", error.message);
+		
+		fstream_close(progress->output);
+		progress->output = NULL;
+	}
+	
+	progress->emitted_at = now;
+	
+}
+
+static void progress_render(struct Progress* const progress, const long long now) {
+	
+	long long done = 0;
+	long long expected = 0;
+	long long eta = 0;
+	
+	progress_estimate(progress, &done, &expected, &eta);
+	
+	char done_size[32];
+	char expected_size[32];
+	char rate[32];
+	
+	format_size((double) done, done_size, sizeof(done_size));
+	format_size((double) expected, expected_size, sizeof(expected_size));
+	format_size(progress->rate, rate, sizeof(rate));
+	
+	const long long percentage = expected < 1 ? 0 : (done * 100) / expected;
+	
+	erase_line();
+	
+	printf("\r+ Baixados %s de %s (%lld%%) a %s/s; %zu em andamento, %zu na fila", done_size, expected_size, percentage, rate, progress->active, progress->queued);
+	
+	if (eta != -1) {
+		printf("; restam %02lld:%02lld:%02lld", eta / 3600, (eta / 60) % 60, eta % 60);
+	}
+	
+	printf("\r");
+	
+	fflush(stdout);
+	
+	progress->rendered_at = now;
+	
+}
+
+void progress_report(struct Progress* const progress, const long long current, const long long remaining, const size_t active, const size_t queued) {
+	/*
+	Updates the state of the running transfers: the bytes they received so far, the bytes those of
+	known size have yet to receive, how many of them are running and how many are waiting for
+	their turn. The progress is shown (and streamed) at most a few times per second.
+	*/
+	
+	progress->current = current;
+	progress->remaining = remaining;
+	progress->active = active;
+	progress->queued = queued;
+	
+	const long long now = get_monotonic_clock();
+	const long long elapsed = now - progress->sampled_at;
+	
+	if (elapsed >= PROGRESS_SAMPLE_INTERVAL) {
+		const double seconds = (double) elapsed / 1000000;
+		
+		progress->rate = progress_smooth(progress->rate, (double) (progress->received - progress->sampled) / seconds);
+		progress->sampled = progress->received;
+		
+		for (size_t index = 0; index < progress->hosts_count; index++) {
+			struct ProgressHost* const host = &progress->hosts[index];
+			
+			host->rate = progress_smooth(host->rate, (double) (host->received - host->sampled) / seconds);
+			host->sampled = host->received;
+		}
+		
+		progress->sampled_at = now;
+	}
+	
+	if (progress->render && now - progress->rendered_at >= PROGRESS_RENDER_INTERVAL) {
+		progress_render(progress, now);
+	}
+	
+	if (progress->output != NULL && now - progress->emitted_at >= PROGRESS_EMIT_INTERVAL) {
+		progress_emit(progress, "progress", now);
+	}
+	
+}
+
+void progress_finish(struct Progress* const progress) {
+	/*
+	Streams the final state of the progress, once every transfer of the job is done.
+	*/
+	
+	progress->current = 0;
+	progress->remaining = 0;
+	progress->active = 0;
+	progress->queued = 0;
+	
+	if (progress->output != NULL) {
+		progress_emit(progress, "finish", get_monotonic_clock());
+	}
+	
+}
+
+void progress_free(struct Progress* const progress) {
+	
+	for (size_t index = 0; index < progress->hosts_count; index++) {
+		free(progress->hosts[index].name);
+	}
+	
+	free(progress->hosts);
+	
+	if (progress->output != NULL) {
+		fstream_close(progress->output);
+	}
+	
+	progress->hosts = NULL;
+	progress->hosts_count = 0;
+	progress->output = NULL;
+	
+}
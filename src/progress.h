@@ -0,0 +1,42 @@
+#include <stdlib.h>
+
+#include "fstream.h"
+
+struct ProgressHost {
+	char* name;
+	long long received; /* Bytes received from the host so far */
+	long long sampled; /* Bytes received from the host as of the last sample */
+	double rate; /* Bytes per second, smoothed over the last samples */
+};
+
+struct Progress {
+	const char* label; /* Identifies the job in the JSON lines (e.g., its provider) */
+	int render; /* Whether the progress is shown in the terminal */
+	struct FStream* output; /* Where the JSON lines go, if anywhere */
+	long long started; /* Times are in microseconds (see get_monotonic_clock()) */
+	long long sampled_at;
+	long long rendered_at;
+	long long emitted_at;
+	long long received; /* Bytes received so far, over every transfer (retries included) */
+	long long sampled; /* Bytes received as of the last sample */
+	double rate; /* Bytes per second, smoothed over the last samples */
+	size_t completed; /* Number of transfers done */
+	long long completed_bytes; /* Bytes received by the transfers done */
+	long long current; /* Bytes received by the running transfers */
+	long long remaining; /* Bytes the running transfers of known size have yet to receive */
+	size_t active; /* Number of running transfers */
+	size_t queued; /* Number of transfers waiting for their turn */
+	struct ProgressHost* hosts;
+	size_t hosts_count;
+};
+
+void progress_init(struct Progress* const progress, const char* const label, const int render);
+int progress_open(struct Progress* const progress, const char* const target);
+size_t progress_host(struct Progress* const progress, const char* const name);
+void progress_receive(struct Progress* const progress, const size_t host, const long long bytes);
+void progress_complete(struct Progress* const progress, const long long size);
+void progress_report(struct Progress* const progress, const long long current, const long long remaining, const size_t active, const size_t queued);
+void progress_finish(struct Progress* const progress);
+void progress_free(struct Progress* const progress);
+
+#pragma once
@@ -4,59 +4,46 @@
 
 #include "symbols.h"
 #include "readlines.h"
+#include "scan.h"
 
-void readlines_init(struct ReadLines* const readlines, const char* const s) {
+void readlines_init(struct ReadLines* const readlines, const char* const s, const size_t size) {
 	
 	readlines->s = s;
-	readlines->send = strchr(readlines->s, '\0');
+	readlines->send = s + size;
 	
 	readlines->lbegin = readlines->s;
-	readlines->lend = strstr(readlines->lbegin, LF);
+	readlines->lend = scan_byte(readlines->lbegin, readlines->send, *LF);
 	
 }
 
 const struct Line* readlines_next(struct ReadLines* const readlines, struct Line* const line) {
+	/*
+	Blank lines are reported with a size of zero. The last line is reported even
+	when it is not followed by a line feed.
+	*/
+	
+	if (readlines->lbegin > readlines->send) {
+		return NULL;
+	}
 	
 	if (readlines->lend == NULL) {
 		readlines->lend = readlines->send;
 	}
 	
-	const size_t line_size = (size_t) (readlines->lend - readlines->lbegin);
+	const char* start = readlines->lbegin;
+	const char* end = readlines->lend;
 	
-	if (line_size > 0) {
-		const char* start = readlines->lbegin;
-		const char* end = readlines->lend;
-		
-		while (start != end) {
-			const char ch = *start;
-			
-			if (!isspace(ch)) {
-				break;
-			}
-			
-			start++;
-		}
-		
-		end--;
-		
-		while (end != start) {
-			if (!isspace(*end)) {
-				break;
-			}
-			
-			end--;
-		}
-		
-		if (end != start) {
-			line->begin = start;
-			line->size = ((size_t) (end - start)) + 1;
-		}
+	while (start != end && isspace((unsigned char) *start)) {
+		start++;
 	}
 	
-	if (readlines->lend == readlines->send) {
-		return NULL;
+	while (end != start && isspace((unsigned char) *(end - 1))) {
+		end--;
 	}
 	
+	line->begin = start;
+	line->size = (size_t) (end - start);
+	
 	if (readlines->lbegin != readlines->s) {
 		line->index++;
 	}
@@ -64,9 +51,10 @@ const struct Line* readlines_next(struct ReadLines* const readlines, struct Line
 	readlines->lbegin = readlines->lend;
 	readlines->lbegin++;
 	
-	readlines->lend = strstr(readlines->lbegin, LF);
+	if (readlines->lbegin <= readlines->send) {
+		readlines->lend = scan_byte(readlines->lbegin, readlines->send, *LF);
+	}
 	
 	return line;
 	
 }
-		
\ No newline at end of file
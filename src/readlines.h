@@ -11,7 +11,7 @@ struct Line {
 	const char* begin;
 };
 
-void readlines_init(struct ReadLines* const readlines, const char* const s);
+void readlines_init(struct ReadLines* const readlines, const char* const s, const size_t size);
 const struct Line* readlines_next(struct ReadLines* const readlines, struct Line* const line);
 
 #pragma once
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+
+#include "resources.h"
+
+static void attachments_free(struct Attachments* const attachments) {
+	
+	for (size_t index = 0; index < attachments->offset; index++) {
+		struct Attachment* const attachment = &attachments->items[index];
+		
+		free(attachment->id);
+		free(attachment->filename);
+		free(attachment->short_filename);
+		free(attachment->url);
+		free(attachment->path);
+	}
+	
+	free(attachments->items);
+	
+	attachments->items = NULL;
+	attachments->offset = 0;
+	attachments->size = 0;
+	
+}
+
+static void medias_free(struct Medias* const medias) {
+	
+	for (size_t index = 0; index < medias->offset; index++) {
+		struct Media* const media = &medias->items[index];
+		
+		free(media->audio.id);
+		free(media->audio.filename);
+		free(media->audio.short_filename);
+		free(media->audio.url);
+		
+		free(media->video.id);
+		free(media->video.filename);
+		free(media->video.short_filename);
+		free(media->video.url);
+		
+		free(media->path);
+		free(media->uri);
+		free(media->digest);
+	}
+	
+	free(medias->items);
+	
+	medias->items = NULL;
+	medias->offset = 0;
+	medias->size = 0;
+	
+}
+
+static void pages_free(struct Pages* const pages) {
+	
+	for (size_t index = 0; index < pages->offset; index++) {
+		struct Page* const page = &pages->items[index];
+		
+		free(page->id);
+		free(page->name);
+		free(page->dirname);
+		free(page->short_dirname);
+		
+		free(page->document.id);
+		free(page->document.filename);
+		free(page->document.short_filename);
+		free(page->document.content);
+		free(page->document.path);
+		
+		medias_free(&page->medias);
+		attachments_free(&page->attachments);
+		
+		free(page->path);
+		free(page->url);
+	}
+	
+	free(pages->items);
+	
+	pages->items = NULL;
+	pages->offset = 0;
+	pages->size = 0;
+	
+}
+
+void modules_free(struct Modules* const modules) {
+	
+	for (size_t index = 0; index < modules->offset; index++) {
+		struct Module* const module = &modules->items[index];
+		
+		free(module->id);
+		free(module->name);
+		free(module->dirname);
+		free(module->short_dirname);
+		
+		attachments_free(&module->attachments);
+		pages_free(&module->pages);
+		
+		free(module->path);
+	}
+	
+	free(modules->items);
+	
+	modules->items = NULL;
+	modules->offset = 0;
+	modules->size = 0;
+	
+}
+
+void resources_free(struct Resources* const resources) {
+	
+	for (size_t index = 0; index < resources->offset; index++) {
+		struct Resource* const resource = &resources->items[index];
+		
+		free(resource->id);
+		free(resource->name);
+		free(resource->dirname);
+		free(resource->short_dirname);
+		free(resource->url);
+		
+		free(resource->qualification.id);
+		free(resource->qualification.name);
+		free(resource->qualification.dirname);
+		free(resource->qualification.short_dirname);
+		
+		modules_free(&resource->modules);
+		
+		free(resource->path);
+	}
+	
+	free(resources->items);
+	
+	resources->items = NULL;
+	resources->offset = 0;
+	resources->size = 0;
+	
+}
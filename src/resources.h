@@ -25,6 +25,8 @@ struct Media {
 	struct VideoStream video;
 	char* path;
 	char* uri;
+	char* digest; /* SHA-256 of the file (in hex), once it is in place; NULL if not wanted */
+	long long size; /* Size of the file, once in place; (-1) if not known */
 };
 
 struct Medias {
@@ -64,6 +66,7 @@ struct Page {
 	struct Medias medias;
 	struct Attachments attachments;
 	int is_locked;
+	int is_complete;
 	char* path;
 	char* url;
 };
@@ -115,4 +118,7 @@ struct Resources {
 	struct Resource* items;
 };
 
+void modules_free(struct Modules* const modules);
+void resources_free(struct Resources* const resources);
+
 #pragma once
@@ -0,0 +1,81 @@
+#if defined(__linux__)
+	#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+
+/*
+Helpers for scanning chunks of text (playlists, HTML pages, JSON documents) that are delimited by
+their end rather than by a NUL terminator.
+
+They are thin wrappers around the C library, whose memchr() (and memmem(), where there is one) is
+already vectorized on the platforms that matter; hand-written kernels did not beat it.
+*/
+
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__HAIKU__) || defined(__ANDROID__)
+	#define SCAN_MEMMEM
+#endif
+
+const char* scan_byte(const char* const s, const char* const end, const char ch) {
+	/*
+	Returns a pointer to the first occurrence of the character within [s, end), or a null pointer
+	if there is none.
+	*/
+	
+	return (const char*) memchr(s, ch, (size_t) (end - s));
+	
+}
+
+size_t scan_count(const char* s, const char* const end, const char ch) {
+	/*
+	Returns the number of occurrences of the character within [s, end).
+	*/
+	
+	size_t count = 0;
+	
+	// Kept free of branches, so that the compiler is free to vectorize it
+	while (s != end) {
+		count += (*s == ch);
+		s++;
+	}
+	
+	return count;
+	
+}
+
+const char* scan_find(const char* s, const char* const end, const char* const needle) {
+	/*
+	Returns a pointer to the first occurrence of the needle within [s, end), or a null pointer
+	if there is none.
+	*/
+	
+	const size_t size = strlen(needle);
+	
+	if (size == 0) {
+		return s;
+	}
+	
+	#if defined(SCAN_MEMMEM)
+		return (const char*) memmem(s, (size_t) (end - s), needle, size);
+	#else
+		while ((size_t) (end - s) >= size) {
+			const char* const candidate = (const char*) memchr(s, *needle, (size_t) (end - s) - size + 1);
+			
+			if (candidate == NULL) {
+				return NULL;
+			}
+			
+			if (memcmp(candidate, needle, size) == 0) {
+				return candidate;
+			}
+			
+			s = candidate + 1;
+		}
+		
+		return NULL;
+	#endif
+	
+}
@@ -0,0 +1,7 @@
+#include <stdlib.h>
+
+const char* scan_byte(const char* const s, const char* const end, const char ch);
+size_t scan_count(const char* const s, const char* const end, const char ch);
+const char* scan_find(const char* const s, const char* const end, const char* const needle);
+
+#pragma once
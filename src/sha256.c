@@ -0,0 +1,391 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#define HAVE_SHA256_X86 1
+#endif
+
+#if defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO) || defined(__linux__) || defined(__APPLE__))
+	#define HAVE_SHA256_ARM 1
+#endif
+
+#if defined(HAVE_SHA256_X86)
+	#include <cpuid.h>
+	#include <immintrin.h>
+#endif
+
+#if defined(HAVE_SHA256_ARM)
+	#include <arm_neon.h>
+	
+	#if defined(__linux__)
+		#include <sys/auxv.h>
+		#include <asm/hwcap.h>
+	#endif
+#endif
+
+#include "sha256.h"
+#include "fstream.h"
+
+/*
+SHA-256 on top of the SHA instructions of x86 (SHA-NI) and ARMv8 (the Cryptography Extension),
+which hash several times faster than plain C. On CPUs that lack them, this falls back to BearSSL.
+*/
+
+static const uint32_t SHA256_INITIAL_STATE[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#if defined(HAVE_SHA256_X86) || defined(HAVE_SHA256_ARM)
+	static const uint32_t SHA256_ROUND_CONSTANTS[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+#endif
+
+#if defined(HAVE_SHA256_X86)
+	__attribute__((__target__("sha,sse4.1"))) static void sha256_compress_x86(uint32_t* const state, const unsigned char* data, size_t blocks) {
+		/*
+		Hashes the blocks with SHA-NI. Each iteration of the inner loop does four rounds, while
+		extending the message schedule for the iterations ahead.
+		*/
+		
+		const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		
+		__m128i temporary = _mm_loadu_si128((const __m128i*) &state[0]);
+		__m128i state1 = _mm_loadu_si128((const __m128i*) &state[4]);
+		
+		// The instructions want the state as ABEF/CDGH rather than ABCD/EFGH
+		temporary = _mm_shuffle_epi32(temporary, 0xb1);
+		state1 = _mm_shuffle_epi32(state1, 0x1b);
+		
+		__m128i state0 = _mm_alignr_epi8(temporary, state1, 8);
+		state1 = _mm_blend_epi16(state1, temporary, 0xf0);
+		
+		while (blocks-- > 0) {
+			const __m128i abef = state0;
+			const __m128i cdgh = state1;
+			
+			__m128i messages[4];
+			
+			for (size_t group = 0; group < 16; group++) {
+				if (group < 4) {
+					messages[group] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + group * 16)), mask);
+				}
+				
+				const __m128i current = messages[group & 3];
+				
+				__m128i message = _mm_add_epi32(current, _mm_loadu_si128((const __m128i*) &SHA256_ROUND_CONSTANTS[group * 4]));
+				state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+				
+				if (group >= 3 && group <= 14) {
+					__m128i* const next = &messages[(group + 1) & 3];
+					
+					*next = _mm_add_epi32(*next, _mm_alignr_epi8(current, messages[(group - 1) & 3], 4));
+					*next = _mm_sha256msg2_epu32(*next, current);
+				}
+				
+				message = _mm_shuffle_epi32(message, 0x0e);
+				state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+				
+				if (group >= 1 && group <= 12) {
+					messages[(group - 1) & 3] = _mm_sha256msg1_epu32(messages[(group - 1) & 3], current);
+				}
+			}
+			
+			state0 = _mm_add_epi32(state0, abef);
+			state1 = _mm_add_epi32(state1, cdgh);
+			
+			data += 64;
+		}
+		
+		temporary = _mm_shuffle_epi32(state0, 0x1b);
+		state1 = _mm_shuffle_epi32(state1, 0xb1);
+		state0 = _mm_blend_epi16(temporary, state1, 0xf0);
+		state1 = _mm_alignr_epi8(state1, temporary, 8);
+		
+		_mm_storeu_si128((__m128i*) &state[0], state0);
+		_mm_storeu_si128((__m128i*) &state[4], state1);
+		
+	}
+	
+	static int sha256_x86_supported(void) {
+		/*
+		Checks whether the CPU supports SHA-NI (along with the SSE4.1 and SSSE3 instructions used around it).
+		*/
+		
+		unsigned int eax = 0;
+		unsigned int ebx = 0;
+		unsigned int ecx = 0;
+		unsigned int edx = 0;
+		
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)) {
+			return 0;
+		}
+		
+		if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+			return 0;
+		}
+		
+		return (ebx & (1 << 29)) != 0;
+		
+	}
+#endif
+
+#if defined(HAVE_SHA256_ARM)
+	#if defined(__clang__)
+		#define SHA256_ARM_TARGET __attribute__((__target__("crypto")))
+	#else
+		#define SHA256_ARM_TARGET __attribute__((__target__("+crypto")))
+	#endif
+	
+	SHA256_ARM_TARGET static void sha256_compress_arm(uint32_t* const state, const unsigned char* data, size_t blocks) {
+		/*
+		Hashes the blocks with the ARMv8 Cryptography Extension. Each iteration of the inner loop
+		does four rounds, while extending the message schedule for the iterations ahead.
+		*/
+		
+		uint32x4_t state0 = vld1q_u32(&state[0]);
+		uint32x4_t state1 = vld1q_u32(&state[4]);
+		
+		while (blocks-- > 0) {
+			const uint32x4_t abcd = state0;
+			const uint32x4_t efgh = state1;
+			
+			uint32x4_t messages[4];
+			
+			for (size_t group = 0; group < 4; group++) {
+				messages[group] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + group * 16)));
+			}
+			
+			for (size_t group = 0; group < 16; group++) {
+				const uint32x4_t current = messages[group & 3];
+				const uint32x4_t message = vaddq_u32(current, vld1q_u32(&SHA256_ROUND_CONSTANTS[group * 4]));
+				
+				if (group < 12) {
+					messages[group & 3] = vsha256su1q_u32(vsha256su0q_u32(current, messages[(group + 1) & 3]), messages[(group + 2) & 3], messages[(group + 3) & 3]);
+				}
+				
+				const uint32x4_t previous = state0;
+				
+				state0 = vsha256hq_u32(state0, state1, message);
+				state1 = vsha256h2q_u32(state1, previous, message);
+			}
+			
+			state0 = vaddq_u32(state0, abcd);
+			state1 = vaddq_u32(state1, efgh);
+			
+			data += 64;
+		}
+		
+		vst1q_u32(&state[0], state0);
+		vst1q_u32(&state[4], state1);
+		
+	}
+	
+	static int sha256_arm_supported(void) {
+		/*
+		Checks whether the CPU supports the SHA-256 instructions of the Cryptography Extension.
+		*/
+		
+		#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO) || defined(__APPLE__)
+			return 1;
+		#else
+			return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+		#endif
+		
+	}
+#endif
+
+void sha256_init(struct SHA256* const context) {
+	/*
+	Starts a new hash, picking the fastest implementation the CPU supports.
+	*/
+	
+	memset(context, 0, sizeof(*context));
+	
+	#if defined(HAVE_SHA256_X86)
+		if (sha256_x86_supported()) {
+			context->compress = sha256_compress_x86;
+		}
+	#endif
+	
+	#if defined(HAVE_SHA256_ARM)
+		if (sha256_arm_supported()) {
+			context->compress = sha256_compress_arm;
+		}
+	#endif
+	
+	if (context->compress == NULL) {
+		br_sha256_init(&context->fallback);
+		return;
+	}
+	
+	memcpy(context->state, SHA256_INITIAL_STATE, sizeof(context->state));
+	
+}
+
+void sha256_update(struct SHA256* const context, const void* const data, const size_t size) {
+	
+	if (context->compress == NULL) {
+		br_sha256_update(&context->fallback, data, size);
+		return;
+	}
+	
+	const unsigned char* input = (const unsigned char*) data;
+	size_t remaining = size;
+	
+	context->length += size;
+	
+	// Complete the block left over from the last update first
+	if (context->used > 0) {
+		const size_t count = (remaining < sizeof(context->block) - context->used) ? remaining : sizeof(context->block) - context->used;
+		
+		memcpy(context->block + context->used, input, count);
+		
+		context->used += count;
+		input += count;
+		remaining -= count;
+		
+		if (context->used < sizeof(context->block)) {
+			return;
+		}
+		
+		(*context->compress)(context->state, context->block, 1);
+		
+		context->used = 0;
+	}
+	
+	// Whole blocks are hashed straight from the input
+	const size_t blocks = remaining / sizeof(context->block);
+	
+	if (blocks > 0) {
+		(*context->compress)(context->state, input, blocks);
+		
+		input += blocks * sizeof(context->block);
+		remaining -= blocks * sizeof(context->block);
+	}
+	
+	memcpy(context->block, input, remaining);
+	context->used = remaining;
+	
+}
+
+void sha256_final(struct SHA256* const context, unsigned char* const digest) {
+	/*
+	Writes out the digest (SHA256_DIGEST_SIZE bytes). The context must be initialized again
+	before being reused.
+	*/
+	
+	if (context->compress == NULL) {
+		br_sha256_out(&context->fallback, digest);
+		return;
+	}
+	
+	const uint64_t bits = context->length * 8;
+	
+	// The message is padded with a single set bit, then zeros up to the length (in bits) at the end of a block
+	context->block[context->used++] = 0x80;
+	
+	if (context->used > sizeof(context->block) - 8) {
+		memset(context->block + context->used, 0, sizeof(context->block) - context->used);
+		(*context->compress)(context->state, context->block, 1);
+		
+		context->used = 0;
+	}
+	
+	memset(context->block + context->used, 0, sizeof(context->block) - 8 - context->used);
+	
+	for (size_t index = 0; index < 8; index++) {
+		context->block[sizeof(context->block) - 1 - index] = (unsigned char) (bits >> (index * 8));
+	}
+	
+	(*context->compress)(context->state, context->block, 1);
+	
+	for (size_t index = 0; index < 8; index++) {
+		digest[index * 4 + 0] = (unsigned char) (context->state[index] >> 24);
+		digest[index * 4 + 1] = (unsigned char) (context->state[index] >> 16);
+		digest[index * 4 + 2] = (unsigned char) (context->state[index] >> 8);
+		digest[index * 4 + 3] = (unsigned char) (context->state[index]);
+	}
+	
+}
+
+void sha256_hex(const unsigned char* const digest, char* const output) {
+	/*
+	Formats the digest as lowercase hexadecimal. The output must have room for SHA256_HEX_SIZE
+	characters (the null terminator included).
+	*/
+	
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+	
+	for (size_t index = 0; index < SHA256_DIGEST_SIZE; index++) {
+		output[index * 2 + 0] = HEX_DIGITS[digest[index] >> 4];
+		output[index * 2 + 1] = HEX_DIGITS[digest[index] & 0x0f];
+	}
+	
+	output[SHA256_DIGEST_SIZE * 2] = '\0';
+	
+}
+
+#define SHA256_BUFFER_SIZE (1024 * 256)
+
+int sha256_file(const char* const filename, unsigned char* const digest) {
+	/*
+	Hashes the contents of a file, a block at a time; files hashed here are media files that may
+	be far larger than what can be mapped (or kept in memory) at once.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct FStream* const stream = fstream_open(filename, FSTREAM_READ);
+	
+	if (stream == NULL) {
+		return -1;
+	}
+	
+	char* const buffer = malloc(SHA256_BUFFER_SIZE);
+	
+	if (buffer == NULL) {
+		fstream_close(stream);
+		return -1;
+	}
+	
+	struct SHA256 context = {0};
+	
+	sha256_init(&context);
+	
+	while (1) {
+		const ssize_t size = fstream_read(stream, buffer, SHA256_BUFFER_SIZE);
+		
+		if (size == -1) {
+			free(buffer);
+			fstream_close(stream);
+			return -1;
+		}
+		
+		if (size == 0) {
+			break;
+		}
+		
+		sha256_update(&context, buffer, (size_t) size);
+	}
+	
+	free(buffer);
+	
+	if (fstream_close(stream) == -1) {
+		return -1;
+	}
+	
+	sha256_final(&context, digest);
+	
+	return 0;
+	
+}
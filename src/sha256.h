@@ -0,0 +1,24 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <bearssl.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+struct SHA256 {
+	void (*compress)(uint32_t* const state, const unsigned char* data, size_t blocks); /* NULL if the CPU lacks SHA instructions */
+	br_sha256_context fallback; /* Used instead when compress is NULL */
+	uint32_t state[8];
+	unsigned char block[64];
+	size_t used; /* Number of bytes waiting in the block */
+	uint64_t length; /* Number of bytes hashed so far */
+};
+
+void sha256_init(struct SHA256* const context);
+void sha256_update(struct SHA256* const context, const void* const data, const size_t size);
+void sha256_final(struct SHA256* const context, unsigned char* const digest);
+void sha256_hex(const unsigned char* const digest, char* const output);
+int sha256_file(const char* const filename, unsigned char* const digest);
+
+#pragma once
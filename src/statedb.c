@@ -0,0 +1,483 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "statedb.h"
+#include "cleanup.h"
+#include "filesystem.h"
+#include "symbols.h"
+
+/*
+A record of every item (page or file) that was completely downloaded, kept across runs.
+
+Records are appended to a log, one JSON object per line, as items are completed; the log is read
+back into a table when opened, with later records taking the place of earlier ones for the same
+item. Once superseded records make up most of the log (or the tail of it was cut short by a crash),
+it gets rewritten with just the records that are current.
+*/
+
+#define STATEDB_MINIMUM_SIZE 1024
+#define STATEDB_COMPACT_THRESHOLD 1024
+
+static const char* const STATE_KINDS[] = {
+	"page",
+	"file"
+};
+
+static size_t statedb_hash(const enum StateKind kind, const char* const path) {
+	/*
+	FNV-1a, seeded with the kind.
+	*/
+	
+	size_t hash = (size_t) 14695981039346656037ULL;
+	
+	hash ^= (size_t) kind;
+	hash *= (size_t) 1099511628211ULL;
+	
+	for (const unsigned char* ch = (const unsigned char*) path; *ch != '\0'; ch++) {
+		hash ^= *ch;
+		hash *= (size_t) 1099511628211ULL;
+	}
+	
+	return hash;
+	
+}
+
+static struct StateRecord* statedb_slot(struct StateRecord* const items, const size_t size, const enum StateKind kind, const char* const path, const size_t hash) {
+	/*
+	Returns the slot holding the record, or the empty slot where it would go.
+	*/
+	
+	size_t position = hash & (size - 1);
+	
+	while (1) {
+		struct StateRecord* const record = &items[position];
+		
+		if (record->path == NULL || (record->hash == hash && record->kind == kind && strcmp(record->path, path) == 0)) {
+			return record;
+		}
+		
+		position = (position + 1) & (size - 1);
+	}
+	
+}
+
+static int statedb_grow(struct StateDB* const db) {
+	
+	const size_t size = (db->size == 0) ? STATEDB_MINIMUM_SIZE : db->size * 2;
+	struct StateRecord* const items = calloc(size, sizeof(*items));
+	
+	if (items == NULL) {
+		return -1;
+	}
+	
+	for (size_t position = 0; position < db->size; position++) {
+		const struct StateRecord* const record = &db->items[position];
+		
+		if (record->path == NULL) {
+			continue;
+		}
+		
+		*statedb_slot(items, size, record->kind, record->path, record->hash) = *record;
+	}
+	
+	free(db->items);
+	
+	db->items = items;
+	db->size = size;
+	
+	return 0;
+	
+}
+
+static char* statedb_strdup(const char* const value) {
+	
+	if (value == NULL) {
+		return NULL;
+	}
+	
+	char* const copy = malloc(strlen(value) + 1);
+	
+	if (copy == NULL) {
+		return NULL;
+	}
+	
+	strcpy(copy, value);
+	
+	return copy;
+	
+}
+
+static void statedb_record_free(struct StateRecord* const record) {
+	
+	free(record->id);
+	free(record->path);
+	free(record->url);
+	free(record->validator);
+	free(record->digest);
+	
+	memset(record, 0, sizeof(*record));
+	
+}
+
+static int statedb_insert(struct StateDB* const db, const struct StateRecord* const record) {
+	/*
+	Copies the record into the table, replacing whatever was there for the same item.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	// Keep the load factor under 3/4
+	if ((db->count + 1) * 4 > db->size * 3 && statedb_grow(db) == -1) {
+		return -1;
+	}
+	
+	struct StateRecord copy = {
+		.kind = record->kind,
+		.id = statedb_strdup(record->id),
+		.path = statedb_strdup(record->path),
+		.url = statedb_strdup(record->url),
+		.size = record->size,
+		.validator = statedb_strdup(record->validator),
+		.digest = statedb_strdup(record->digest),
+		.hash = statedb_hash(record->kind, record->path)
+	};
+	
+	if (copy.id == NULL || copy.path == NULL || (record->url != NULL && copy.url == NULL) || (record->validator != NULL && copy.validator == NULL) || (record->digest != NULL && copy.digest == NULL)) {
+		statedb_record_free(&copy);
+		return -1;
+	}
+	
+	struct StateRecord* const slot = statedb_slot(db->items, db->size, copy.kind, copy.path, copy.hash);
+	
+	if (slot->path == NULL) {
+		db->count++;
+	} else {
+		statedb_record_free(slot);
+	}
+	
+	*slot = copy;
+	
+	return 0;
+	
+}
+
+static int statedb_parse(struct StateDB* const db, const char* const line, const size_t size) {
+	/*
+	Parses a line of the log and adds its record to the table.
+	
+	Returns (0) on success, (1) if the line is not a valid record, (-1) on error.
+	*/
+	
+	json_auto_t* tree = json_loadb(line, size, 0, NULL);
+	
+	if (tree == NULL || !json_is_object(tree)) {
+		return 1;
+	}
+	
+	const json_t* const kind = json_object_get(tree, "kind");
+	const json_t* const id = json_object_get(tree, "id");
+	const json_t* const path = json_object_get(tree, "path");
+	const json_t* const url = json_object_get(tree, "url");
+	const json_t* const fsize = json_object_get(tree, "size");
+	const json_t* const validator = json_object_get(tree, "validator");
+	const json_t* const digest = json_object_get(tree, "digest");
+	
+	if (!(json_is_string(kind) && json_is_string(id) && json_is_string(path))) {
+		return 1;
+	}
+	
+	struct StateRecord record = {
+		.id = (char*) json_string_value(id),
+		.path = (char*) json_string_value(path),
+		.url = json_is_string(url) ? (char*) json_string_value(url) : NULL,
+		.size = json_is_integer(fsize) ? (long long) json_integer_value(fsize) : -1,
+		.validator = json_is_string(validator) ? (char*) json_string_value(validator) : NULL,
+		.digest = json_is_string(digest) ? (char*) json_string_value(digest) : NULL
+	};
+	
+	size_t index = 0;
+	
+	for (; index < sizeof(STATE_KINDS) / sizeof(*STATE_KINDS); index++) {
+		if (strcmp(json_string_value(kind), STATE_KINDS[index]) == 0) {
+			break;
+		}
+	}
+	
+	if (index == sizeof(STATE_KINDS) / sizeof(*STATE_KINDS)) {
+		return 1;
+	}
+	
+	record.kind = (enum StateKind) index;
+	
+	return statedb_insert(db, &record);
+	
+}
+
+static int statedb_write(struct FStream* const stream, const struct StateRecord* const record) {
+	/*
+	Appends a record to the log.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	json_auto_t* tree = json_object();
+	
+	if (tree == NULL) {
+		return -1;
+	}
+	
+	json_object_set_new(tree, "kind", json_string(STATE_KINDS[record->kind]));
+	json_object_set_new(tree, "id", json_string(record->id));
+	json_object_set_new(tree, "path", json_string(record->path));
+	json_object_set_new(tree, "url", record->url == NULL ? json_null() : json_string(record->url));
+	json_object_set_new(tree, "size", record->size == -1 ? json_null() : json_integer((json_int_t) record->size));
+	json_object_set_new(tree, "validator", record->validator == NULL ? json_null() : json_string(record->validator));
+	json_object_set_new(tree, "digest", record->digest == NULL ? json_null() : json_string(record->digest));
+	
+	char* line __free__ = json_dumps(tree, JSON_COMPACT);
+	
+	if (line == NULL) {
+		return -1;
+	}
+	
+	if (fstream_write(stream, line, strlen(line)) == -1 || fstream_write(stream, "\n", 1) == -1) {
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+static int statedb_compact(struct StateDB* const db) {
+	/*
+	Rewrites the log with only the records that are current. The new log is written aside and
+	then moved over the old one, so that a crash halfway through loses nothing.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	char filename[strlen(db->filename) + strlen(DOT) + strlen("tmp") + 1];
+	strcpy(filename, db->filename);
+	strcat(filename, DOT);
+	strcat(filename, "tmp");
+	
+	struct FStream* const stream = fstream_open(filename, FSTREAM_WRITE);
+	
+	if (stream == NULL) {
+		return -1;
+	}
+	
+	for (size_t position = 0; position < db->size; position++) {
+		const struct StateRecord* const record = &db->items[position];
+		
+		// Items that are no longer complete are simply left out
+		if (record->path == NULL || *record->id == '\0') {
+			continue;
+		}
+		
+		if (statedb_write(stream, record) == -1) {
+			fstream_close(stream);
+			remove_file(filename);
+			
+			return -1;
+		}
+	}
+	
+	if (fstream_close(stream) == -1 || move_file(filename, db->filename) == -1) {
+		remove_file(filename);
+		return -1;
+	}
+	
+	db->lines = db->count;
+	
+	return 0;
+	
+}
+
+static int statedb_load(struct StateDB* const db) {
+	/*
+	Reads the log into the table.
+	
+	Returns the number of lines that could not be parsed, or (-1) on error.
+	*/
+	
+	struct FStream* const stream = fstream_open(db->filename, FSTREAM_READ);
+	
+	if (stream == NULL) {
+		return -1;
+	}
+	
+	size_t size = 0;
+	const char* const data = fstream_map(stream, &size);
+	
+	if (data == NULL) {
+		fstream_close(stream);
+		return -1;
+	}
+	
+	int broken = 0;
+	size_t start = 0;
+	
+	while (start < size) {
+		const char* const end = memchr(data + start, '\n', size - start);
+		const size_t length = (end == NULL) ? size - start : (size_t) (end - (data + start));
+		
+		// A line without a line break can only be a record that was cut short
+		const int status = (end == NULL) ? 1 : statedb_parse(db, data + start, length);
+		
+		if (status == -1) {
+			fstream_close(stream);
+			return -1;
+		}
+		
+		if (status == 1) {
+			broken++;
+		}
+		
+		db->lines++;
+		
+		start += length + 1;
+	}
+	
+	fstream_close(stream);
+	
+	return broken;
+	
+}
+
+int statedb_open(struct StateDB* const db, const char* const filename) {
+	/*
+	Loads the records saved in the log (if it exists) and opens it for new records.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(db, 0, sizeof(*db));
+	
+	db->filename = statedb_strdup(filename);
+	
+	if (db->filename == NULL) {
+		return -1;
+	}
+	
+	switch (file_exists(filename)) {
+		case 1: {
+			const int broken = statedb_load(db);
+			
+			if (broken == -1) {
+				return -1;
+			}
+			
+			if ((broken > 0 || (db->lines > STATEDB_COMPACT_THRESHOLD && db->lines > db->count * 2)) && statedb_compact(db) == -1) {
+				return -1;
+			}
+			
+			break;
+		}
+		case -1:
+			return -1;
+	}
+	
+	db->stream = fstream_open(filename, FSTREAM_APPEND);
+	
+	if (db->stream == NULL) {
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+const struct StateRecord* statedb_get(const struct StateDB* const db, const enum StateKind kind, const char* const path) {
+	/*
+	Looks up the record of the item saved at the given path.
+	
+	Returns a null pointer if there is no such record.
+	*/
+	
+	if (db->size == 0) {
+		return NULL;
+	}
+	
+	const struct StateRecord* const record = statedb_slot(db->items, db->size, kind, path, statedb_hash(kind, path));
+	
+	return (record->path == NULL) ? NULL : record;
+	
+}
+
+int statedb_complete(const struct StateDB* const db, const enum StateKind kind, const char* const id, const char* const path) {
+	/*
+	Checks whether the item was completely downloaded to the given path.
+	
+	Returns (1) if it was, (0) otherwise.
+	*/
+	
+	const struct StateRecord* const record = statedb_get(db, kind, path);
+	
+	return (record != NULL && strcmp(record->id, id) == 0);
+	
+}
+
+int statedb_put(struct StateDB* const db, const struct StateRecord* const record) {
+	/*
+	Saves the record of a completed item, replacing any earlier record of it.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (statedb_insert(db, record) == -1 || statedb_write(db->stream, record) == -1) {
+		return -1;
+	}
+	
+	db->lines++;
+	
+	return 0;
+	
+}
+
+int statedb_invalidate(struct StateDB* const db, const enum StateKind kind, const char* const path) {
+	/*
+	Marks an item as no longer complete (e.g., because its file was found to be corrupted).
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	const struct StateRecord* const record = statedb_get(db, kind, path);
+	
+	if (record == NULL || *record->id == '\0') {
+		return 0;
+	}
+	
+	// The path may belong to the record being replaced
+	char copy[strlen(path) + 1];
+	strcpy(copy, path);
+	
+	const struct StateRecord invalid = {
+		.kind = kind,
+		.id = (char*) "",
+		.path = copy,
+		.size = -1
+	};
+	
+	return statedb_put(db, &invalid);
+	
+}
+
+void statedb_close(struct StateDB* const db) {
+	
+	if (db->stream != NULL) {
+		fstream_close(db->stream);
+	}
+	
+	for (size_t position = 0; position < db->size; position++) {
+		statedb_record_free(&db->items[position]);
+	}
+	
+	free(db->items);
+	free(db->filename);
+	
+	memset(db, 0, sizeof(*db));
+	
+}
@@ -0,0 +1,37 @@
+#include <stdlib.h>
+
+#include "fstream.h"
+
+enum StateKind {
+	STATE_PAGE,
+	STATE_FILE
+};
+
+struct StateRecord {
+	enum StateKind kind;
+	char* id; /* Empty for an item that is no longer complete */
+	char* path; /* Where the item was saved; together with the kind, this identifies the record */
+	char* url; /* NULL if not applicable */
+	long long size; /* (-1) if unknown */
+	char* validator; /* ETag or Last-Modified of the response, if any */
+	char* digest; /* SHA-256 of the contents (in hex), if known */
+	size_t hash;
+};
+
+struct StateDB {
+	char* filename;
+	struct FStream* stream; /* The log, opened for appending */
+	size_t lines; /* Number of records in the log, superseded ones included */
+	size_t count; /* Number of records in the table */
+	size_t size; /* Number of slots; always a power of two */
+	struct StateRecord* items;
+};
+
+int statedb_open(struct StateDB* const db, const char* const filename);
+const struct StateRecord* statedb_get(const struct StateDB* const db, const enum StateKind kind, const char* const path);
+int statedb_complete(const struct StateDB* const db, const enum StateKind kind, const char* const id, const char* const path);
+int statedb_put(struct StateDB* const db, const struct StateRecord* const record);
+int statedb_invalidate(struct StateDB* const db, const enum StateKind kind, const char* const path);
+void statedb_close(struct StateDB* const db);
+
+#pragma once
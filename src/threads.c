@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+#include "threads.h"
+
+/*
+A fixed-size pool of worker threads fed through a bounded queue.
+
+Submitting a job blocks while the queue is full, so whoever produces the work (and the
+resources each job holds on to, such as temporary files) is throttled by the workers.
+*/
+
+#ifdef _WIN32
+	#define threadpool_lock(pool) EnterCriticalSection(&(pool)->mutex)
+	#define threadpool_unlock(pool) LeaveCriticalSection(&(pool)->mutex)
+	#define threadpool_sleep(pool) SleepConditionVariableCS(&(pool)->changed, &(pool)->mutex, INFINITE)
+	#define threadpool_wake(pool) WakeAllConditionVariable(&(pool)->changed)
+#else
+	#define threadpool_lock(pool) pthread_mutex_lock(&(pool)->mutex)
+	#define threadpool_unlock(pool) pthread_mutex_unlock(&(pool)->mutex)
+	#define threadpool_sleep(pool) pthread_cond_wait(&(pool)->changed, &(pool)->mutex)
+	#define threadpool_wake(pool) pthread_cond_broadcast(&(pool)->changed)
+#endif
+
+static void threadpool_work(struct ThreadPool* const pool) {
+	
+	threadpool_lock(pool);
+	
+	while (1) {
+		while (pool->pending == 0 && !pool->stopping) {
+			threadpool_sleep(pool);
+		}
+		
+		// Jobs that are still queued when the pool is stopping are run anyway
+		if (pool->pending == 0) {
+			break;
+		}
+		
+		const struct ThreadJob job = pool->jobs[pool->head];
+		
+		pool->head = (pool->head + 1) % pool->backlog;
+		pool->pending--;
+		pool->active++;
+		
+		threadpool_wake(pool);
+		threadpool_unlock(pool);
+		
+		const int code = job.run(job.data);
+		
+		if (job.release != NULL) {
+			job.release(job.data);
+		}
+		
+		threadpool_lock(pool);
+		
+		if (code != 0) {
+			pool->failures++;
+		}
+		
+		pool->active--;
+		
+		threadpool_wake(pool);
+	}
+	
+	threadpool_unlock(pool);
+	
+}
+
+#ifdef _WIN32
+	static DWORD WINAPI threadpool_routine(LPVOID argument) {
+		
+		threadpool_work((struct ThreadPool*) argument);
+		
+		return 0;
+		
+	}
+#else
+	static void* threadpool_routine(void* argument) {
+		
+		threadpool_work((struct ThreadPool*) argument);
+		
+		return NULL;
+		
+	}
+#endif
+
+int threadpool_init(struct ThreadPool* const pool, const size_t count, const size_t backlog) {
+	/*
+	Starts a pool with the specified number of worker threads. With no workers (or if none of them
+	could be started), jobs run on the thread that submits them.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(pool, 0, sizeof(*pool));
+	
+	if (count == 0) {
+		return 0;
+	}
+	
+	pool->backlog = backlog < 1 ? 1 : backlog;
+	pool->jobs = malloc(pool->backlog * sizeof(*pool->jobs));
+	
+	if (pool->jobs == NULL) {
+		return -1;
+	}
+	
+	pool->threads = malloc(count * sizeof(*pool->threads));
+	
+	if (pool->threads == NULL) {
+		free(pool->jobs);
+		pool->jobs = NULL;
+		
+		return -1;
+	}
+	
+	#ifdef _WIN32
+		InitializeCriticalSection(&pool->mutex);
+		InitializeConditionVariable(&pool->changed);
+	#else
+		pthread_mutex_init(&pool->mutex, NULL);
+		pthread_cond_init(&pool->changed, NULL);
+	#endif
+	
+	for (size_t index = 0; index < count; index++) {
+		#ifdef _WIN32
+			pool->threads[index] = CreateThread(NULL, 0, threadpool_routine, (LPVOID) pool, 0, NULL);
+			
+			const int failed = (pool->threads[index] == NULL);
+		#else
+			const int failed = (pthread_create(&pool->threads[index], NULL, threadpool_routine, (void*) pool) != 0);
+		#endif
+		
+		// Make do with the workers that could be started
+		if (failed) {
+			break;
+		}
+		
+		pool->count++;
+	}
+	
+	return 0;
+	
+}
+
+int threadpool_submit(struct ThreadPool* const pool, int (*run)(void* const data), void (*release)(void* const data), void* const data) {
+	/*
+	Queues a job, waiting for room in the queue if it is full. The release callback (if any)
+	is called once the job is done with, whether it ran or not.
+	
+	Returns (0) on success, (-1) if a job has already failed (or, without workers, if this one did);
+	no more jobs are accepted after that.
+	*/
+	
+	if (pool->count == 0) {
+		if (pool->failures == 0 && run(data) != 0) {
+			pool->failures++;
+		}
+		
+		if (release != NULL) {
+			release(data);
+		}
+		
+		return pool->failures == 0 ? 0 : -1;
+	}
+	
+	threadpool_lock(pool);
+	
+	while (pool->pending == pool->backlog && pool->failures == 0) {
+		threadpool_sleep(pool);
+	}
+	
+	if (pool->failures != 0) {
+		threadpool_unlock(pool);
+		
+		if (release != NULL) {
+			release(data);
+		}
+		
+		return -1;
+	}
+	
+	const struct ThreadJob job = {
+		.run = run,
+		.release = release,
+		.data = data
+	};
+	
+	pool->jobs[(pool->head + pool->pending) % pool->backlog] = job;
+	pool->pending++;
+	
+	threadpool_wake(pool);
+	threadpool_unlock(pool);
+	
+	return 0;
+	
+}
+
+size_t threadpool_wait(struct ThreadPool* const pool) {
+	/*
+	Waits until every queued job is done.
+	
+	Returns the number of jobs that failed.
+	*/
+	
+	if (pool->count == 0) {
+		return pool->failures;
+	}
+	
+	threadpool_lock(pool);
+	
+	while (pool->pending > 0 || pool->active > 0) {
+		threadpool_sleep(pool);
+	}
+	
+	const size_t failures = pool->failures;
+	
+	threadpool_unlock(pool);
+	
+	return failures;
+	
+}
+
+void threadpool_free(struct ThreadPool* const pool) {
+	/*
+	Runs whatever is still queued, then stops the worker threads.
+	*/
+	
+	if (pool->threads == NULL) {
+		return;
+	}
+	
+	threadpool_lock(pool);
+	pool->stopping = 1;
+	threadpool_wake(pool);
+	threadpool_unlock(pool);
+	
+	for (size_t index = 0; index < pool->count; index++) {
+		#ifdef _WIN32
+			WaitForSingleObject(pool->threads[index], INFINITE);
+			CloseHandle(pool->threads[index]);
+		#else
+			pthread_join(pool->threads[index], NULL);
+		#endif
+	}
+	
+	#ifdef _WIN32
+		DeleteCriticalSection(&pool->mutex);
+	#else
+		pthread_mutex_destroy(&pool->mutex);
+		pthread_cond_destroy(&pool->changed);
+	#endif
+	
+	free(pool->threads);
+	free(pool->jobs);
+	
+	pool->threads = NULL;
+	pool->jobs = NULL;
+	pool->count = 0;
+	
+}
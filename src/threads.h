@@ -0,0 +1,40 @@
+#include <stdlib.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+struct ThreadJob {
+	int (*run)(void* const data);
+	void (*release)(void* const data);
+	void* data;
+};
+
+struct ThreadPool {
+#ifdef _WIN32
+	HANDLE* threads;
+	CRITICAL_SECTION mutex;
+	CONDITION_VARIABLE changed;
+#else
+	pthread_t* threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+#endif
+	size_t count; /* Number of worker threads; 0 means jobs run on the thread that submits them */
+	size_t backlog; /* Maximum number of jobs waiting for a worker */
+	struct ThreadJob* jobs;
+	size_t head;
+	size_t pending;
+	size_t active;
+	size_t failures;
+	int stopping;
+};
+
+int threadpool_init(struct ThreadPool* const pool, const size_t count, const size_t backlog);
+int threadpool_submit(struct ThreadPool* const pool, int (*run)(void* const data), void (*release)(void* const data), void* const data);
+size_t threadpool_wait(struct ThreadPool* const pool);
+void threadpool_free(struct ThreadPool* const pool);
+
+#pragma once
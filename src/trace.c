@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "trace.h"
+#include "fstream.h"
+#include "os.h"
+#include "cleanup.h"
+
+/*
+Spans of the phases of a run (logging in, listing resources, modules and pages, copying streams,
+moving files into place) and of each HTTP transfer, written in the Trace Event format of Chrome,
+so that a run can be loaded into Perfetto (or chrome://tracing) to see where the time goes.
+
+Phases are complete events on the track of the thread that ran them. Transfers overlap on the
+thread that runs the multi handle, so they are async events instead, each one on a track of its
+own, split into the DNS lookup, connect, TLS handshake, wait for the first byte and download
+times reported by cURL.
+
+The trace is process-wide: spans may be recorded from any thread once trace_open() was called
+(before any thread other than the main one is started). It is written out as it goes and
+closed when the process exits.
+*/
+
+#define TRACE_PID 1
+
+static struct FStream* trace_stream_global = NULL;
+static long long trace_started_global = 0;
+static size_t trace_events_global = 0;
+static long trace_threads_global = 0;
+static long long trace_transfers_global = 0;
+
+/* Track number of the calling thread; thread-specific storage, as not every target has __thread */
+#ifdef _WIN32
+	static DWORD trace_thread_global = TLS_OUT_OF_INDEXES;
+#else
+	static pthread_key_t trace_thread_global;
+#endif
+
+#ifdef _WIN32
+	static CRITICAL_SECTION trace_mutex_global;
+#else
+	static pthread_mutex_t trace_mutex_global = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void trace_lock(void) {
+	
+	#ifdef _WIN32
+		EnterCriticalSection(&trace_mutex_global);
+	#else
+		pthread_mutex_lock(&trace_mutex_global);
+	#endif
+	
+}
+
+static void trace_unlock(void) {
+	
+	#ifdef _WIN32
+		LeaveCriticalSection(&trace_mutex_global);
+	#else
+		pthread_mutex_unlock(&trace_mutex_global);
+	#endif
+	
+}
+
+static void trace_close(void) {
+	
+	trace_lock();
+	
+	fstream_write(trace_stream_global, "\n]\n", 3);
+	fstream_close(trace_stream_global);
+	
+	trace_stream_global = NULL;
+	
+	trace_unlock();
+	
+}
+
+static void trace_write(json_t* const event) {
+	/*
+	Writes the event to the trace, tagged with the thread that recorded it. Takes ownership of the
+	event.
+	*/
+	
+	json_auto_t* tree = event;
+	
+	if (tree == NULL) {
+		return;
+	}
+	
+	trace_lock();
+	
+	if (trace_stream_global == NULL) {
+		trace_unlock();
+		return;
+	}
+	
+	#ifdef _WIN32
+		long thread = (long) (intptr_t) TlsGetValue(trace_thread_global);
+	#else
+		long thread = (long) (intptr_t) pthread_getspecific(trace_thread_global);
+	#endif
+	
+	if (thread == 0) {
+		thread = ++trace_threads_global;
+		
+		#ifdef _WIN32
+			TlsSetValue(trace_thread_global, (void*) (intptr_t) thread);
+		#else
+			pthread_setspecific(trace_thread_global, (void*) (intptr_t) thread);
+		#endif
+	}
+	
+	json_object_set_new(tree, "pid", json_integer(TRACE_PID));
+	json_object_set_new(tree, "tid", json_integer((json_int_t) thread));
+	
+	char* line __free__ = json_dumps(tree, JSON_COMPACT);
+	
+	if (line != NULL) {
+		if (trace_events_global++ > 0) {
+			fstream_write(trace_stream_global, ",\n", 2);
+		}
+		
+		fstream_write(trace_stream_global, line, strlen(line));
+	}
+	
+	trace_unlock();
+	
+}
+
+static json_t* trace_event(const char* const name, const char* const phase, const long long timestamp) {
+	
+	json_t* const event = json_object();
+	
+	if (event == NULL) {
+		return NULL;
+	}
+	
+	json_object_set_new(event, "name", json_string(name));
+	json_object_set_new(event, "ph", json_string(phase));
+	json_object_set_new(event, "ts", json_integer((json_int_t) (timestamp - trace_started_global)));
+	
+	return event;
+	
+}
+
+int trace_open(const char* const filename) {
+	/*
+	Starts recording spans into the file.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	#ifdef _WIN32
+		trace_thread_global = TlsAlloc();
+		
+		if (trace_thread_global == TLS_OUT_OF_INDEXES) {
+			return -1;
+		}
+	#else
+		if (pthread_key_create(&trace_thread_global, NULL) != 0) {
+			return -1;
+		}
+	#endif
+	
+	trace_stream_global = fstream_open(filename, FSTREAM_WRITE);
+	
+	if (trace_stream_global == NULL) {
+		return -1;
+	}
+	
+	#ifdef _WIN32
+		InitializeCriticalSection(&trace_mutex_global);
+	#endif
+	
+	trace_started_global = get_monotonic_clock();
+	
+	fstream_write(trace_stream_global, "[\n", 2);
+	
+	atexit(trace_close);
+	
+	return 0;
+	
+}
+
+long long trace_clock(void) {
+	/*
+	Returns the time a span starts at, to be given to trace_span() once it ends; (0) if no
+	trace is being recorded.
+	*/
+	
+	if (trace_stream_global == NULL) {
+		return 0;
+	}
+	
+	return get_monotonic_clock();
+	
+}
+
+void trace_span(const char* const name, const char* const detail, const long long start) {
+	/*
+	Records a span that started at the given time (see trace_clock()) and ends now, on the
+	calling thread. The detail (e.g., what the phase was about) may be a null pointer.
+	*/
+	
+	if (start == 0) {
+		return;
+	}
+	
+	json_t* const event = trace_event(name, "X", start);
+	
+	if (event == NULL) {
+		return;
+	}
+	
+	json_object_set_new(event, "cat", json_string("phase"));
+	json_object_set_new(event, "dur", json_integer((json_int_t) (get_monotonic_clock() - start)));
+	
+	if (detail != NULL) {
+		json_t* const args = json_object();
+		
+		json_object_set_new(args, "detail", json_string(detail));
+		json_object_set_new(event, "args", args);
+	}
+	
+	trace_write(event);
+	
+}
+
+static void trace_async(const char* const name, const long long id, const long long start, const long long end, json_t* const args) {
+	/*
+	Records a span of a transfer, as a pair of async events. Takes ownership of the arguments.
+	*/
+	
+	json_t* const begin = trace_event(name, "b", start);
+	json_t* const finish = trace_event(name, "e", end);
+	
+	if (begin == NULL || finish == NULL) {
+		json_decref(begin);
+		json_decref(finish);
+		json_decref(args);
+		return;
+	}
+	
+	json_object_set_new(begin, "cat", json_string("transfer"));
+	json_object_set_new(begin, "id", json_integer((json_int_t) id));
+	
+	if (args != NULL) {
+		json_object_set_new(begin, "args", args);
+	}
+	
+	json_object_set_new(finish, "cat", json_string("transfer"));
+	json_object_set_new(finish, "id", json_integer((json_int_t) id));
+	
+	trace_write(begin);
+	trace_write(finish);
+	
+}
+
+void trace_transfer(CURL* const handle, const CURLcode result) {
+	/*
+	Records a transfer that just ended (whether or not it succeeded), along with the time it
+	spent on each of its stages.
+	*/
+	
+	if (trace_stream_global == NULL) {
+		return;
+	}
+	
+	#if LIBCURL_VERSION_NUM >= 0x073d00
+		const long long end = get_monotonic_clock();
+		
+		curl_off_t total = 0;
+		curl_off_t stages[5] = {0};
+		
+		curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+		curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &stages[0]);
+		curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &stages[1]);
+		curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &stages[2]);
+		curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &stages[3]);
+		stages[4] = total;
+		
+		/*
+		The times are measured from the start of the transfer, and each stage ends where the next
+		one starts. The TLS handshake is 0 for plain HTTP; the wait for the first byte is measured
+		from the end of whichever of the first stages took place.
+		*/
+		static const char* const STAGES[] = {"dns", "connect", "tls", "ttfb", "download"};
+		
+		const long long start = end - (long long) total;
+		
+		char* url = NULL;
+		long status_code = 0;
+		curl_off_t size = 0;
+		
+		curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+		curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status_code);
+		curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+		
+		json_t* const args = json_object();
+		
+		if (args != NULL) {
+			json_object_set_new(args, "url", url == NULL ? json_null() : json_string(url));
+			json_object_set_new(args, "status", json_integer((json_int_t) status_code));
+			json_object_set_new(args, "bytes", json_integer((json_int_t) size));
+			json_object_set_new(args, "result", json_string(curl_easy_strerror(result)));
+		}
+		
+		trace_lock();
+		const long long id = ++trace_transfers_global;
+		trace_unlock();
+		
+		trace_async("transfer", id, start, end, args);
+		
+		curl_off_t previous = 0;
+		
+		for (size_t index = 0; index < sizeof(stages) / sizeof(*stages); index++) {
+			const curl_off_t stage = stages[index];
+			
+			// Stages that did not take place (e.g., on a reused connection) are not recorded
+			if (stage <= previous) {
+				continue;
+			}
+			
+			trace_async(STAGES[index], id, start + (long long) previous, start + (long long) stage, NULL);
+			
+			previous = stage;
+		}
+	#else
+		(void) handle;
+		(void) result;
+	#endif
+	
+}
@@ -0,0 +1,10 @@
+#include <stdlib.h>
+
+#include <curl/curl.h>
+
+int trace_open(const char* const filename);
+long long trace_clock(void);
+void trace_span(const char* const name, const char* const detail, const long long start);
+void trace_transfer(CURL* const handle, const CURLcode result);
+
+#pragma once
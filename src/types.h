@@ -5,6 +5,8 @@
 #include <jansson.h>
 
 #include "fstream.h"
+#include "writer.h"
+#include "progress.h"
 
 typedef struct string_array_t {
 	size_t offset;
@@ -21,7 +23,22 @@ typedef struct jint_array_t {
 struct Download {
 	CURL* handle;
 	char* filename;
-	struct FStream* stream;
+	struct WriterFile* file;
+	struct SHA256* digest; /* Hash of the contents, if wanted */
+	int keep; /* Whether the handle is kept once the transfer is done, so that its response can still be looked into */
+	CURL* finished; /* The handle of the finished transfer, if kept */
+	long long received; /* Bytes received by the transfer, as last accounted for in the progress */
+	size_t host; /* Host of the transfer within the progress (see progress_host()); 0 until known */
+	size_t retries; /* Number of times the transfer was retried */
+	long long retry_at; /* When the failed transfer is to be tried again (see get_monotonic_clock()); 0 if it is not waiting */
+};
+
+struct Downloads {
+	size_t offset;
+	size_t size;
+	struct Download* items;
+	size_t limit; /* Maximum number of transfers running at the same time; 0 means no limit */
+	struct Progress* progress; /* Where the transfers are accounted for */
 };
 
 void string_array_free(string_array_t* obj);
@@ -14,6 +14,7 @@
 #include "vimeo.h"
 #include "buffer.h"
 #include "curl.h"
+#include "scan.h"
 
 static const char VIMEO_URL_PATTERN[] = "https://player.vimeo.com/video";
 
@@ -66,7 +67,9 @@ int vimeo_parse(
 	curl_easy_setopt(curl_easy, CURLOPT_REFERER, NULL);
 	curl_easy_setopt(curl_easy, CURLOPT_URL, NULL);
 	
-	const char* start = strstr(string.s, JSON_TREE_PATTERN);
+	const char* const send = string.s + string.slength;
+	
+	const char* start = scan_find(string.s, send, JSON_TREE_PATTERN);
 	
 	if (start == NULL) {
 		return UERR_STRSTR_FAILURE;
@@ -81,7 +84,7 @@ int vimeo_parse(
 	for (size_t index = 0; index < sizeof(patterns) / sizeof(*patterns); index++) {
 		const char* const pattern = patterns[index];
 		
-		if ((end = strstr(start, pattern)) != NULL) {
+		if ((end = scan_find(start, send, pattern)) != NULL) {
 			break;
 		}
 	}
@@ -94,11 +97,7 @@ int vimeo_parse(
 	
 	const size_t size = (size_t) (end - start);
 	
-	char text[size + 1];
-	memcpy(text, start, size);
-	text[size] = '\0';
-	
-	json_auto_t* tree = json_loads(text, 0, NULL);
+	json_auto_t* tree = json_loadb(start, size, 0, NULL);
 	
 	if (tree == NULL) {
 		return UERR_JSON_CANNOT_PARSE;
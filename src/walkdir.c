@@ -7,9 +7,7 @@
 
 #if !defined(_WIN32)
 	#include <dirent.h>
-#endif
-
-#if defined(__HAIKU__)
+	#include <fcntl.h>
 	#include <sys/stat.h>
 #endif
 
@@ -195,6 +193,39 @@ const struct WalkDirItem* walkdir_next(struct WalkDir* const walkdir) {
 	
 }
 
+int walkdir_stat(struct WalkDir* const walkdir) {
+	/*
+	Fills in the size and modification time of the current item. Windows lists them along with
+	the names, so this is free there; elsewhere, it takes a stat() relative to the directory.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct WalkDirItem* const item = &walkdir->item;
+	
+	#if defined(_WIN32)
+		ULARGE_INTEGER mtime = {0};
+		mtime.LowPart = walkdir->data.ftLastWriteTime.dwLowDateTime;
+		mtime.HighPart = walkdir->data.ftLastWriteTime.dwHighDateTime;
+		
+		// FILETIME counts 100-nanosecond intervals since 1601
+		item->size = (long long) (((unsigned long long) walkdir->data.nFileSizeHigh << 32) | walkdir->data.nFileSizeLow);
+		item->mtime = (long long) ((mtime.QuadPart - 116444736000000000ULL) / 10000000ULL);
+	#else
+		struct stat st = {0};
+		
+		if (fstatat(dirfd(walkdir->dir), item->name, &st, 0) == -1) {
+			return -1;
+		}
+		
+		item->size = (long long) st.st_size;
+		item->mtime = (long long) st.st_mtime;
+	#endif
+	
+	return 0;
+	
+}
+
 void walkdir_free(struct WalkDir* const walkdir) {
 	
 	#if defined(_WIN32)
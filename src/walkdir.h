@@ -20,6 +20,8 @@ struct WalkDirItem {
 	enum WalkDirType type;
 	size_t index;
 	char name[NAME_MAX + 1];
+	long long size; /* Filled in by walkdir_stat() */
+	long long mtime; /* Seconds since the Unix epoch; filled in by walkdir_stat() */
 };
 
 struct WalkDir {
@@ -37,6 +39,7 @@ struct WalkDir {
 
 int walkdir_init(struct WalkDir* const walkdir, const char* const directory);
 const struct WalkDirItem* walkdir_next(struct WalkDir* const walkdir);
+int walkdir_stat(struct WalkDir* const walkdir);
 void walkdir_free(struct WalkDir* const walkdir);
 
 #pragma once
@@ -0,0 +1,609 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "writer.h"
+#include "errors.h"
+
+#if defined(_WIN32) && defined(_UNICODE)
+	#include "wio.h"
+#endif
+
+/*
+Writes files on a worker thread, so that a slow disk (e.g., a USB drive or a network mount)
+does not hold up the thread that runs the transfers.
+
+Data is gathered into buffers taken from a bounded pool; once full, a buffer is queued for
+the worker and goes back to the pool after being written. When the pool runs dry, writers are
+told to wait (see writer_write()) instead of being blocked, and the wakeup callback lets them know
+once a buffer is available again.
+
+Operations are queued on a list of the writer's own, which has no bound: other than writes,
+they take no buffer from the pool, and queueing one must never block the thread that runs the
+transfers either. The worker is only handed a job to drain the list when it is not draining
+it already.
+*/
+
+#ifdef _WIN32
+	#define writer_lock(writer) EnterCriticalSection(&(writer)->mutex)
+	#define writer_unlock(writer) LeaveCriticalSection(&(writer)->mutex)
+#else
+	#define writer_lock(writer) pthread_mutex_lock(&(writer)->mutex)
+	#define writer_unlock(writer) pthread_mutex_unlock(&(writer)->mutex)
+#endif
+
+enum WriterOperation {
+	WRITER_WRITE,
+	WRITER_ALLOCATE,
+	WRITER_REWIND,
+	WRITER_CLOSE
+};
+
+struct WriterBuffer {
+	struct Writer* writer;
+	struct WriterFile* file;
+	enum WriterOperation operation;
+	char* data;
+	size_t size;
+	long long reserve; /* Size to reserve disk space for, with WRITER_ALLOCATE */
+	struct WriterBuffer* next;
+};
+
+static int writer_run(void* const data) {
+	/*
+	Carries out a queued operation. This runs on the worker thread.
+	*/
+	
+	const struct WriterBuffer* const buffer = (const struct WriterBuffer*) data;
+	struct WriterFile* const file = buffer->file;
+	
+	switch (buffer->operation) {
+		case WRITER_WRITE: {
+			if (fstream_write(file->stream, buffer->data, buffer->size) == -1) {
+				const struct SystemError error = get_system_error();
+				
+				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o arquivo em '%s': %s\r\n", file->filename, error.message);
+				return -1;
+			}
+			
+			break;
+		}
+		case WRITER_ALLOCATE: {
+			// This is only a hint (see fstream_allocate()); the file is written all the same if it fails
+			fstream_allocate(file->stream, buffer->reserve);
+			
+			break;
+		}
+		case WRITER_REWIND: {
+			// Whatever was written before must not outlive the new contents, which may be shorter
+			if (fstream_seek(file->stream, 0, FSTREAM_SEEK_BEGIN) == -1 || fstream_truncate(file->stream) == -1) {
+				const struct SystemError error = get_system_error();
+				
+				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar mover a posição do arquivo em '%s': %s\r\n", file->filename, error.message);
+				return -1;
+			}
+			
+			break;
+		}
+		case WRITER_CLOSE: {
+			const int status = fstream_close(file->stream);
+			
+			file->stream = NULL;
+			
+			if (status == -1) {
+				const struct SystemError error = get_system_error();
+				
+				fprintf(stderr, "- Ocorreu uma falha inesperada ao tentar salvar o arquivo em '%s': %s\r\n", file->filename, error.message);
+				return -1;
+			}
+			
+			break;
+		}
+	}
+	
+	return 0;
+	
+}
+
+static void writer_release(struct WriterBuffer* const buffer) {
+	/*
+	Puts a buffer back into the pool, waking up whoever is waiting for one. This is called
+	once an operation is done with, whether it was carried out or not; whatever was queued
+	before it is done with already.
+	*/
+	
+	struct Writer* const writer = buffer->writer;
+	
+	if (buffer->operation == WRITER_CLOSE) {
+		struct WriterFile* const file = buffer->file;
+		
+		// The operation was skipped after an earlier one failed; the file still has to be closed
+		if (file->stream != NULL) {
+			fstream_close(file->stream);
+		}
+		
+		free(file->filename);
+		free(file);
+	}
+	
+	// Only writes use buffers from the pool
+	if (buffer->operation != WRITER_WRITE) {
+		free(buffer);
+		return;
+	}
+	
+	buffer->file = NULL;
+	buffer->size = 0;
+	
+	writer_lock(writer);
+	
+	buffer->next = writer->buffers;
+	writer->buffers = buffer;
+	
+	const size_t paused = writer->paused;
+	
+	writer_unlock(writer);
+	
+	if (paused > 0 && writer->wakeup != NULL) {
+		(*writer->wakeup)(writer->wakeup_data);
+	}
+	
+}
+
+static int writer_drain(void* const data) {
+	/*
+	Carries out the queued operations until there are none left. This runs on the worker thread.
+	
+	Once an operation fails, the ones after it are released without being carried out.
+	*/
+	
+	struct Writer* const writer = (struct Writer*) data;
+	
+	while (1) {
+		writer_lock(writer);
+		
+		struct WriterBuffer* const buffer = writer->queue;
+		
+		if (buffer == NULL) {
+			writer->draining = 0;
+			writer_unlock(writer);
+			
+			break;
+		}
+		
+		writer->queue = buffer->next;
+		
+		if (writer->queue == NULL) {
+			writer->queue_tail = NULL;
+		}
+		
+		const size_t failures = writer->failures;
+		
+		writer_unlock(writer);
+		
+		buffer->next = NULL;
+		
+		if (failures == 0 && writer_run(buffer) != 0) {
+			writer_lock(writer);
+			writer->failures++;
+			writer_unlock(writer);
+		}
+		
+		writer_release(buffer);
+	}
+	
+	// Failures are counted by the writer; the pool must keep taking jobs regardless
+	return 0;
+	
+}
+
+static int writer_acquire(struct WriterFile* const file, struct WriterBuffer** const buffer) {
+	/*
+	Takes a buffer from the pool, allocating a new one if the pool is not full yet.
+	
+	Returns (0) on success, (1) if the pool has run dry (the file is then marked as waiting
+	for a buffer), (-1) on error.
+	*/
+	
+	struct Writer* const writer = file->writer;
+	
+	writer_lock(writer);
+	
+	*buffer = writer->buffers;
+	
+	if (*buffer != NULL) {
+		writer->buffers = (*buffer)->next;
+		writer_unlock(writer);
+		
+		return 0;
+	}
+	
+	if (writer->allocated == writer->limit) {
+		if (!file->paused) {
+			file->paused = 1;
+			writer->paused++;
+		}
+		
+		writer_unlock(writer);
+		
+		return 1;
+	}
+	
+	writer->allocated++;
+	
+	writer_unlock(writer);
+	
+	// The buffer and its data are allocated together
+	*buffer = malloc(sizeof(**buffer) + writer->buffer_size);
+	
+	if (*buffer == NULL) {
+		writer_lock(writer);
+		writer->allocated--;
+		writer_unlock(writer);
+		
+		return -1;
+	}
+	
+	(*buffer)->writer = writer;
+	(*buffer)->operation = WRITER_WRITE;
+	(*buffer)->data = (char*) (*buffer + 1);
+	(*buffer)->size = 0;
+	(*buffer)->reserve = 0;
+	(*buffer)->next = NULL;
+	
+	return 0;
+	
+}
+
+static int writer_submit(struct WriterFile* const file, const enum WriterOperation operation, const long long reserve) {
+	/*
+	Queues an operation on the file. Writes queue the buffer being filled; allocations carry the
+	size to reserve disk space for.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct Writer* const writer = file->writer;
+	struct WriterBuffer* buffer = NULL;
+	
+	if (operation == WRITER_WRITE) {
+		buffer = file->current;
+		file->current = NULL;
+	} else if (operation == WRITER_CLOSE) {
+		buffer = file->closing;
+		file->closing = NULL;
+	} else {
+		buffer = malloc(sizeof(*buffer));
+		
+		if (buffer == NULL) {
+			return -1;
+		}
+		
+		buffer->writer = writer;
+		buffer->operation = operation;
+		buffer->data = NULL;
+		buffer->size = 0;
+		buffer->reserve = reserve;
+		buffer->next = NULL;
+	}
+	
+	buffer->file = file;
+	buffer->next = NULL;
+	
+	writer_lock(writer);
+	
+	if (writer->failures != 0) {
+		writer_unlock(writer);
+		
+		// Whatever is still queued for the file has to be done with before it is released
+		threadpool_wait(&writer->pool);
+		writer_release(buffer);
+		
+		return -1;
+	}
+	
+	if (writer->queue_tail == NULL) {
+		writer->queue = buffer;
+	} else {
+		writer->queue_tail->next = buffer;
+	}
+	
+	writer->queue_tail = buffer;
+	
+	const int draining = writer->draining;
+	writer->draining = 1;
+	
+	writer_unlock(writer);
+	
+	if (draining) {
+		return 0;
+	}
+	
+	// At most one job is ever waiting in the pool (see writer_drain()), so this never blocks
+	return threadpool_submit(&writer->pool, writer_drain, NULL, writer);
+	
+}
+
+int writer_init(
+	struct Writer* const writer,
+	const size_t buffers,
+	const size_t buffer_size,
+	void (*wakeup)(void* const data),
+	void* const wakeup_data
+) {
+	/*
+	Starts the worker thread. At most the specified number of buffers are allocated (as they
+	are needed), each one of the specified size. If the worker cannot be started, files are
+	written on the thread that fills them.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	memset(writer, 0, sizeof(*writer));
+	
+	writer->limit = buffers < 1 ? 1 : buffers;
+	writer->buffer_size = buffer_size;
+	writer->wakeup = wakeup;
+	writer->wakeup_data = wakeup_data;
+	
+	// Room for the job being run, plus the one that picks up whatever was queued in the meantime
+	if (threadpool_init(&writer->pool, 1, 2) != 0) {
+		writer->limit = 0;
+		return -1;
+	}
+	
+	#ifdef _WIN32
+		InitializeCriticalSection(&writer->mutex);
+	#else
+		pthread_mutex_init(&writer->mutex, NULL);
+	#endif
+	
+	return 0;
+	
+}
+
+struct WriterFile* writer_open(struct Writer* const writer, const char* const filename, struct SHA256* const digest) {
+	/*
+	Creates a file to be written through the writer. If a hash context is given, the contents
+	are hashed into it by the worker as they are written (see fstream_digest()); it must stay
+	around until writer_wait() returns.
+	
+	Returns a null pointer on error.
+	*/
+	
+	struct WriterFile* const file = calloc(1, sizeof(*file));
+	
+	if (file == NULL) {
+		return NULL;
+	}
+	
+	file->writer = writer;
+	file->filename = malloc(strlen(filename) + 1);
+	
+	if (file->filename == NULL) {
+		free(file);
+		return NULL;
+	}
+	
+	strcpy(file->filename, filename);
+	
+	file->closing = malloc(sizeof(*file->closing));
+	
+	if (file->closing == NULL) {
+		free(file->filename);
+		free(file);
+		
+		return NULL;
+	}
+	
+	file->closing->writer = writer;
+	file->closing->operation = WRITER_CLOSE;
+	file->closing->data = NULL;
+	file->closing->size = 0;
+	file->closing->reserve = 0;
+	file->closing->next = NULL;
+	
+	file->stream = fstream_open(filename, FSTREAM_WRITE);
+	
+	if (file->stream == NULL) {
+		free(file->closing);
+		free(file->filename);
+		free(file);
+		
+		return NULL;
+	}
+	
+	if (digest != NULL) {
+		fstream_digest(file->stream, digest);
+	}
+	
+	return file;
+	
+}
+
+int writer_write(struct WriterFile* const file, const char* const data, const size_t size) {
+	/*
+	Appends a block of data to the file. The block is either taken as a whole or not at all;
+	it must not be larger than the buffers.
+	
+	Returns (0) on success, (1) if there is no buffer available at the moment (try again once
+	writer_resume() says so), (-1) on error.
+	*/
+	
+	struct Writer* const writer = file->writer;
+	
+	if (size > writer->buffer_size) {
+		return -1;
+	}
+	
+	// A full buffer is queued right away, so that files waiting for a buffer never hold on to one
+	if (file->current != NULL && file->current->size + size > writer->buffer_size && writer_submit(file, WRITER_WRITE, 0) != 0) {
+		return -1;
+	}
+	
+	if (file->current == NULL) {
+		const int status = writer_acquire(file, &file->current);
+		
+		if (status != 0) {
+			file->current = NULL;
+			return status;
+		}
+	}
+	
+	struct WriterBuffer* const buffer = file->current;
+	
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+	
+	return 0;
+	
+}
+
+int writer_resume(struct WriterFile* const file) {
+	/*
+	Checks whether a file that was told to wait for a buffer can be written to again.
+	
+	Returns (1) if so, (0) otherwise.
+	*/
+	
+	struct Writer* const writer = file->writer;
+	
+	if (!file->paused) {
+		return 0;
+	}
+	
+	writer_lock(writer);
+	
+	const int available = (writer->buffers != NULL || writer->allocated < writer->limit);
+	
+	if (available) {
+		file->paused = 0;
+		writer->paused--;
+	}
+	
+	writer_unlock(writer);
+	
+	return available;
+	
+}
+
+int writer_allocate(struct WriterFile* const file, const long long size) {
+	/*
+	Has the worker reserve disk space for the file, which is expected to grow up to the specified
+	size (see fstream_allocate()). The stream belongs to the worker, so this is queued like any
+	other operation. Asking for a size that was already asked for does nothing.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (size <= file->reserved) {
+		return 0;
+	}
+	
+	file->reserved = size;
+	
+	return writer_submit(file, WRITER_ALLOCATE, size);
+	
+}
+
+int writer_rewind(struct WriterFile* const file) {
+	/*
+	Discards whatever was not written yet and starts writing the file over.
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	if (file->current != NULL) {
+		file->current->size = 0;
+	}
+	
+	return writer_submit(file, WRITER_REWIND, 0);
+	
+}
+
+int writer_close(struct WriterFile* const file) {
+	/*
+	Writes whatever is left and closes the file; the file must not be used anymore after this.
+	Errors that happen from here on are only reported by writer_wait().
+	
+	Returns (0) on success, (-1) on error.
+	*/
+	
+	struct Writer* const writer = file->writer;
+	
+	if (file->paused) {
+		writer_lock(writer);
+		
+		file->paused = 0;
+		writer->paused--;
+		
+		writer_unlock(writer);
+	}
+	
+	int status = 0;
+	
+	if (file->current != NULL) {
+		if (file->current->size > 0) {
+			status = writer_submit(file, WRITER_WRITE, 0);
+		} else {
+			file->current->file = file;
+			writer_release(file->current);
+			file->current = NULL;
+		}
+	}
+	
+	// The file is closed (and released) even if this fails
+	if (writer_submit(file, WRITER_CLOSE, 0) != 0) {
+		status = -1;
+	}
+	
+	return status;
+	
+}
+
+size_t writer_wait(struct Writer* const writer) {
+	/*
+	Waits until everything queued has been written.
+	
+	Returns the number of operations that failed.
+	*/
+	
+	threadpool_wait(&writer->pool);
+	
+	writer_lock(writer);
+	const size_t failures = writer->failures;
+	writer_unlock(writer);
+	
+	return failures;
+	
+}
+
+void writer_free(struct Writer* const writer) {
+	/*
+	Writes whatever is still queued, then stops the worker thread. Does nothing if the writer
+	was never initialized or was already freed.
+	*/
+	
+	if (writer->limit == 0) {
+		return;
+	}
+	
+	threadpool_free(&writer->pool);
+	
+	while (writer->buffers != NULL) {
+		struct WriterBuffer* const buffer = writer->buffers;
+		
+		writer->buffers = buffer->next;
+		free(buffer);
+	}
+	
+	#ifdef _WIN32
+		DeleteCriticalSection(&writer->mutex);
+	#else
+		pthread_mutex_destroy(&writer->mutex);
+	#endif
+	
+	writer->allocated = 0;
+	writer->limit = 0;
+	
+}
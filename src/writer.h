@@ -0,0 +1,60 @@
+#include <stdlib.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+#include "threads.h"
+#include "fstream.h"
+
+struct WriterBuffer;
+
+struct Writer {
+	struct ThreadPool pool; /* A single worker, which drains the queue */
+#ifdef _WIN32
+	CRITICAL_SECTION mutex;
+#else
+	pthread_mutex_t mutex;
+#endif
+	struct WriterBuffer* queue; /* Operations waiting for the worker, in the order they were queued */
+	struct WriterBuffer* queue_tail;
+	int draining; /* Whether the worker was handed the queue already */
+	size_t failures; /* Number of operations that failed */
+	struct WriterBuffer* buffers; /* Buffers ready to be filled */
+	size_t allocated; /* Number of buffers allocated so far */
+	size_t limit; /* Maximum number of buffers */
+	size_t buffer_size;
+	size_t paused; /* Number of files waiting for a buffer */
+	void (*wakeup)(void* const data); /* Called from the worker thread whenever a buffer is released while files are waiting */
+	void* wakeup_data;
+};
+
+struct WriterFile {
+	struct Writer* writer;
+	struct FStream* stream;
+	char* filename;
+	struct WriterBuffer* current; /* Buffer being filled */
+	struct WriterBuffer* closing; /* Allocated upfront, so that closing the file never fails for lack of memory */
+	int paused;
+	long long reserved; /* Largest size disk space was asked to be reserved for (see writer_allocate()) */
+};
+
+int writer_init(
+	struct Writer* const writer,
+	const size_t buffers,
+	const size_t buffer_size,
+	void (*wakeup)(void* const data),
+	void* const wakeup_data
+);
+struct WriterFile* writer_open(struct Writer* const writer, const char* const filename, struct SHA256* const digest);
+int writer_write(struct WriterFile* const file, const char* const data, const size_t size);
+int writer_resume(struct WriterFile* const file);
+int writer_allocate(struct WriterFile* const file, const long long size);
+int writer_rewind(struct WriterFile* const file);
+int writer_close(struct WriterFile* const file);
+size_t writer_wait(struct Writer* const writer);
+void writer_free(struct Writer* const writer);
+
+#pragma once